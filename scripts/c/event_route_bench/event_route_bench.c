@@ -0,0 +1,324 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2010, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * event_route_bench.c -- delivery cost of the event route index against the per id node walk
+ *
+ * Copies of switch_events_match, the EVENT_NODES lists and the route lookup from switch_event.c, with a trivial
+ * callback so only the cost of finding the bindings is measured.  For each binding count it delivers the same
+ * stream of events both ways and prints ns per event:
+ *
+ *   walk   walk EVENT_NODES[id] and EVENT_NODES[ALL] and match every node, what switch_event_deliver did before
+ *   route  build the id:subclass key, look it up under a read lock and call the resolved nodes
+ *
+ * The bindings are spread like a busy box: most are CUSTOM subclass listeners (modules and event socket clients
+ * subscribing to their own subclasses), the rest on channel ids and a few on ALL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#define EV_IDS 64
+#define EV_CUSTOM 0
+#define EV_ALL (EV_IDS - 1)
+#define ROUTE_BUCKETS 1024
+#define EVENTS 1000000
+
+typedef struct node {
+	int event_id;
+	char *subclass_name;
+	int dynamic;
+	struct node *next;
+} node_t;
+
+typedef struct event {
+	int event_id;
+	const char *subclass_name;
+} event_t;
+
+typedef struct route {
+	char *key;
+	uint32_t count;
+	struct route *next;
+	node_t *nodes[1];
+} route_t;
+
+static node_t *EVENT_NODES[EV_IDS];
+static route_t *ROUTES[ROUTE_BUCKETS];
+static pthread_rwlock_t ROUTE_RWLOCK = PTHREAD_RWLOCK_INITIALIZER;
+static volatile uint64_t DELIVERED;
+
+static void callback(event_t *event)
+{
+	DELIVERED++;
+}
+
+/* the same rules as switch_events_match, file: and func: need the event headers so they are always dynamic */
+static int events_match(event_t *event, node_t *node)
+{
+	int match = 0;
+
+	if (node->event_id == EV_ALL) {
+		match++;
+
+		if (!node->subclass_name) {
+			return match;
+		}
+	}
+
+	if (match || event->event_id == node->event_id) {
+		if (event->subclass_name && node->subclass_name) {
+			if (!strncasecmp(node->subclass_name, "file:", 5) || !strncasecmp(node->subclass_name, "func:", 5)) {
+				match = 0;
+			} else {
+				match = strstr(event->subclass_name, node->subclass_name) ? 1 : 0;
+			}
+		} else if ((event->subclass_name && !node->subclass_name) || (!event->subclass_name && !node->subclass_name)) {
+			match = 1;
+		} else {
+			match = 0;
+		}
+	}
+
+	return match;
+}
+
+static void deliver_walk(event_t *event)
+{
+	node_t *node;
+	int e;
+
+	for (e = event->event_id;; e = EV_ALL) {
+		for (node = EVENT_NODES[e]; node; node = node->next) {
+			if (events_match(event, node)) {
+				callback(event);
+			}
+		}
+		if (e == EV_ALL) {
+			break;
+		}
+	}
+}
+
+static uint32_t hash_key(const char *key)
+{
+	uint32_t h = 0;
+
+	/* switch_core_hash is case insensitive too */
+	while (*key) {
+		h = h * 33 + (uint8_t) (*key++ | 0x20);
+	}
+
+	return h;
+}
+
+static route_t *get_route(event_t *event)
+{
+	char key[256];
+	route_t *route;
+	node_t *node;
+	uint32_t h, count = 0;
+	int e;
+
+	if (event->subclass_name) {
+		snprintf(key, sizeof(key), "%d:%s", event->event_id, event->subclass_name);
+	} else {
+		snprintf(key, sizeof(key), "%d", event->event_id);
+	}
+	h = hash_key(key) % ROUTE_BUCKETS;
+
+	pthread_rwlock_rdlock(&ROUTE_RWLOCK);
+	for (route = ROUTES[h]; route && strcasecmp(route->key, key); route = route->next);
+	pthread_rwlock_unlock(&ROUTE_RWLOCK);
+
+	if (route) {
+		return route;
+	}
+
+	for (e = event->event_id;; e = EV_ALL) {
+		for (node = EVENT_NODES[e]; node; node = node->next) {
+			count++;
+		}
+		if (e == EV_ALL) {
+			break;
+		}
+	}
+
+	route = malloc(sizeof(*route) + count * sizeof(route->nodes[0]));
+	route->key = strdup(key);
+	route->count = 0;
+
+	for (e = event->event_id;; e = EV_ALL) {
+		for (node = EVENT_NODES[e]; node; node = node->next) {
+			if (node->dynamic || events_match(event, node)) {
+				route->nodes[route->count++] = node;
+			}
+		}
+		if (e == EV_ALL) {
+			break;
+		}
+	}
+
+	pthread_rwlock_wrlock(&ROUTE_RWLOCK);
+	route->next = ROUTES[h];
+	ROUTES[h] = route;
+	pthread_rwlock_unlock(&ROUTE_RWLOCK);
+
+	return route;
+}
+
+static void deliver_route(event_t *event)
+{
+	route_t *route = get_route(event);
+	uint32_t i;
+
+	for (i = 0; i < route->count; i++) {
+		if (!route->nodes[i]->dynamic || events_match(event, route->nodes[i])) {
+			callback(event);
+		}
+	}
+}
+
+static void flush(void)
+{
+	node_t *node;
+	route_t *route;
+	int i;
+
+	for (i = 0; i < EV_IDS; i++) {
+		while ((node = EVENT_NODES[i])) {
+			EVENT_NODES[i] = node->next;
+			free(node->subclass_name);
+			free(node);
+		}
+	}
+
+	for (i = 0; i < ROUTE_BUCKETS; i++) {
+		while ((route = ROUTES[i])) {
+			ROUTES[i] = route->next;
+			free(route->key);
+			free(route);
+		}
+	}
+}
+
+static void bind_node(int event_id, const char *subclass_name)
+{
+	node_t *node = calloc(1, sizeof(*node)), **np;
+
+	node->event_id = event_id;
+	node->subclass_name = subclass_name ? strdup(subclass_name) : NULL;
+	node->dynamic = subclass_name && (!strncasecmp(subclass_name, "file:", 5) || !strncasecmp(subclass_name, "func:", 5));
+
+	/* appended like switch_event_bind_removable does */
+	for (np = &EVENT_NODES[event_id]; *np; np = &(*np)->next);
+	*np = node;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+	static const int counts[] = { 10, 50, 100, 250, 500, 1000, 2000 };
+	static event_t stream[4096];
+	static char subclasses[512][32];
+	uint64_t walk_delivered, route_delivered;
+	double t, walk_ns, route_ns;
+	int c, i;
+
+	for (i = 0; i < 512; i++) {
+		snprintf(subclasses[i], sizeof(subclasses[i]), "mod_%d::event_%d", i / 4, i % 4);
+	}
+
+	/* 60% CUSTOM events across the subclasses, the rest on the channel ids */
+	srand(1);
+	for (i = 0; i < 4096; i++) {
+		if (rand() % 10 < 6) {
+			stream[i].event_id = EV_CUSTOM;
+			stream[i].subclass_name = subclasses[rand() % 512];
+		} else {
+			stream[i].event_id = 1 + rand() % 30;
+			stream[i].subclass_name = NULL;
+		}
+	}
+
+	printf("%9s %12s %12s %8s\n", "bindings", "walk ns/ev", "route ns/ev", "speedup");
+
+	for (c = 0; c < (int) (sizeof(counts) / sizeof(counts[0])); c++) {
+		int n = counts[c];
+
+		/* 70% subclass listeners, 25% channel ids, 4% ALL, 1% func: filters on ALL */
+		for (i = 0; i < n; i++) {
+			int r = i % 100;
+
+			if (r < 70) {
+				bind_node(EV_CUSTOM, subclasses[rand() % 512]);
+			} else if (r < 95) {
+				bind_node(1 + rand() % 30, NULL);
+			} else if (r < 99) {
+				bind_node(EV_ALL, NULL);
+			} else {
+				bind_node(EV_ALL, "func:conference_member_play_file");
+			}
+		}
+
+		DELIVERED = 0;
+		t = now_ns();
+		for (i = 0; i < EVENTS; i++) {
+			deliver_walk(&stream[i & 4095]);
+		}
+		walk_ns = (now_ns() - t) / EVENTS;
+		walk_delivered = DELIVERED;
+
+		DELIVERED = 0;
+		t = now_ns();
+		for (i = 0; i < EVENTS; i++) {
+			deliver_route(&stream[i & 4095]);
+		}
+		route_ns = (now_ns() - t) / EVENTS;
+		route_delivered = DELIVERED;
+
+		if (walk_delivered != route_delivered) {
+			fprintf(stderr, "mismatch at %d bindings: walk delivered %llu route delivered %llu\n",
+					n, (unsigned long long) walk_delivered, (unsigned long long) route_delivered);
+			return 1;
+		}
+
+		printf("%9d %12.1f %12.1f %7.1fx\n", n, walk_ns, route_ns, walk_ns / route_ns);
+		flush();
+	}
+
+	return 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2010, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * mix_sln_bench.c -- bit exactness and throughput of the switch_mix_sln_* kernels
+ *
+ * Builds the kernels from src/include/private/switch_mix_kernels.h on their own.  Every SIMD set the cpu has is run
+ * against the scalar one on random frames and on frames pinned near +-32767 so the 32 bit mix overflows 16 bits and
+ * the saturating path is taken, over lengths 1..1024 so every tail is covered.  Any difference is printed and makes
+ * it exit 1.  Then it times each kernel on a 20ms 48k frame and prints Msamples/sec.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../../../src/include/private/switch_mix_kernels.h"
+
+#define MAX_SAMPLES 1024
+#define BENCH_SAMPLES 960
+#define BENCH_TALKERS 8
+#define BENCH_SECONDS 1.0
+
+typedef void (*acc_fn_t) (int32_t *, const int16_t *, uint32_t);
+typedef void (*sub_fn_t) (int16_t *, const int32_t *, const int16_t *, uint32_t);
+
+typedef struct kernels {
+	const char *name;
+	int supported;
+	acc_fn_t acc;
+	acc_fn_t rem;
+	sub_fn_t sub;
+} kernels_t;
+
+static kernels_t KERNELS[] = {
+	{"scalar", 1, mix_sln_accumulate_scalar, mix_sln_subtract_scalar, mix_sln_subtract_saturate_scalar},
+#ifdef SWITCH_MIX_X86_DISPATCH
+	{"sse2", 0, mix_sln_accumulate_sse2, mix_sln_subtract_sse2, mix_sln_subtract_saturate_sse2},
+	{"avx2", 0, mix_sln_accumulate_avx2, mix_sln_subtract_avx2, mix_sln_subtract_saturate_avx2},
+#endif
+};
+
+#define KERNEL_COUNT (int) (sizeof(KERNELS) / sizeof(KERNELS[0]))
+
+static int16_t TALKER[BENCH_TALKERS][MAX_SAMPLES];
+
+static void fill(int16_t *data, uint32_t samples, int loud)
+{
+	uint32_t x;
+
+	for (x = 0; x < samples; x++) {
+		if (loud) {
+			/* within 64 of full scale either way so a few talkers always clip */
+			int16_t v = (int16_t) (32704 + rand() % 64);
+			data[x] = (rand() & 1) ? v : (int16_t) -v;
+		} else {
+			data[x] = (int16_t) (rand() & 0xffff);
+		}
+	}
+}
+
+static int check(kernels_t *k, uint32_t samples, int loud)
+{
+	int32_t mix1[MAX_SAMPLES], mix2[MAX_SAMPLES];
+	int16_t out1[MAX_SAMPLES], out2[MAX_SAMPLES];
+	int t;
+
+	memset(mix1, 0, sizeof(mix1));
+	memset(mix2, 0, sizeof(mix2));
+
+	for (t = 0; t < BENCH_TALKERS; t++) {
+		fill(TALKER[t], samples, loud);
+		mix_sln_accumulate_scalar(mix1, TALKER[t], samples);
+		k->acc(mix2, TALKER[t], samples);
+	}
+
+	/* a talker leaving the mix mid frame */
+	mix_sln_subtract_scalar(mix1 + 1, TALKER[1] + 1, samples - 1);
+	k->rem(mix2 + 1, TALKER[1] + 1, samples - 1);
+
+	if (memcmp(mix1, mix2, samples * sizeof(mix1[0]))) {
+		printf("%s: accumulate/subtract differ from scalar, %u samples, %s input\n", k->name, samples, loud ? "saturating" : "random");
+		return 0;
+	}
+
+	for (t = -1; t < BENCH_TALKERS; t++) {
+		const int16_t *own = t < 0 ? NULL : TALKER[t];
+
+		k->sub(out2, mix2, own, samples);
+		mix_sln_subtract_saturate_scalar(out1, mix1, own, samples);
+
+		if (memcmp(out1, out2, samples * sizeof(out1[0]))) {
+			printf("%s: subtract_saturate differs from scalar, %u samples, %s input\n", k->name, samples, loud ? "saturating" : "random");
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* one conference tick: sum every talker, then hand each talker the mix minus itself */
+static void bench(kernels_t *k)
+{
+	static int32_t mix[BENCH_SAMPLES];
+	static int16_t out[BENCH_SAMPLES];
+	double start = now(), acc_time = 0, sub_time = 0, t;
+	uint64_t ticks = 0;
+	int i;
+
+	while (now() - start < BENCH_SECONDS) {
+		memset(mix, 0, sizeof(mix));
+
+		t = now();
+		for (i = 0; i < BENCH_TALKERS; i++) {
+			k->acc(mix, TALKER[i], BENCH_SAMPLES);
+		}
+		acc_time += now() - t;
+
+		t = now();
+		for (i = 0; i < BENCH_TALKERS; i++) {
+			k->sub(out, mix, TALKER[i], BENCH_SAMPLES);
+		}
+		sub_time += now() - t;
+
+		ticks++;
+	}
+
+	printf("%-8s accumulate %8.0f Msamples/sec   subtract_saturate %8.0f Msamples/sec\n", k->name,
+		   ticks * BENCH_TALKERS * BENCH_SAMPLES / acc_time / 1e6, ticks * BENCH_TALKERS * BENCH_SAMPLES / sub_time / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+	int i, loud, ok = 1;
+	uint32_t samples;
+
+#ifdef SWITCH_MIX_X86_DISPATCH
+	__builtin_cpu_init();
+	KERNELS[1].supported = __builtin_cpu_supports("sse2");
+	KERNELS[2].supported = __builtin_cpu_supports("avx2");
+#endif
+
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+
+	for (i = 0; i < KERNEL_COUNT; i++) {
+		kernels_t *k = &KERNELS[i];
+		int pass = 1;
+
+		if (!k->supported) {
+			printf("%-8s not supported by this cpu\n", k->name);
+			continue;
+		}
+
+		for (loud = 0; loud < 2; loud++) {
+			for (samples = 1; samples <= MAX_SAMPLES && pass; samples++) {
+				pass = check(k, samples, loud);
+			}
+		}
+
+		printf("%-8s %s\n", k->name, pass ? "bit exact with scalar" : "MISMATCH");
+		ok &= pass;
+	}
+
+	for (i = 0; i < BENCH_TALKERS; i++) {
+		fill(TALKER[i], BENCH_SAMPLES, 0);
+	}
+
+	for (i = 0; i < KERNEL_COUNT; i++) {
+		if (KERNELS[i].supported) {
+			bench(&KERNELS[i]);
+		}
+	}
+
+	return ok ? 0 : 1;
+}
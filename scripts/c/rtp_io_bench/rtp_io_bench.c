@@ -0,0 +1,420 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2010, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * rtp_io_bench.c -- loopback load test for the rtp-io-threads receive engine
+ *
+ * A sender plays the far end of N calls, one 20ms packet per call per tick.  On the receiving side every call has
+ * its own thread woken on the packet clock like a timer driven switch_rtp session, and reads in one of two ways:
+ *
+ *   direct  the session polls and reads its own socket the way read_rtp_frame does with a timer
+ *           (poll, recvfrom, poll again for the hot socket check)
+ *   engine  io threads wait on every socket with epoll, drain them with recvmmsg and queue the packets,
+ *           the session only pops its queue
+ *
+ * With -b the sessions have no timer and block for their packet instead, on poll in direct mode or on their
+ * queue's condition in engine mode.
+ *
+ * It reports what arrived, receive side cpu per packet and the syscalls each side made per packet.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define PACKET_LEN 172
+#define BATCH 32
+#define QUEUE_LEN 64
+#define EVENTS 256
+
+typedef struct packet {
+	uint32_t len;
+	char data[1536];
+} packet_t;
+
+typedef struct session {
+	int fd;
+	struct sockaddr_in addr;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int waiting;
+	packet_t queue[QUEUE_LEN];
+	uint32_t head;
+	uint32_t tail;
+	uint64_t received;
+	uint64_t drops;
+	uint64_t syscalls;
+	double cpu;
+} session_t;
+
+typedef struct io_thread {
+	int epfd;
+	pthread_t thread;
+	uint64_t syscalls;
+	uint64_t wakes;
+	double cpu;
+} io_thread_t;
+
+static int engine = 0;
+static int blocking = 0;
+static int sessions = 500;
+static int io_threads = 1;
+static int seconds = 10;
+static int ptime = 20;
+static volatile int running = 1;
+static session_t *SESSIONS;
+static io_thread_t *IO;
+
+static double thread_cpu(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_THREAD, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000000.0;
+}
+
+static void tick_add(struct timespec *ts, int ms)
+{
+	ts->tv_nsec += (long) ms * 1000000;
+	while (ts->tv_nsec >= 1000000000) {
+		ts->tv_nsec -= 1000000000;
+		ts->tv_sec++;
+	}
+}
+
+static void *session_run(void *obj)
+{
+	session_t *s = (session_t *) obj;
+	struct pollfd pfd = { s->fd, POLLIN, 0 };
+	struct sockaddr_storage from;
+	socklen_t fromlen;
+	struct timespec next;
+	packet_t pkt;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while (running && blocking) {
+		if (engine) {
+			pthread_mutex_lock(&s->mutex);
+			while (running && s->head == s->tail) {
+				s->waiting = 1;
+				pthread_cond_wait(&s->cond, &s->mutex);
+				s->waiting = 0;
+			}
+			if (s->head != s->tail) {
+				memcpy(&pkt, &s->queue[s->tail++ % QUEUE_LEN], sizeof(pkt));
+				s->received++;
+			}
+			pthread_mutex_unlock(&s->mutex);
+			continue;
+		}
+
+		s->syscalls++;
+		if (poll(&pfd, 1, 100) > 0) {
+			fromlen = sizeof(from);
+			s->syscalls++;
+			if (recvfrom(s->fd, pkt.data, sizeof(pkt.data), 0, (struct sockaddr *) &from, &fromlen) > 0) {
+				s->received++;
+			}
+		}
+	}
+
+	while (running && !blocking) {
+		tick_add(&next, ptime);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		if (engine) {
+			pthread_mutex_lock(&s->mutex);
+			if (s->head != s->tail) {
+				memcpy(&pkt, &s->queue[s->tail++ % QUEUE_LEN], sizeof(pkt));
+				s->received++;
+			}
+			pthread_mutex_unlock(&s->mutex);
+			continue;
+		}
+
+		s->syscalls++;
+		if (poll(&pfd, 1, 0) > 0) {
+			fromlen = sizeof(from);
+			s->syscalls++;
+			if (recvfrom(s->fd, pkt.data, sizeof(pkt.data), 0, (struct sockaddr *) &from, &fromlen) > 0) {
+				s->received++;
+			}
+			s->syscalls++;
+			poll(&pfd, 1, 0);
+		}
+	}
+
+	s->cpu = thread_cpu();
+
+	return NULL;
+}
+
+static void *io_run(void *obj)
+{
+	io_thread_t *io = (io_thread_t *) obj;
+	struct epoll_event events[EVENTS];
+	struct mmsghdr msgs[BATCH];
+	struct iovec iov[BATCH];
+	struct sockaddr_storage addrs[BATCH];
+	static __thread packet_t bufs[BATCH];
+	int i, j, n, r;
+
+	while (running) {
+		io->syscalls++;
+		n = epoll_wait(io->epfd, events, EVENTS, 100);
+		if (n > 0) {
+			io->wakes++;
+		}
+
+		for (i = 0; i < n; i++) {
+			session_t *s = (session_t *) events[i].data.ptr;
+
+			for (j = 0; j < BATCH; j++) {
+				iov[j].iov_base = bufs[j].data;
+				iov[j].iov_len = sizeof(bufs[j].data);
+				memset(&msgs[j], 0, sizeof(msgs[j]));
+				msgs[j].msg_hdr.msg_iov = &iov[j];
+				msgs[j].msg_hdr.msg_iovlen = 1;
+				msgs[j].msg_hdr.msg_name = &addrs[j];
+				msgs[j].msg_hdr.msg_namelen = sizeof(addrs[j]);
+			}
+
+			io->syscalls++;
+			if ((r = recvmmsg(s->fd, msgs, BATCH, MSG_DONTWAIT, NULL)) <= 0) {
+				continue;
+			}
+
+			pthread_mutex_lock(&s->mutex);
+			for (j = 0; j < r; j++) {
+				if (s->head - s->tail >= QUEUE_LEN) {
+					s->drops++;
+					continue;
+				}
+				s->queue[s->head % QUEUE_LEN].len = msgs[j].msg_len;
+				memcpy(s->queue[s->head % QUEUE_LEN].data, bufs[j].data, msgs[j].msg_len);
+				s->head++;
+			}
+			if (s->waiting) {
+				/* the futex wake a blocking reader costs on every packet */
+				io->syscalls++;
+				pthread_cond_signal(&s->cond);
+			}
+			pthread_mutex_unlock(&s->mutex);
+		}
+	}
+
+	io->cpu = thread_cpu();
+
+	return NULL;
+}
+
+static void *sender_run(void *obj)
+{
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	struct mmsghdr *msgs = calloc(sessions, sizeof(*msgs));
+	struct iovec iov;
+	char payload[PACKET_LEN];
+	struct timespec next, end;
+	int i, sent;
+
+	memset(payload, 0x55, sizeof(payload));
+	iov.iov_base = payload;
+	iov.iov_len = sizeof(payload);
+
+	for (i = 0; i < sessions; i++) {
+		msgs[i].msg_hdr.msg_iov = &iov;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &SESSIONS[i].addr;
+		msgs[i].msg_hdr.msg_namelen = sizeof(SESSIONS[i].addr);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	end = next;
+	end.tv_sec += seconds;
+
+	while (next.tv_sec < end.tv_sec || (next.tv_sec == end.tv_sec && next.tv_nsec < end.tv_nsec)) {
+		for (i = 0; i < sessions; i += sent) {
+			if ((sent = sendmmsg(fd, msgs + i, sessions - i, 0)) <= 0) {
+				break;
+			}
+		}
+		tick_add(&next, ptime);
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+
+	/* let the last tick drain */
+	usleep(ptime * 3000);
+	running = 0;
+
+	for (i = 0; i < sessions; i++) {
+		pthread_mutex_lock(&SESSIONS[i].mutex);
+		pthread_cond_signal(&SESSIONS[i].cond);
+		pthread_mutex_unlock(&SESSIONS[i].mutex);
+	}
+
+	close(fd);
+	free(msgs);
+
+	return NULL;
+}
+
+static void usage(const char *me)
+{
+	fprintf(stderr, "usage: %s [-m direct|engine] [-b] [-n sessions] [-t io-threads] [-s seconds] [-p ptime-ms]\n", me);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_attr_t attr;
+	pthread_t sender;
+	struct epoll_event ev;
+	socklen_t len;
+	uint64_t received = 0, drops = 0, syscalls = 0, wakes = 0, sent;
+	double cpu = 0;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "m:bn:t:s:p:")) != -1) {
+		switch (opt) {
+		case 'm':
+			engine = !strcmp(optarg, "engine");
+			break;
+		case 'b':
+			blocking = 1;
+			break;
+		case 'n':
+			sessions = atoi(optarg);
+			break;
+		case 't':
+			io_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			ptime = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (sessions < 1 || io_threads < 1 || seconds < 1 || ptime < 1) {
+		usage(argv[0]);
+	}
+
+	SESSIONS = calloc(sessions, sizeof(*SESSIONS));
+	IO = calloc(io_threads, sizeof(*IO));
+
+	for (i = 0; i < io_threads; i++) {
+		IO[i].epfd = epoll_create(EVENTS);
+	}
+
+	for (i = 0; i < sessions; i++) {
+		session_t *s = &SESSIONS[i];
+
+		s->fd = socket(AF_INET, SOCK_DGRAM, 0);
+		s->addr.sin_family = AF_INET;
+		s->addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (bind(s->fd, (struct sockaddr *) &s->addr, sizeof(s->addr)) < 0) {
+			fprintf(stderr, "bind: %s\n", strerror(errno));
+			return 1;
+		}
+		len = sizeof(s->addr);
+		getsockname(s->fd, (struct sockaddr *) &s->addr, &len);
+		pthread_mutex_init(&s->mutex, NULL);
+		pthread_cond_init(&s->cond, NULL);
+
+		if (engine) {
+			memset(&ev, 0, sizeof(ev));
+			ev.events = EPOLLIN;
+			ev.data.ptr = s;
+			epoll_ctl(IO[i % io_threads].epfd, EPOLL_CTL_ADD, s->fd, &ev);
+		}
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, 256 * 1024);
+
+	for (i = 0; i < sessions; i++) {
+		pthread_create(&SESSIONS[i].thread, &attr, session_run, &SESSIONS[i]);
+	}
+
+	if (engine) {
+		for (i = 0; i < io_threads; i++) {
+			pthread_create(&IO[i].thread, &attr, io_run, &IO[i]);
+		}
+	}
+
+	pthread_create(&sender, &attr, sender_run, NULL);
+	pthread_join(sender, NULL);
+
+	for (i = 0; i < sessions; i++) {
+		pthread_join(SESSIONS[i].thread, NULL);
+		received += SESSIONS[i].received;
+		drops += SESSIONS[i].drops;
+		syscalls += SESSIONS[i].syscalls;
+		cpu += SESSIONS[i].cpu;
+	}
+
+	if (engine) {
+		for (i = 0; i < io_threads; i++) {
+			pthread_join(IO[i].thread, NULL);
+			syscalls += IO[i].syscalls;
+			wakes += IO[i].wakes;
+			cpu += IO[i].cpu;
+		}
+	}
+
+	sent = (uint64_t) sessions * (seconds * 1000 / ptime);
+
+	printf("mode %s%s sessions %d io-threads %d ptime %dms seconds %d\n", engine ? "engine" : "direct", blocking ? " blocking" : "",
+		   sessions, engine ? io_threads : 0, ptime, seconds);
+	printf("sent %llu received %llu (%.1f%%) queue-drops %llu\n", (unsigned long long) sent, (unsigned long long) received,
+		   sent ? received * 100.0 / sent : 0, (unsigned long long) drops);
+	printf("packets/sec %.0f\n", received / (double) seconds);
+	printf("receive cpu %.3fs, %.2f us/packet\n", cpu, received ? cpu * 1000000.0 / received : 0);
+	printf("receive syscalls %llu, %.2f/packet (clock sleeps not counted)\n", (unsigned long long) syscalls,
+		   received ? syscalls / (double) received : 0);
+	if (engine) {
+		printf("epoll wakes %llu, %.1f ready sockets per wake\n", (unsigned long long) wakes, wakes ? received / (double) wakes : 0);
+	}
+
+	return 0;
+}
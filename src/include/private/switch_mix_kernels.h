@@ -0,0 +1,197 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2011, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ *
+ * switch_mix_kernels.h -- Scalar and SIMD kernels behind switch_mix_sln_* (not to be installed into the system)
+ *
+ * Only switch_resample.c and scripts/c/mix_sln_bench include this, the bench builds it without the rest of the
+ * core to check the SIMD kernels against the scalar ones bit for bit and time them.
+ *
+ */
+#ifndef SWITCH_MIX_KERNELS_H
+#define SWITCH_MIX_KERNELS_H
+
+#include <stdint.h>
+
+#ifndef switch_normalize_to_16bit
+#define switch_normalize_to_16bit(n) if (n > 32767) n = 32767; else if (n < -32768) n = -32768;
+#endif
+
+/* Conference style mixing kernels.
+   The mixer sums every talker into a 32 bit accumulator and then hands each listener a clamped copy
+   with their own audio removed.  Both steps are done here so they can use SIMD when the cpu has it. */
+
+static void mix_sln_accumulate_scalar(int32_t *mix, const int16_t *data, uint32_t samples)
+{
+	uint32_t x;
+
+	for (x = 0; x < samples; x++) {
+		mix[x] += (int32_t) data[x];
+	}
+}
+
+static void mix_sln_subtract_scalar(int32_t *mix, const int16_t *data, uint32_t samples)
+{
+	uint32_t x;
+
+	for (x = 0; x < samples; x++) {
+		mix[x] -= (int32_t) data[x];
+	}
+}
+
+static void mix_sln_subtract_saturate_scalar(int16_t *out, const int32_t *mix, const int16_t *own, uint32_t samples)
+{
+	uint32_t x;
+	int32_t z;
+
+	for (x = 0; x < samples; x++) {
+		z = mix[x];
+		if (own) {
+			z -= (int32_t) own[x];
+		}
+		switch_normalize_to_16bit(z);
+		out[x] = (int16_t) z;
+	}
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SWITCH_MIX_X86_DISPATCH
+#include <immintrin.h>
+
+__attribute__ ((target("sse2")))
+static void mix_sln_accumulate_sse2(int32_t *mix, const int16_t *data, uint32_t samples)
+{
+	uint32_t x = 0;
+
+	for (; x + 8 <= samples; x += 8) {
+		__m128i d = _mm_loadu_si128((const __m128i *) (data + x));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(d, d), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(d, d), 16);
+		__m128i *m = (__m128i *) (mix + x);
+
+		_mm_storeu_si128(m, _mm_add_epi32(_mm_loadu_si128(m), lo));
+		_mm_storeu_si128(m + 1, _mm_add_epi32(_mm_loadu_si128(m + 1), hi));
+	}
+
+	mix_sln_accumulate_scalar(mix + x, data + x, samples - x);
+}
+
+__attribute__ ((target("sse2")))
+static void mix_sln_subtract_sse2(int32_t *mix, const int16_t *data, uint32_t samples)
+{
+	uint32_t x = 0;
+
+	for (; x + 8 <= samples; x += 8) {
+		__m128i d = _mm_loadu_si128((const __m128i *) (data + x));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(d, d), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(d, d), 16);
+		__m128i *m = (__m128i *) (mix + x);
+
+		_mm_storeu_si128(m, _mm_sub_epi32(_mm_loadu_si128(m), lo));
+		_mm_storeu_si128(m + 1, _mm_sub_epi32(_mm_loadu_si128(m + 1), hi));
+	}
+
+	mix_sln_subtract_scalar(mix + x, data + x, samples - x);
+}
+
+__attribute__ ((target("sse2")))
+static void mix_sln_subtract_saturate_sse2(int16_t *out, const int32_t *mix, const int16_t *own, uint32_t samples)
+{
+	uint32_t x = 0;
+
+	for (; x + 8 <= samples; x += 8) {
+		__m128i lo = _mm_loadu_si128((const __m128i *) (mix + x));
+		__m128i hi = _mm_loadu_si128((const __m128i *) (mix + x + 4));
+
+		if (own) {
+			__m128i d = _mm_loadu_si128((const __m128i *) (own + x));
+			lo = _mm_sub_epi32(lo, _mm_srai_epi32(_mm_unpacklo_epi16(d, d), 16));
+			hi = _mm_sub_epi32(hi, _mm_srai_epi32(_mm_unpackhi_epi16(d, d), 16));
+		}
+
+		/* packs saturates to the same range as switch_normalize_to_16bit */
+		_mm_storeu_si128((__m128i *) (out + x), _mm_packs_epi32(lo, hi));
+	}
+
+	mix_sln_subtract_saturate_scalar(out + x, mix + x, own ? own + x : NULL, samples - x);
+}
+
+__attribute__ ((target("avx2")))
+static void mix_sln_accumulate_avx2(int32_t *mix, const int16_t *data, uint32_t samples)
+{
+	uint32_t x = 0;
+
+	for (; x + 16 <= samples; x += 16) {
+		__m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (data + x)));
+		__m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (data + x + 8)));
+		__m256i *m = (__m256i *) (mix + x);
+
+		_mm256_storeu_si256(m, _mm256_add_epi32(_mm256_loadu_si256(m), lo));
+		_mm256_storeu_si256(m + 1, _mm256_add_epi32(_mm256_loadu_si256(m + 1), hi));
+	}
+
+	mix_sln_accumulate_scalar(mix + x, data + x, samples - x);
+}
+
+__attribute__ ((target("avx2")))
+static void mix_sln_subtract_avx2(int32_t *mix, const int16_t *data, uint32_t samples)
+{
+	uint32_t x = 0;
+
+	for (; x + 16 <= samples; x += 16) {
+		__m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (data + x)));
+		__m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (data + x + 8)));
+		__m256i *m = (__m256i *) (mix + x);
+
+		_mm256_storeu_si256(m, _mm256_sub_epi32(_mm256_loadu_si256(m), lo));
+		_mm256_storeu_si256(m + 1, _mm256_sub_epi32(_mm256_loadu_si256(m + 1), hi));
+	}
+
+	mix_sln_subtract_scalar(mix + x, data + x, samples - x);
+}
+
+__attribute__ ((target("avx2")))
+static void mix_sln_subtract_saturate_avx2(int16_t *out, const int32_t *mix, const int16_t *own, uint32_t samples)
+{
+	uint32_t x = 0;
+
+	for (; x + 16 <= samples; x += 16) {
+		__m256i lo = _mm256_loadu_si256((const __m256i *) (mix + x));
+		__m256i hi = _mm256_loadu_si256((const __m256i *) (mix + x + 8));
+
+		if (own) {
+			lo = _mm256_sub_epi32(lo, _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (own + x))));
+			hi = _mm256_sub_epi32(hi, _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (own + x + 8))));
+		}
+
+		/* packs works per 128 bit lane so put the quadwords back in order afterwards */
+		_mm256_storeu_si256((__m256i *) (out + x), _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8));
+	}
+
+	mix_sln_subtract_saturate_scalar(out + x, mix + x, own ? own + x : NULL, samples - x);
+}
+#endif
+
+#endif
@@ -473,6 +473,15 @@ SWITCH_DECLARE(void) switch_atomic_inc(volatile switch_atomic_t *mem);
  */
 SWITCH_DECLARE(int)  switch_atomic_dec(volatile switch_atomic_t *mem);
 
+/**
+ * Uses an atomic operation to set the value at the specified memory location to with if it currently holds cmp.
+ * @param mem The location of the value to compare and swap.
+ * @param with The value to store.
+ * @param cmp The value it must hold for the swap to happen.
+ * @return the value mem held before the call
+ */
+SWITCH_DECLARE(uint32_t) switch_atomic_cas(volatile switch_atomic_t *mem, uint32_t with, uint32_t cmp);
+
 /** @} */
 
 /**
@@ -1148,6 +1157,21 @@ SWITCH_DECLARE(int32_t) switch_sockaddr_get_family(switch_sockaddr_t *sa);
 SWITCH_DECLARE(switch_status_t) switch_sockaddr_ip_get(char **addr, switch_sockaddr_t *sa);
 SWITCH_DECLARE(int) switch_sockaddr_equal(const switch_sockaddr_t *sa1, const switch_sockaddr_t *sa2);
 
+/**
+ * Fill in a socket address from a raw system sockaddr.
+ * @param sa The socket address to fill in.
+ * @param raw The struct sockaddr_in or sockaddr_in6 to copy.
+ * @param len The length of raw.
+ */
+SWITCH_DECLARE(switch_status_t) switch_sockaddr_set_raw(switch_sockaddr_t *sa, const void *raw, switch_size_t len);
+
+/**
+ * Get the operating system descriptor of a socket.
+ * @param sock The socket.
+ * @return the descriptor or -1
+ */
+SWITCH_DECLARE(int) switch_socket_fd_get(switch_socket_t *sock);
+
 
 /**
  * Create apr_sockaddr_t from hostname, address family, and port.
@@ -1483,6 +1507,31 @@ SWITCH_DECLARE(switch_status_t) switch_thread_exit(switch_thread_t *thd, switch_
  */
 SWITCH_DECLARE(switch_status_t) switch_thread_join(switch_status_t *retval, switch_thread_t *thd);
 
+/** Opaque thread private key. */
+	 typedef struct apr_threadkey_t switch_threadkey_t;
+
+/**
+ * Create and initialize a new thread private address space
+ * @param key The thread private handle.
+ * @param dest The destructor to use when freeing the private memory, it is not called on Windows
+ * @param pool The pool to use
+ */
+SWITCH_DECLARE(switch_status_t) switch_threadkey_private_create(switch_threadkey_t ** key, void (*dest) (void *), switch_memory_pool_t *pool);
+
+/**
+ * Get a pointer to the thread private memory
+ * @param new_mem The data stored in private memory
+ * @param key The handle for the desired thread private memory
+ */
+SWITCH_DECLARE(switch_status_t) switch_threadkey_private_get(void **new_mem, switch_threadkey_t *key);
+
+/**
+ * Set the data to be stored in thread private memory
+ * @param priv The data to be stored in private memory
+ * @param key The handle for the desired thread private memory
+ */
+SWITCH_DECLARE(switch_status_t) switch_threadkey_private_set(void *priv, switch_threadkey_t *key);
+
  /** @} */
 
 
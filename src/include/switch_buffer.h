@@ -70,6 +70,16 @@ SWITCH_DECLARE(switch_status_t) switch_buffer_create(_In_ switch_memory_pool_t *
 SWITCH_DECLARE(switch_status_t) switch_buffer_create_dynamic(_Out_ switch_buffer_t **buffer, _In_ switch_size_t blocksize, _In_ switch_size_t start_len,
 															 _In_ switch_size_t max_len);
 
+/*! \brief Allocate a new fixed size single producer / single consumer ring buffer
+ * One thread may write while another reads without any locking.  Writes are all or nothing, zero and toss
+ * may only be called by the reading side.  The loop, zwrite and slide_write helpers assert on it and zwrite and
+ * slide_write return 0 when asserts are compiled out.
+ * \param buffer returned pointer to the new buffer
+ * \param max_len capacity of the ring
+ * \return status
+ */
+SWITCH_DECLARE(switch_status_t) switch_buffer_create_spsc(_Out_ switch_buffer_t **buffer, _In_ switch_size_t max_len);
+
 SWITCH_DECLARE(void) switch_buffer_add_mutex(_In_ switch_buffer_t *buffer, _In_ switch_mutex_t *mutex);
 SWITCH_DECLARE(void) switch_buffer_lock(_In_ switch_buffer_t *buffer);
 SWITCH_DECLARE(switch_status_t) switch_buffer_trylock(_In_ switch_buffer_t *buffer);
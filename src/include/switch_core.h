@@ -226,6 +226,13 @@ SWITCH_DECLARE(void) switch_core_media_bug_set_read_replace_frame(_In_ switch_me
 SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove(_In_ switch_core_session_t *session, _Inout_ switch_media_bug_t **bug);
 SWITCH_DECLARE(uint32_t) switch_core_media_bug_prune(switch_core_session_t *session);
 
+/*!
+  \brief Count the media bugs attached to a session
+  \param session the session to check
+  \return the number of media bugs
+*/
+SWITCH_DECLARE(uint32_t) switch_core_media_bug_count(switch_core_session_t *session);
+
 /*!
   \brief Remove media bug callback
   \param bug bug to remove
@@ -100,6 +100,16 @@ struct switch_event {
 	unsigned long key;
 	struct switch_event *next;
 	int flags;
+	/*! the number of headers linked on the event */
+	uint32_t header_count;
+	/*! open addressing lookup index, built once the event grows past a handful of headers */
+	switch_event_header_t **index;
+	/*! the number of slots in the lookup index */
+	uint32_t index_size;
+	/*! the number of occupied slots in the lookup index */
+	uint32_t index_used;
+	/*! set when more than one header shares a name */
+	int index_dups;
 };
 
 typedef enum {
@@ -381,6 +391,21 @@ static inline switch_status_t switch_event_create_plain(switch_event_t **event,
 */
 SWITCH_DECLARE(void) switch_event_deliver(switch_event_t **event);
 
+/*!
+  \brief Write the event and header recycling counters and the dispatch shard counters to a stream
+  \param stream the stream to write to
+*/
+SWITCH_DECLARE(void) switch_event_stats(switch_stream_handle_t *stream);
+
+/*!
+  \brief Shard event dispatch on a header so events sharing its value are delivered in order
+  \param keys comma separated header names, the first one present on an event is its key
+  \param shards the number of dispatch threads to spread the keys over
+  \return SWITCH_STATUS_SUCCESS if sharding was enabled
+  \note sharding can only be configured once
+*/
+SWITCH_DECLARE(switch_status_t) switch_event_set_dispatch_key(const char *keys, uint32_t shards);
+
 /*!
   \brief Fire an event filling in most of the arguements with obvious values
   \param event the event to send (will be nulled on success)
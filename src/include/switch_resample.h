@@ -171,6 +171,31 @@ SWITCH_DECLARE(void) switch_change_sln_volume_granular(int16_t *data, uint32_t s
 
 SWITCH_DECLARE(uint32_t) switch_merge_sln(int16_t *data, uint32_t samples, int16_t *other_data, uint32_t other_samples);
 
+/*!
+  \brief Add a signed linear audio frame into a 32 bit mix accumulator
+  \param mix the 32 bit accumulator
+  \param data the audio data to add
+  \param samples the number of 2 byte samples
+ */
+SWITCH_DECLARE(void) switch_mix_sln_accumulate(int32_t *mix, const int16_t *data, uint32_t samples);
+
+/*!
+  \brief Remove a signed linear audio frame from a 32 bit mix accumulator
+  \param mix the 32 bit accumulator
+  \param data the audio data to remove
+  \param samples the number of 2 byte samples
+ */
+SWITCH_DECLARE(void) switch_mix_sln_subtract(int32_t *mix, const int16_t *data, uint32_t samples);
+
+/*!
+  \brief Convert a 32 bit mix accumulator to signed linear, optionally removing one contribution first
+  \param out the 16 bit output frame
+  \param mix the 32 bit accumulator
+  \param own the audio to subtract from the mix before clamping (may be NULL)
+  \param samples the number of 2 byte samples
+ */
+SWITCH_DECLARE(void) switch_mix_sln_subtract_saturate(int16_t *out, const int32_t *mix, const int16_t *own, uint32_t samples);
+
 SWITCH_DECLARE(void) switch_mux_channels(int16_t *data, switch_size_t samples, uint32_t channels);
 
 SWITCH_END_EXTERN_C
@@ -106,6 +106,13 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_set_ssrc(switch_rtp_t *rtp_session, u
 */
 SWITCH_DECLARE(switch_port_t) switch_rtp_set_end_port(switch_port_t port);
 
+/*!
+  \brief Set the number of threads receiving RTP for all sessions with epoll and recvmmsg (Linux only)
+  \param threads the number of threads, 0 keeps reading on each session's own thread
+  \note must be set before the first session is created
+*/
+SWITCH_DECLARE(void) switch_rtp_set_io_threads(uint32_t threads);
+
 /*! 
   \brief Request a new port to be used for media
   \param ip the ip to request a port from
@@ -3915,7 +3915,7 @@ SWITCH_STANDARD_API(alias_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
-#define SHOW_SYNTAX "codec|endpoint|application|api|dialplan|file|timer|calls [count]|channels [count|like <match string>]|calls|detailed_calls|bridged_calls|detailed_bridged_calls|aliases|complete|chat|management|modules|nat_map|say|interfaces|interface_types|tasks|limits"
+#define SHOW_SYNTAX "codec|endpoint|application|api|dialplan|file|timer|calls [count]|channels [count|like <match string>]|calls|detailed_calls|bridged_calls|detailed_bridged_calls|aliases|complete|chat|management|modules|nat_map|say|interfaces|interface_types|tasks|limits|events stats"
 SWITCH_STANDARD_API(show_function)
 {
 	char sql[1024];
@@ -3929,6 +3929,12 @@ SWITCH_STANDARD_API(show_function)
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
     const char *hostname = switch_core_get_switchname();
 
+	/* not backed by the db */
+	if (cmd && !strcasecmp(cmd, "events stats")) {
+		switch_event_stats(stream);
+		return SWITCH_STATUS_SUCCESS;
+	}
+
 	if (!(cflags & SCF_USE_SQL)) {
 		stream->write_function(stream, "-ERR SQL DISABLED NO DATA AVAILABLE!\n");
 		return SWITCH_STATUS_SUCCESS;
@@ -5418,6 +5424,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_commands_load)
 	switch_console_set_complete("add show bridged_calls");
 	switch_console_set_complete("add show detailed_bridged_calls");
 	switch_console_set_complete("add show endpoint");
+	switch_console_set_complete("add show events stats");
 	switch_console_set_complete("add show file");
 	switch_console_set_complete("add show interfaces");
 	switch_console_set_complete("add show interface_types");
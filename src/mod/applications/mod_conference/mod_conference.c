@@ -57,11 +57,26 @@ static int EC = 0;
 /* Size to allocate for audio buffers */
 #define CONF_BUFFER_SIZE 1024 * 128
 #define CONF_EVENT_MAINT "conference::maintenance"
+#define CONF_EVENT_STATE "conference::state"
 #define CONF_DEFAULT_LEADIN 20
 
 #define CONF_DBLOCK_SIZE CONF_BUFFER_SIZE
 #define CONF_DBUFFER_SIZE CONF_BUFFER_SIZE
 #define CONF_DBUFFER_MAX 0
+/* capacity of the lock free member input and output rings */
+#define CONF_RING_SIZE CONF_BUFFER_SIZE
+/* Mixed frames a listener may have queued before we consider it behind and flush */
+#define CONF_MUX_QUEUE_LEN 20
+#define CONF_MUX_QUEUE_MAX 10
+/* most frames an inline reader will take off the call leg per output tick */
+#define CONF_INLINE_READ_MAX 3
+/* Frames of conference file or speech audio the prefetch readers keep decoded ahead of the mixer */
+#define CONF_PREFETCH_FRAMES 25
+/* seconds a cached prompt is trusted before its file is looked at again */
+#define CONF_PROMPT_RECHECK_SEC 30
+/* Distinct listener codecs the mixer will encode the shared mix for */
+#define CONF_MAX_ENCODERS 4
+#define CONF_ENC_MAX_PAYLOAD 1500
 #define CONF_CHAT_PROTO "conf"
 
 #ifndef MIN
@@ -76,6 +91,10 @@ static int EC = 0;
 #define SCORE_IIR_SPEAKING_MAX 3000
 /* the threshold below which you cede the floor to someone loud (see above value). */
 #define SCORE_IIR_SPEAKING_MIN 100
+/* how much of a head start a member already in the mix gets over newcomers when max-active-speakers is set */
+#define SCORE_IIR_ACTIVE_BONUS 4
+/* default ms an active speaker keeps its slot once it stops talking, so pauses between words do not drop it */
+#define CONF_DEFAULT_ACTIVE_SPEAKER_HOLD 600
 
 
 #define test_eflag(conference, flag) ((conference)->eflags & flag)
@@ -86,18 +105,62 @@ typedef enum {
 	FILE_STOP_ASYNC
 } file_stop_t;
 
+struct conference_obj;
+struct conference_mixer_worker;
+struct conference_prompt;
+struct conference_cfg_cache;
+
+#define CONF_REGISTRY_SHARDS 16
+
+/* One slice of the conference registry, rooms land in a shard by the hash of their name */
+typedef struct conference_registry_shard {
+	switch_thread_rwlock_t *rwlock;
+	switch_hash_t *hash;
+} conference_registry_shard_t;
+
 /* Global Values */
 static struct {
 	switch_memory_pool_t *conference_pool;
 	switch_mutex_t *conference_mutex;
-	switch_hash_t *conference_hash;
+	conference_registry_shard_t registry[CONF_REGISTRY_SHARDS];
 	switch_mutex_t *id_mutex;
-	switch_mutex_t *hash_mutex;
 	switch_mutex_t *setup_mutex;
 	uint32_t id_pool;
 	int32_t running;
-	uint32_t threads;
+	volatile switch_atomic_t threads;
+	volatile switch_atomic_t list_seq;
 	switch_event_node_t *node;
+	uint32_t mixer_threads;
+	uint32_t mixer_interval;
+	char *mixer_timer_name;
+	switch_timer_t mixer_timer;
+	switch_mutex_t *mixer_mutex;
+	struct conference_obj *mixer_conferences;
+	struct conference_mixer_worker *mixer_workers;
+	int32_t mixer_clock_running;
+	uint32_t prefetch_threads;
+	switch_queue_t *prefetch_queue;
+	switch_mutex_t *prompt_mutex;
+	switch_hash_t *prompt_hash;
+	struct conference_prompt *prompt_head;
+	struct conference_prompt *prompt_tail;
+	switch_size_t prompt_bytes;
+	switch_size_t prompt_max_bytes;
+	uint32_t prompt_count;
+	uint64_t prompt_hits;
+	uint64_t prompt_misses;
+	uint64_t prompt_evictions;
+	uint64_t prompt_reloads;
+	/* prompts checked at or before this time are looked at again on their next play, set by reloadxml */
+	time_t prompt_stale;
+	switch_bool_t profile_cache;
+	switch_thread_rwlock_t *cfg_rwlock;
+	struct conference_cfg_cache *cfg_cache;
+	switch_event_node_t *reload_node;
+	uint32_t rec_writer_threads;
+	struct conference_rec_writer *rec_writers;
+	volatile switch_atomic_t rec_next;
+	volatile switch_atomic_t rec_sinks;
 } globals;
 
 /* forward declaration for conference_obj and caller_control */
@@ -206,9 +269,67 @@ typedef enum {
 	EFLAG_FLOOR_CHANGE = (1 << 25),
 	EFLAG_MUTE_DETECT = (1 << 26),
 	EFLAG_RECORD = (1 << 27),
-	EFLAG_HUP_MEMBER = (1 << 28)
+	EFLAG_HUP_MEMBER = (1 << 28),
+	EFLAG_STATE_DELTA = (1 << 29),
+	EFLAG_TALK_SUMMARY = (1 << 30)
 } event_type_t;
 
+/* State changes kept in each room's delta ring, see conference_delta_names */
+typedef enum {
+	CONF_DELTA_NONE = 0,
+	CONF_DELTA_ADD_MEMBER,
+	CONF_DELTA_DEL_MEMBER,
+	CONF_DELTA_START_TALKING,
+	CONF_DELTA_STOP_TALKING,
+	CONF_DELTA_MUTE_MEMBER,
+	CONF_DELTA_UNMUTE_MEMBER,
+	CONF_DELTA_DEAF_MEMBER,
+	CONF_DELTA_UNDEAF_MEMBER,
+	CONF_DELTA_FLOOR_CHANGE,
+	CONF_DELTA_ENERGY_LEVEL,
+	CONF_DELTA_VOLUME_IN,
+	CONF_DELTA_VOLUME_OUT,
+	CONF_DELTA_LOCK,
+	CONF_DELTA_UNLOCK
+} conference_delta_type_t;
+
+static const char *conference_delta_names[] = {
+	"none", "add-member", "del-member", "start-talking", "stop-talking", "mute-member", "unmute-member", "deaf-member",
+	"undeaf-member", "floor-change", "energy-level", "volume-in", "volume-out", "lock", "unlock"
+};
+
+#define CONF_DELTA_RING 256
+#define CONF_TALK_SUMMARY_MAX_TOP 32
+#define CONF_TRACK_QUEUE_LEN 4096
+/* ticks a pooled conference may fall behind the mixer clock and still catch up, later ones are skipped */
+#define CONF_MIXER_MAX_OWED 2
+/* recordings are handed to the writers in blocks of this many ms, a recording may have CONF_REC_MAX_PENDING of them queued */
+#define CONF_REC_BLOCK_MS 500
+#define CONF_REC_MAX_PENDING 8
+/* how long a member event block may go without picking up channel variable or caller-id changes */
+#define CONF_EVENT_BLOCK_TTL 1000000
+
+typedef struct conference_delta {
+	uint32_t version;
+	uint32_t member_id;
+	int32_t value;
+	conference_delta_type_t type;
+	switch_time_t time;
+} conference_delta_t;
+
+/* A prompt decoded and converted to one conference rate, shared read only by every node that plays it */
+typedef struct conference_prompt {
+	char *key;
+	time_t mtime;
+	time_t checked;
+	const int16_t *data;
+	switch_size_t samples;
+	volatile switch_atomic_t refs;
+	uint8_t cached;
+	struct conference_prompt *prev;
+	struct conference_prompt *next;
+} conference_prompt_t;
+
 typedef struct conference_file_node {
 	switch_file_handle_t fh;
 	switch_speech_handle_t *sh;
@@ -219,14 +340,75 @@ typedef struct conference_file_node {
 	uint32_t leadin;
 	struct conference_file_node *next;
 	char *file;
+	/* decoded audio waiting for the mixer when the node is prefetched */
+	switch_buffer_t *pcm;
+	uint32_t frame_bytes;
+	struct conference_obj *conference;
+	volatile switch_atomic_t refs;
+	volatile switch_atomic_t queued;
+	volatile switch_atomic_t eof;
+	/* cached prompts are played straight out of the shared decoded copy and never open fh */
+	conference_prompt_t *prompt;
+	switch_size_t prompt_pos;
 } conference_file_node_t;
 
+/* A listener codec the mixer encodes the shared mix with once per tick on behalf of everyone using it */
+typedef struct conference_encoder {
+	char key[256];
+	switch_codec_t codec;
+	uint32_t index;
+	uint32_t users;
+	uint8_t failed;
+} conference_encoder_t;
+
+typedef struct conference_mix_payload {
+	uint32_t datalen;
+	uint8_t data[CONF_ENC_MAX_PAYLOAD];
+} conference_mix_payload_t;
+
+/* A mixed frame handed to one or more listeners by reference */
+typedef struct conference_mix_frame {
+	volatile switch_atomic_t refs;
+	uint32_t datalen;
+	struct conference_mix_frame *next;
+	int16_t data[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+	conference_mix_payload_t enc[CONF_MAX_ENCODERS];
+} conference_mix_frame_t;
+
+/* The mixer's contiguous view of the member list, rebuilt only when membership changes.
+   The per-member hot state is refreshed once per tick so the mixing passes never chase member pointers.
+   Relationships are flattened into one bitset row per listener of the speakers it must not hear. */
+typedef struct conference_mix_table {
+	uint32_t version;
+	uint32_t rel_version;
+	uint32_t count;
+	uint32_t size;
+	uint32_t words;
+	struct conference_member **member;
+	uint32_t *flags;
+	uint32_t *read;
+	uint32_t *score;
+	uint32_t *rank;
+	int16_t **frame;
+	uint32_t *exclude;
+	uint32_t *exclude_count;
+} conference_mix_table_t;
+
 /* conference xml config sections */
 typedef struct conf_xml_cfg {
 	switch_xml_t profile;
 	switch_xml_t controls;
 } conf_xml_cfg_t;
 
+/* Immutable parsed copy of the profiles and caller-controls sections, shared by joins */
+typedef struct conference_cfg_cache {
+	switch_memory_pool_t *pool;
+	switch_xml_t xml;
+	switch_hash_t *profiles;
+	switch_hash_t *controls;
+	volatile switch_atomic_t refs;
+} conference_cfg_cache_t;
+
 /* Conference Object */
 typedef struct conference_obj {
 	char *name;
@@ -253,6 +435,18 @@ typedef struct conference_obj {
 	char *special_announce;
 	char *auto_record;
 	uint32_t terminate_on_silence;
+	uint32_t parallel_mix_threshold;
+	uint32_t parallel_mix_threads;
+	uint32_t max_active_speakers;
+	uint32_t active_speaker_hold;
+	uint32_t talk_summary_interval;
+	uint32_t talk_summary_top;
+	switch_time_t talk_summary_next;
+	uint8_t talk_summary_active;
+	volatile switch_atomic_t talk_starts;
+	volatile switch_atomic_t talk_stops;
+	volatile switch_atomic_t floor_changes;
+	uint8_t inline_input;
 	uint32_t max_members;
 	char *maxmember_sound;
 	uint32_t announce_count;
@@ -274,6 +468,10 @@ typedef struct conference_obj {
 	conference_member_t *members;
 	conference_member_t *floor_holder;
 	switch_mutex_t *member_mutex;
+	switch_mutex_t *frame_mutex;
+	conference_mix_frame_t *free_frames;
+	conference_encoder_t *encoders[CONF_MAX_ENCODERS];
+	uint32_t encoder_count;
 	conference_file_node_t *fnode;
 	conference_file_node_t *async_fnode;
 	switch_memory_pool_t *pool;
@@ -296,6 +494,8 @@ typedef struct conference_obj {
 	uint32_t verbose_events;
 	int end_count;
 	uint32_t relationship_total;
+	uint32_t relationship_version;
+	uint32_t members_version;
 	uint32_t score;
 	int mux_loop_count;
 	int member_loop_count;
@@ -308,8 +508,74 @@ typedef struct conference_obj {
 	char *uuid_str;
 	uint32_t originating;
 	switch_call_cause_t cancel_cause;
+	struct conference_mix_state *mixer_state;
+	struct conference_obj *mixer_next;
+	volatile switch_atomic_t mixer_busy;
+	volatile switch_atomic_t mixer_owed;
+	uint32_t mixer_ticks;
+	uint32_t mixer_late;
+	uint32_t mixer_skipped;
+	uint8_t mixer_done;
+	switch_mutex_t *tts_mutex;
+	volatile switch_atomic_t prefetch_pending;
+	uint32_t prefetch_starved;
+	volatile uint32_t list_seq;
+	switch_mutex_t *delta_mutex;
+	uint32_t state_version;
+	conference_delta_t deltas[CONF_DELTA_RING];
+	struct conference_track_rec *track_rec;
+	volatile switch_atomic_t rec_backlog;
+	volatile switch_atomic_t rec_dropped;
 } conference_obj_t;
 
+/* Point in time copy of a member, taken under member_mutex and serialized after it is dropped */
+typedef struct conference_member_snap {
+	uint32_t id;
+	uint32_t flags;
+	char uuid[SWITCH_UUID_FORMATTED_LENGTH + 1];
+	char caller_id_name[256];
+	char caller_id_number[256];
+	switch_time_t join_time;
+	switch_time_t last_talking;
+	int32_t energy_level;
+	int32_t volume_in_level;
+	int32_t volume_out_level;
+	int32_t agc_volume_in_level;
+	uint8_t has_video;
+	uint8_t has_floor;
+} conference_member_snap_t;
+
+/* Point in time copy of a room for the list serializers */
+typedef struct conference_snap {
+	const char *name;
+	const char *uuid;
+	uint32_t flags;
+	uint32_t count;
+	uint32_t rate;
+	uint32_t seq;
+	uint32_t version;
+	uint32_t prefetch_starved;
+	int record_count;
+	int agc_level;
+	switch_time_t run_time;
+	uint32_t member_count;
+	conference_member_snap_t *members;
+} conference_snap_t;
+
+/* --room, --since, --after and --limit for list, xml_list and json_list */
+typedef struct conference_list_filter {
+	const char *room;
+	const char *after;
+	uint32_t since;
+	uint32_t limit;
+} conference_list_filter_t;
+
+/* A shared mixer worker, picks conferences off its own queue first and steals from the others when it runs dry */
+typedef struct conference_mixer_worker {
+	uint32_t id;
+	switch_queue_t *queue;
+} conference_mixer_worker_t;
+
 /* Relationship with another member */
 typedef struct conference_relationship {
 	uint32_t id;
@@ -325,16 +591,30 @@ struct conference_member {
 	switch_memory_pool_t *pool;
 	switch_buffer_t *audio_buffer;
 	switch_buffer_t *mux_buffer;
+	switch_queue_t *mux_queue;
+	conference_encoder_t *encoder;
 	switch_buffer_t *resample_buffer;
 	uint32_t flags;
 	uint32_t score;
 	uint32_t last_score;
 	uint32_t score_iir;
+	uint8_t active_speaker;
+	uint32_t speaker_hold;
 	switch_mutex_t *flag_mutex;
 	switch_mutex_t *write_mutex;
 	switch_mutex_t *audio_in_mutex;
 	switch_mutex_t *audio_out_mutex;
 	switch_mutex_t *read_mutex;
+	switch_mutex_t *event_mutex;
+	switch_event_t *event_block;
+	struct conference_rec_sink *rec_sink;
+	switch_caller_profile_t *event_block_profile;
+	switch_codec_t *event_block_read_codec;
+	switch_codec_t *event_block_write_codec;
+	switch_channel_state_t event_block_state;
+	switch_channel_callstate_t event_block_callstate;
+	switch_time_t event_block_time;
+	uint8_t event_block_video;
 	switch_thread_rwlock_t *rwlock;
 	switch_codec_implementation_t read_impl;
 	switch_codec_implementation_t orig_read_impl;
@@ -367,16 +647,80 @@ struct conference_member {
 	uint32_t avg_score;
 	uint32_t avg_itt;
 	uint32_t avg_tally;
+	uint32_t hangover_hits;
+	uint32_t hangunder_hits;
+	uint32_t input_idle;
 	struct conference_member *next;
 	switch_ivr_dmachine_t *dmachine;
 };
 
-/* Record Node */
-typedef struct conference_record {
+/* A run of recorded audio handed to a writer thread in one piece, or the end of the recording when close is set */
+typedef struct conference_rec_block {
+	struct conference_rec_sink *sink;
+	uint32_t datalen;
+	uint8_t close;
+	struct conference_rec_block *next;
+	int16_t data[1];
+} conference_rec_block_t;
+
+/* One file being recorded. The mixer fills blocks with the recorder's mixed frames and one of the shared writers
+   owns the file handle, so a recording costs neither a thread nor a timer. */
+typedef struct conference_rec_sink {
 	conference_obj_t *conference;
+	conference_member_t member;
+	switch_file_handle_t fh;
 	char *path;
 	switch_memory_pool_t *pool;
-} conference_record_t;
+	switch_mutex_t *mutex;
+	conference_rec_block_t *block;
+	conference_rec_block_t *free_blocks;
+	uint32_t block_size;
+	uint32_t writer;
+	uint8_t failed;
+	volatile switch_atomic_t pending;
+} conference_rec_sink_t;
+
+/* A recording writer thread and the blocks queued for it */
+typedef struct conference_rec_writer {
+	switch_queue_t *queue;
+} conference_rec_writer_t;
+
+/* One member's speech for one mixer tick, or a close marker for that member's track when datalen is 0 */
+typedef struct conference_track_chunk {
+	uint32_t member_id;
+	uint32_t tick;
+	uint32_t datalen;
+	struct conference_track_chunk *next;
+	int16_t data[1];
+} conference_track_chunk_t;
+
+/* An open per-member track file and the speech segment it is currently writing */
+typedef struct conference_track {
+	switch_file_handle_t fh;
+	FILE *idx;
+	uint32_t segment_tick;
+	uint32_t last_tick;
+	switch_size_t samples;
+	switch_size_t segment_samples;
+} conference_track_t;
+
+/* Per-speaker recording, fed by the mixer with the member frames it already read and written out by one thread */
+typedef struct conference_track_rec {
+	char *path;
+	char *base;
+	char *ext;
+	uint32_t rate;
+	uint32_t interval;
+	uint32_t chunk_size;
+	uint32_t tick;
+	uint32_t dropped;
+	volatile int running;
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+	switch_queue_t *queue;
+	switch_hash_t *tracks;
+	conference_track_chunk_t *free_chunks;
+} conference_track_rec_t;
 
 typedef enum {
 	CONF_API_SUB_ARGS_SPLIT,
@@ -412,7 +756,16 @@ static switch_status_t conference_play_file(conference_obj_t *conference, char *
 static void conference_send_all_dtmf(conference_member_t *member, conference_obj_t *conference, const char *dtmf);
 static switch_status_t conference_say(conference_obj_t *conference, const char *text, uint32_t leadin);
 static void conference_list(conference_obj_t *conference, switch_stream_handle_t *stream, char *delim);
-static conference_obj_t *conference_find(char *name);
+static conference_obj_t *conference_find(const char *name);
+static void conference_touch(conference_obj_t *conference);
+static void conference_rec_sink_write(conference_rec_sink_t *sink, const int16_t *data, uint32_t datalen);
+static void conference_state_delta(conference_obj_t *conference, conference_delta_type_t type, conference_member_t *member, int32_t value);
+static void conference_list_parse_filter(conference_list_filter_t *filter, int argc, char **argv);
+static switch_bool_t conference_list_filter_match(conference_list_filter_t *filter, conference_obj_t *conference);
+static void conference_registry_add(conference_obj_t *conference);
+static void conference_registry_del(conference_obj_t *conference);
+static uint32_t conference_registry_snapshot(conference_obj_t ***list);
+static void conference_registry_release(conference_obj_t **list, uint32_t count);
 static void member_bind_controls(conference_member_t *member, const char *controls);
 
 SWITCH_STANDARD_API(conf_api_main);
@@ -433,6 +786,8 @@ static switch_status_t conference_outcall_bg(conference_obj_t *conference,
 											 const char *cid_num, const char *call_uuid, const char *profile, switch_call_cause_t *cancel_cause);
 SWITCH_STANDARD_APP(conference_function);
 static void launch_conference_thread(conference_obj_t *conference);
+static switch_thread_t *launch_thread_detached(switch_thread_start_t func, switch_memory_pool_t *pool, void *data);
+static void conference_file_node_close(conference_file_node_t *fnode);
 static void launch_conference_video_thread(conference_obj_t *conference);
 static void *SWITCH_THREAD_FUNC conference_loop_input(switch_thread_t *thread, void *obj);
 static switch_status_t conference_local_play_file(conference_obj_t *conference, switch_core_session_t *session, char *path, uint32_t leadin, void *buf,
@@ -444,7 +799,7 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
 static switch_status_t chat_send(switch_event_t *message_event);
 								 
 
-static void launch_conference_record_thread(conference_obj_t *conference, char *path);
+static void conference_record_start(conference_obj_t *conference, char *path);
 static void launch_conference_video_bridge_thread(conference_member_t *member_a, conference_member_t *member_b);
 
 typedef switch_status_t (*conf_api_args_cmd_t) (conference_obj_t *, switch_stream_handle_t *, int, char **);
@@ -478,38 +833,93 @@ static switch_status_t conference_add_event_data(conference_obj_t *conference, s
 	return status;
 }
 
+/* Copy the member's channel headers into event. The block is built once and only rebuilt when the channel
+   state, call state, caller profile, codecs or video flag changed; every block also ages out after CONF_EVENT_BLOCK_TTL
+   so variables and caller-id updates made while in the conference still show up.  What this saves is the walk over
+   the channel and its variables, switch_event_merge still copies each of the block's headers into the event. */
+static void conference_member_add_event_block(conference_member_t *member, switch_event_t *event)
+{
+	switch_channel_t *channel = switch_core_session_get_channel(member->session);
+	switch_channel_state_t state = switch_channel_get_state(channel);
+	switch_channel_callstate_t callstate = switch_channel_get_callstate(channel);
+	switch_caller_profile_t *profile = switch_channel_get_caller_profile(channel);
+	switch_codec_t *read_codec = switch_core_session_get_read_codec(member->session);
+	switch_codec_t *write_codec = switch_core_session_get_write_codec(member->session);
+	uint8_t video = switch_channel_test_flag(channel, CF_VIDEO) ? 1 : 0;
+	switch_time_t now = switch_micro_time_now();
+
+	if (!member->event_mutex) {
+		if (member->verbose_events) {
+			switch_channel_event_set_data(channel, event);
+		} else {
+			switch_channel_event_set_basic_data(channel, event);
+		}
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Video", video ? "true" : "false");
+		return;
+	}
+
+	switch_mutex_lock(member->event_mutex);
+
+	if (!member->event_block || member->event_block_state != state || member->event_block_callstate != callstate ||
+		member->event_block_profile != profile || member->event_block_read_codec != read_codec ||
+		member->event_block_write_codec != write_codec || member->event_block_video != video ||
+		now - member->event_block_time > CONF_EVENT_BLOCK_TTL) {
+
+		if (member->event_block) {
+			switch_event_destroy(&member->event_block);
+		}
+
+		if (switch_event_create_plain(&member->event_block, SWITCH_EVENT_CHANNEL_DATA) == SWITCH_STATUS_SUCCESS) {
+			if (member->verbose_events) {
+				switch_channel_event_set_data(channel, member->event_block);
+			} else {
+				switch_channel_event_set_basic_data(channel, member->event_block);
+			}
+			switch_event_add_header_string(member->event_block, SWITCH_STACK_BOTTOM, "Video", video ? "true" : "false");
+
+			member->event_block_state = state;
+			member->event_block_callstate = callstate;
+			member->event_block_profile = profile;
+			member->event_block_read_codec = read_codec;
+			member->event_block_write_codec = write_codec;
+			member->event_block_video = video;
+			member->event_block_time = now;
+		}
+	}
+
+	if (member->event_block) {
+		switch_event_merge(event, member->event_block);
+	}
+
+	switch_mutex_unlock(member->event_mutex);
+}
+
 static switch_status_t conference_add_event_member_data(conference_member_t *member, switch_event_t *event)
 {
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	char buf[32];
 
 	if (!member)
 		return status;
 
 	if (member->conference) {
 		status = conference_add_event_data(member->conference, event);
-		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Floor", "%s", (member == member->conference->floor_holder) ? "true" : "false" );
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Floor", (member == member->conference->floor_holder) ? "true" : "false");
 	}
 
 	if (member->session) {
-		switch_channel_t *channel = switch_core_session_get_channel(member->session);
-
-		if (member->verbose_events) {
-			switch_channel_event_set_data(channel, event);
-		} else {
-			switch_channel_event_set_basic_data(channel, event);
-		}
-		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Video", "%s",
-								switch_channel_test_flag(switch_core_session_get_channel(member->session), CF_VIDEO) ? "true" : "false" );
-
+		conference_member_add_event_block(member, event);
 	}
 
-	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Hear", "%s", switch_test_flag(member, MFLAG_CAN_HEAR) ? "true" : "false" );
-	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Speak", "%s", switch_test_flag(member, MFLAG_CAN_SPEAK) ? "true" : "false" );
-	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Talking", "%s", switch_test_flag(member, MFLAG_TALKING) ? "true" : "false" );
-	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Mute-Detect", "%s", switch_test_flag(member, MFLAG_MUTE_DETECT) ? "true" : "false" );
-	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Member-ID", "%u", member->id);
-	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Member-Type", "%s", switch_test_flag(member, MFLAG_MOD) ? "moderator" : "member");
-	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Energy-Level", "%d", member->energy_level);
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Hear", switch_test_flag(member, MFLAG_CAN_HEAR) ? "true" : "false");
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Speak", switch_test_flag(member, MFLAG_CAN_SPEAK) ? "true" : "false");
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Talking", switch_test_flag(member, MFLAG_TALKING) ? "true" : "false");
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Mute-Detect", switch_test_flag(member, MFLAG_MUTE_DETECT) ? "true" : "false");
+	switch_snprintf(buf, sizeof(buf), "%u", member->id);
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Member-ID", buf);
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Member-Type", switch_test_flag(member, MFLAG_MOD) ? "moderator" : "member");
+	switch_snprintf(buf, sizeof(buf), "%d", member->energy_level);
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Energy-Level", buf);
 
 	return status;
 }
@@ -526,6 +936,401 @@ static uint32_t next_member_id(void)
 	return id;
 }
 
+/* Grab a mix frame from the conference free list, the caller owns the only reference */
+static conference_mix_frame_t *conference_mix_frame_get(conference_obj_t *conference)
+{
+	conference_mix_frame_t *mframe;
+	uint32_t i;
+
+	switch_mutex_lock(conference->frame_mutex);
+	if ((mframe = conference->free_frames)) {
+		conference->free_frames = mframe->next;
+	} else {
+		mframe = switch_core_alloc(conference->pool, sizeof(*mframe));
+	}
+	switch_mutex_unlock(conference->frame_mutex);
+
+	mframe->next = NULL;
+	mframe->datalen = 0;
+	for (i = 0; i < CONF_MAX_ENCODERS; i++) {
+		mframe->enc[i].datalen = 0;
+	}
+	switch_atomic_set(&mframe->refs, 1);
+
+	return mframe;
+}
+
+/* Drop a reference to a mix frame, the last one out puts it back on the free list */
+static void conference_mix_frame_release(conference_obj_t *conference, conference_mix_frame_t *mframe)
+{
+	if (switch_atomic_dec(&mframe->refs)) {
+		return;
+	}
+
+	switch_mutex_lock(conference->frame_mutex);
+	mframe->next = conference->free_frames;
+	conference->free_frames = mframe;
+	switch_mutex_unlock(conference->frame_mutex);
+}
+
+/* Hand a mixed frame to a member, by reference if it reads at the conference ptime otherwise through the mux buffer */
+static void conference_member_send_mix(conference_member_t *member, conference_mix_frame_t *mframe)
+{
+	if (member->rec_sink) {
+		conference_rec_sink_write(member->rec_sink, mframe->data, mframe->datalen);
+	} else if (member->mux_queue) {
+		switch_atomic_inc(&mframe->refs);
+		if (switch_queue_trypush(member->mux_queue, mframe) != SWITCH_STATUS_SUCCESS) {
+			/* the listener is not keeping up, let the output loop start over */
+			conference_mix_frame_release(member->conference, mframe);
+			switch_set_flag_locked(member, MFLAG_FLUSH_BUFFER);
+		}
+	} else if (!switch_buffer_write(member->mux_buffer, mframe->data, mframe->datalen)) {
+		/* the ring is full, only the reading side may empty it */
+		switch_set_flag_locked(member, MFLAG_FLUSH_BUFFER);
+	}
+}
+
+/* Release every mixed frame a member has not played yet */
+static void conference_member_flush_mux_queue(conference_member_t *member)
+{
+	void *pop;
+
+	if (!member->mux_queue || !member->conference) {
+		return;
+	}
+
+	while (switch_queue_trypop(member->mux_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		conference_mix_frame_release(member->conference, (conference_mix_frame_t *) pop);
+	}
+}
+
+/* Encode the shared mix once for every listener codec in use, must be called with the conference mutex held */
+static void conference_mix_frame_encode(conference_obj_t *conference, conference_mix_frame_t *mframe)
+{
+	uint32_t i;
+
+	for (i = 0; i < conference->encoder_count; i++) {
+		conference_encoder_t *encoder = conference->encoders[i];
+		uint32_t enc_len = CONF_ENC_MAX_PAYLOAD, enc_rate = conference->rate;
+		unsigned int flag = 0;
+
+		if (!encoder->users) {
+			continue;
+		}
+
+		if (switch_core_codec_encode(&encoder->codec, NULL, mframe->data, mframe->datalen, conference->rate,
+									 mframe->enc[i].data, &enc_len, &enc_rate, &flag) == SWITCH_STATUS_SUCCESS && enc_len <= CONF_ENC_MAX_PAYLOAD) {
+			mframe->enc[i].datalen = enc_len;
+		}
+	}
+}
+
+/* Find or create the shared encoder matching the member's write codec, must be called with the conference mutex held */
+static void conference_member_attach_encoder(conference_obj_t *conference, conference_member_t *member)
+{
+	switch_codec_t *write_codec;
+	const switch_codec_implementation_t *impl;
+	conference_encoder_t *encoder = NULL;
+	char key[256];
+	uint32_t i;
+
+	if (!member->session || !member->mux_queue || member->encoder) {
+		return;
+	}
+
+	if (!(write_codec = switch_core_session_get_write_codec(member->session)) || !(impl = write_codec->implementation)) {
+		return;
+	}
+
+	/* A listener falls back to its own encoder whenever it talks or needs the pcm, so only stateless codecs can be
+	   shared, interleaving two encoder states would corrupt G.722, G.729, Opus and the like at the far end.  That
+	   leaves G.711, there is no stateless wideband codec to share, L16 listeners need no encoding at all.
+	   It is also only worth it when the channel would otherwise encode exactly the pcm we mixed. */
+	if ((strcasecmp(impl->iananame, "PCMU") && strcasecmp(impl->iananame, "PCMA")) || switch_test_flag(write_codec, SWITCH_CODEC_FLAG_PASSTHROUGH) ||
+		impl->actual_samples_per_second != conference->rate || impl->microseconds_per_packet / 1000 != conference->interval ||
+		impl->number_of_channels != 1) {
+		return;
+	}
+
+	switch_snprintf(key, sizeof(key), "%s@%uh@%ui/%s", impl->iananame, impl->samples_per_second,
+					impl->microseconds_per_packet / 1000, switch_str_nil(write_codec->fmtp_in));
+
+	for (i = 0; i < conference->encoder_count; i++) {
+		if (!strcmp(conference->encoders[i]->key, key)) {
+			encoder = conference->encoders[i];
+			break;
+		}
+	}
+
+	if (!encoder) {
+		if (conference->encoder_count == CONF_MAX_ENCODERS) {
+			return;
+		}
+
+		/* a key that cannot be shared keeps its slot as a failed entry so later joins do not try again */
+		encoder = switch_core_alloc(conference->pool, sizeof(*encoder));
+		switch_copy_string(encoder->key, key, sizeof(encoder->key));
+		encoder->index = conference->encoder_count;
+		conference->encoders[conference->encoder_count++] = encoder;
+
+		if (switch_core_codec_init(&encoder->codec, impl->iananame, write_codec->fmtp_in, impl->samples_per_second,
+								   impl->microseconds_per_packet / 1000, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE,
+								   NULL, conference->pool) != SWITCH_STATUS_SUCCESS) {
+			encoder->failed = 1;
+		} else if (encoder->codec.implementation != impl) {
+			/* the core only passes our payload through untouched if the implementations are the same */
+			switch_core_codec_destroy(&encoder->codec);
+			encoder->failed = 1;
+		}
+
+		if (encoder->failed) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Conference %s cannot share encoder %s\n", conference->name, key);
+		} else {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Conference %s shared encoder %s created\n", conference->name, key);
+		}
+	}
+
+	if (encoder->failed) {
+		return;
+	}
+
+	encoder->users++;
+	member->encoder = encoder;
+}
+
+/* Write the payload the mixer already encoded for us straight to the channel if nothing on our side needs the pcm */
+static switch_status_t conference_member_write_encoded(conference_member_t *member, conference_mix_frame_t *mframe,
+													  switch_frame_t *write_frame, switch_bool_t *written)
+{
+	switch_codec_t *write_codec;
+	conference_mix_payload_t *payload;
+	switch_frame_t enc_frame = { 0 };
+
+	*written = SWITCH_FALSE;
+
+	if (!member->encoder || !(payload = &mframe->enc[member->encoder->index])->datalen) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!switch_test_flag(member, MFLAG_CAN_HEAR) || member->volume_out_level || member->fnode || switch_core_media_bug_count(member->session)) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!(write_codec = switch_core_session_get_write_codec(member->session)) || write_codec->implementation != member->encoder->codec.implementation) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	memcpy(write_frame->data, payload->data, payload->datalen);
+	enc_frame.data = write_frame->data;
+	enc_frame.buflen = write_frame->buflen;
+	enc_frame.datalen = payload->datalen;
+	enc_frame.samples = mframe->datalen / 2;
+	enc_frame.rate = member->conference->rate;
+	enc_frame.timestamp = write_frame->timestamp;
+	enc_frame.codec = &member->encoder->codec;
+
+	*written = SWITCH_TRUE;
+
+	return switch_core_session_write_frame(member->session, &enc_frame, SWITCH_IO_FLAG_NONE, 0);
+}
+
+static void conference_mix_table_exclude(conference_mix_table_t *table, uint32_t listener, uint32_t speaker)
+{
+	uint32_t *word = &table->exclude[listener * table->words + speaker / 32];
+	uint32_t bit = 1U << (speaker % 32);
+
+	if (listener != speaker && !(*word & bit)) {
+		*word |= bit;
+		table->exclude_count[listener]++;
+	}
+}
+
+/* Flatten every member's relationships into per listener bitsets so the mixer never has to walk them */
+static void conference_mix_table_relate(conference_obj_t *conference, conference_mix_table_t *table)
+{
+	conference_relationship_t *rel;
+	uint32_t i, j;
+
+	table->rel_version = conference->relationship_version;
+
+	memset(table->exclude, 0, table->size * table->words * sizeof(*table->exclude));
+	memset(table->exclude_count, 0, table->size * sizeof(*table->exclude_count));
+
+	if (!conference->relationship_total) {
+		return;
+	}
+
+	for (i = 0; i < table->count; i++) {
+		for (rel = table->member[i]->relationships; rel; rel = rel->next) {
+			if (switch_test_flag(rel, RFLAG_CAN_SPEAK) && switch_test_flag(rel, RFLAG_CAN_HEAR)) {
+				continue;
+			}
+
+			for (j = 0; j < table->count; j++) {
+				/* 0 matches everyone */
+				if (rel->id && table->member[j]->id != rel->id) {
+					continue;
+				}
+
+				if (!switch_test_flag(rel, RFLAG_CAN_SPEAK)) {
+					conference_mix_table_exclude(table, j, i);
+				}
+
+				if (!switch_test_flag(rel, RFLAG_CAN_HEAR)) {
+					conference_mix_table_exclude(table, i, j);
+				}
+			}
+		}
+	}
+}
+
+/* Keep only the loudest max-active-speakers members in this tick's mix, everyone else is treated as silent.
+   Members already in the mix get a head start so the set does not flap between two similar voices, and one that
+   stops talking keeps its slot for active-speaker-hold ms so a pause between words does not hand it to someone else. */
+static void conference_mix_table_select_speakers(conference_obj_t *conference, conference_mix_table_t *table)
+{
+	uint32_t i, n, candidates = 0, held = 0;
+	uint32_t hold = conference->active_speaker_hold / conference->interval;
+
+	for (i = 0; i < table->count; i++) {
+		conference_member_t *imember = table->member[i];
+
+		table->rank[i] = 0;
+
+		if (imember->active_speaker) {
+			if ((table->flags[i] & MFLAG_TALKING)) {
+				imember->speaker_hold = hold;
+			} else if (imember->speaker_hold) {
+				imember->speaker_hold--;
+			}
+		}
+
+		if ((table->flags[i] & (MFLAG_RUNNING | MFLAG_HAS_AUDIO)) != (MFLAG_RUNNING | MFLAG_HAS_AUDIO)) {
+			if (imember->active_speaker && imember->speaker_hold) {
+				/* nothing to mix this tick but the slot stays taken */
+				held++;
+			} else {
+				imember->active_speaker = 0;
+			}
+			continue;
+		}
+
+		if (imember->active_speaker && imember->speaker_hold) {
+			/* held speakers go in first whatever their score */
+			table->rank[i] = (uint32_t) -1;
+		} else {
+			/* +1 so a silent candidate still outranks a non candidate */
+			table->rank[i] = imember->score_iir + 1;
+			if (imember->active_speaker) {
+				table->rank[i] += imember->score_iir / SCORE_IIR_ACTIVE_BONUS + SCORE_IIR_SPEAKING_MIN;
+			}
+		}
+		candidates++;
+	}
+
+	for (n = held; n < conference->max_active_speakers && n - held < candidates; n++) {
+		uint32_t best = 0, best_rank = 0;
+
+		for (i = 0; i < table->count; i++) {
+			if (table->rank[i] > best_rank) {
+				best_rank = table->rank[i];
+				best = i;
+			}
+		}
+
+		if (!table->member[best]->active_speaker) {
+			table->member[best]->active_speaker = 1;
+			table->member[best]->speaker_hold = hold;
+		}
+		table->rank[best] = 0;
+	}
+
+	/* whoever still has a rank did not make the cut */
+	for (i = 0; i < table->count; i++) {
+		if (table->rank[i]) {
+			table->member[i]->active_speaker = 0;
+			table->member[i]->speaker_hold = 0;
+			table->flags[i] &= ~MFLAG_HAS_AUDIO;
+		}
+	}
+}
+
+/* Rebuild the mixer's member table if anyone joined or left, must be called with the conference mutex held */
+static void conference_mix_table_sync(conference_obj_t *conference, conference_mix_table_t *table)
+{
+	conference_member_t *imember;
+	uint32_t count = 0;
+
+	if (table->member && table->version == conference->members_version) {
+		if (table->rel_version != conference->relationship_version) {
+			conference_mix_table_relate(conference, table);
+		}
+		return;
+	}
+
+	for (imember = conference->members; imember; imember = imember->next) {
+		count++;
+	}
+
+	if (count > table->size || !table->member) {
+		uint32_t size = table->size ? table->size : 16;
+
+		while (size < count) {
+			size *= 2;
+		}
+
+		switch_safe_free(table->member);
+		switch_safe_free(table->flags);
+		switch_safe_free(table->read);
+		switch_safe_free(table->score);
+		switch_safe_free(table->rank);
+		switch_safe_free(table->frame);
+		switch_safe_free(table->exclude);
+		switch_safe_free(table->exclude_count);
+
+		table->size = size;
+		table->words = (size + 31) / 32;
+
+		switch_zmalloc(table->member, size * sizeof(*table->member));
+		switch_zmalloc(table->flags, size * sizeof(*table->flags));
+		switch_zmalloc(table->read, size * sizeof(*table->read));
+		switch_zmalloc(table->score, size * sizeof(*table->score));
+		switch_zmalloc(table->rank, size * sizeof(*table->rank));
+		switch_zmalloc(table->frame, size * sizeof(*table->frame));
+		switch_zmalloc(table->exclude, size * table->words * sizeof(*table->exclude));
+		switch_zmalloc(table->exclude_count, size * sizeof(*table->exclude_count));
+	}
+
+	count = 0;
+	for (imember = conference->members; imember; imember = imember->next) {
+		table->member[count] = imember;
+		table->frame[count] = (int16_t *) imember->frame;
+		table->flags[count] = 0;
+		table->read[count] = 0;
+		table->score[count] = 0;
+		count++;
+	}
+
+	table->count = count;
+	table->version = conference->members_version;
+
+	conference_mix_table_relate(conference, table);
+}
+
+static void conference_mix_table_destroy(conference_mix_table_t *table)
+{
+	switch_safe_free(table->member);
+	switch_safe_free(table->flags);
+	switch_safe_free(table->read);
+	switch_safe_free(table->score);
+	switch_safe_free(table->rank);
+	switch_safe_free(table->frame);
+	switch_safe_free(table->exclude);
+	switch_safe_free(table->exclude_count);
+	memset(table, 0, sizeof(*table));
+}
+
 /* if other_member has a relationship with member, produce it */
 static conference_relationship_t *member_get_relationship(conference_member_t *member, conference_member_t *other_member)
 {
@@ -589,930 +1394,2236 @@ static conference_member_t *conference_member_get(conference_obj_t *conference,
 	return member;
 }
 
-/* stop the specified recording */
-static switch_status_t conference_record_stop(conference_obj_t *conference, char *path)
+static conference_rec_block_t *conference_rec_block_get(conference_rec_sink_t *sink)
 {
-	conference_member_t *member = NULL;
-	int count = 0;
+	conference_rec_block_t *block;
 
-	switch_assert(conference != NULL);
-	switch_mutex_lock(conference->member_mutex);
-	for (member = conference->members; member; member = member->next) {
-		if (switch_test_flag(member, MFLAG_NOCHANNEL) && (!path || !strcmp(path, member->rec_path))) {
-			switch_clear_flag_locked(member, MFLAG_RUNNING);
-			count++;
-		}
+	switch_mutex_lock(sink->mutex);
+	if ((block = sink->free_blocks)) {
+		sink->free_blocks = block->next;
+	} else {
+		block = switch_core_alloc(sink->pool, sizeof(*block) + sink->block_size);
+		block->sink = sink;
 	}
-	switch_mutex_unlock(conference->member_mutex);
-	return count;
+	switch_mutex_unlock(sink->mutex);
+
+	block->datalen = 0;
+	block->close = 0;
+
+	return block;
 }
 
+static void conference_rec_block_put(conference_rec_sink_t *sink, conference_rec_block_t *block)
+{
+	switch_mutex_lock(sink->mutex);
+	block->next = sink->free_blocks;
+	sink->free_blocks = block;
+	switch_mutex_unlock(sink->mutex);
+}
 
-/* Add a custom relationship to a member */
-static conference_relationship_t *member_add_relationship(conference_member_t *member, uint32_t id)
+/* Hand a full block to the sink's writer, a writer that is CONF_REC_MAX_PENDING blocks behind costs us the block */
+static void conference_rec_sink_submit(conference_rec_sink_t *sink, conference_rec_block_t *block)
 {
-	conference_relationship_t *rel = NULL;
+	conference_obj_t *conference = sink->conference;
 
-	if (member == NULL || id == 0 || !(rel = switch_core_alloc(member->pool, sizeof(*rel))))
-		return NULL;
+	if (switch_atomic_read(&sink->pending) < CONF_REC_MAX_PENDING) {
+		switch_atomic_inc(&sink->pending);
+		switch_atomic_inc(&conference->rec_backlog);
 
-	rel->id = id;
+		if (switch_queue_trypush(globals.rec_writers[sink->writer].queue, block) == SWITCH_STATUS_SUCCESS) {
+			return;
+		}
 
+		switch_atomic_dec(&sink->pending);
+		switch_atomic_dec(&conference->rec_backlog);
+	}
 
-	lock_member(member);
-	switch_mutex_lock(member->conference->member_mutex);
-	member->conference->relationship_total++;
-	switch_mutex_unlock(member->conference->member_mutex);
-	rel->next = member->relationships;
-	member->relationships = rel;
-	unlock_member(member);
+	switch_atomic_add(&conference->rec_dropped, block->datalen / (switch_samples_per_packet(conference->rate, conference->interval) * 2));
+	conference_rec_block_put(sink, block);
+}
 
-	return rel;
+/* Called by the mixer with the recorder's mixed frame */
+static void conference_rec_sink_write(conference_rec_sink_t *sink, const int16_t *data, uint32_t datalen)
+{
+	conference_rec_block_t *block;
+
+	if (!(block = sink->block)) {
+		block = sink->block = conference_rec_block_get(sink);
+	}
+
+	if (datalen > sink->block_size - block->datalen) {
+		datalen = sink->block_size - block->datalen;
+	}
+
+	memcpy((uint8_t *) block->data + block->datalen, data, datalen);
+	block->datalen += datalen;
+
+	if (block->datalen == sink->block_size) {
+		sink->block = NULL;
+		conference_rec_sink_submit(sink, block);
+	}
 }
 
-/* Remove a custom relationship from a member */
-static switch_status_t member_del_relationship(conference_member_t *member, uint32_t id)
+/* Queue what is left of the recording followed by the close, the mixer must not be able to reach the sink anymore */
+static void conference_rec_sink_close(conference_rec_sink_t *sink)
 {
-	switch_status_t status = SWITCH_STATUS_FALSE;
-	conference_relationship_t *rel, *last = NULL;
+	conference_rec_block_t *block;
+
+	if ((block = sink->block)) {
+		sink->block = NULL;
+		if (block->datalen) {
+			switch_atomic_inc(&sink->pending);
+			switch_atomic_inc(&sink->conference->rec_backlog);
+			switch_queue_push(globals.rec_writers[sink->writer].queue, block);
+		} else {
+			conference_rec_block_put(sink, block);
+		}
+	}
 
-	if (member == NULL || id == 0)
-		return status;
+	block = conference_rec_block_get(sink);
+	block->close = 1;
+	switch_queue_push(globals.rec_writers[sink->writer].queue, block);
+}
 
-	lock_member(member);
-	for (rel = member->relationships; rel; rel = rel->next) {
-		if (rel->id == id) {
-			/* we just forget about rel here cos it was allocated by the member's pool 
-			   it will be freed when the member is */
-			status = SWITCH_STATUS_SUCCESS;
-			if (last) {
-				last->next = rel->next;
-			} else {
-				member->relationships = rel->next;
+static void conference_rec_sink_open(conference_rec_sink_t *sink)
+{
+	conference_obj_t *conference = sink->conference;
+	switch_event_t *event;
+	char *vval;
+
+	sink->fh.channels = 1;
+	sink->fh.samplerate = conference->rate;
+	sink->fh.pre_buffer_datalen = SWITCH_DEFAULT_FILE_BUFFER_LEN;
+
+	if (switch_core_file_open(&sink->fh, sink->path, (uint8_t) 1, conference->rate, SWITCH_FILE_FLAG_WRITE | SWITCH_FILE_DATA_SHORT,
+							  NULL) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Opening File [%s]\n", sink->path);
+		sink->failed = 1;
+		return;
+	}
+
+	if ((vval = switch_mprintf("Conference %s", conference->name))) {
+		switch_core_file_set_string(&sink->fh, SWITCH_AUDIO_COL_STR_TITLE, vval);
+		switch_safe_free(vval);
+	}
+
+	switch_core_file_set_string(&sink->fh, SWITCH_AUDIO_COL_STR_ARTIST, "FreeSWITCH mod_conference Software Conference Module");
+
+	if (test_eflag(conference, EFLAG_RECORD) &&
+		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
+		conference_add_event_data(conference, event);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "start-recording");
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Path", sink->path);
+		switch_event_fire(&event);
+	}
+}
+
+/* Last block of a recording, close the file and let go of the conference */
+static void conference_rec_sink_finish(conference_rec_sink_t *sink)
+{
+	conference_obj_t *conference = sink->conference;
+	switch_memory_pool_t *pool = sink->pool;
+	switch_event_t *event;
+
+	if (switch_test_flag((&sink->fh), SWITCH_FILE_OPEN)) {
+		switch_core_file_close(&sink->fh);
+	}
+
+	switch_buffer_destroy(&sink->member.audio_buffer);
+	switch_buffer_destroy(&sink->member.mux_buffer);
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Recording of %s Stopped\n", sink->path);
+	if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
+		conference_add_event_data(conference, event);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "stop-recording");
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Path", sink->path);
+		switch_event_fire(&event);
+	}
+
+	switch_core_destroy_memory_pool(&pool);
+	switch_atomic_dec(&globals.rec_sinks);
+
+	switch_thread_rwlock_unlock(conference->rwlock);
+}
+
+/* Shared recording writer, turns each block into one large file write */
+static void *SWITCH_THREAD_FUNC conference_rec_writer_run(switch_thread_t *thread, void *obj)
+{
+	conference_rec_writer_t *writer = (conference_rec_writer_t *) obj;
+	void *pop;
+
+	for (;;) {
+		conference_rec_block_t *block;
+		conference_rec_sink_t *sink;
+		switch_size_t len;
+
+		if (switch_queue_pop_timeout(writer->queue, &pop, 100000) != SWITCH_STATUS_SUCCESS) {
+			if (!globals.running && !switch_atomic_read(&globals.rec_sinks)) {
+				break;
 			}
+			continue;
+		}
 
-			switch_mutex_lock(member->conference->member_mutex);
-			member->conference->relationship_total--;
-			switch_mutex_unlock(member->conference->member_mutex);
+		block = (conference_rec_block_t *) pop;
+		sink = block->sink;
+
+		if (block->close) {
+			conference_rec_sink_finish(sink);
+			continue;
+		}
 
+		if (!sink->failed && !switch_test_flag((&sink->fh), SWITCH_FILE_OPEN)) {
+			conference_rec_sink_open(sink);
 		}
-		last = rel;
+
+		if (!sink->failed) {
+			len = block->datalen / 2;
+			if (switch_core_file_write(&sink->fh, block->data, &len) != SWITCH_STATUS_SUCCESS) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Write Failed [%s]\n", sink->path);
+				sink->failed = 1;
+			}
+		}
+
+		switch_atomic_dec(&sink->pending);
+		switch_atomic_dec(&sink->conference->rec_backlog);
+		conference_rec_block_put(sink, block);
 	}
-	unlock_member(member);
 
-	return status;
+	switch_atomic_dec(&globals.threads);
+
+	return NULL;
 }
 
-/* Gain exclusive access and add the member to the list */
-static switch_status_t conference_add_member(conference_obj_t *conference, conference_member_t *member)
+/* stop the specified recording */
+static switch_status_t conference_record_stop(conference_obj_t *conference, char *path)
 {
-	switch_status_t status = SWITCH_STATUS_FALSE;
-	switch_event_t *event;
-	char msg[512];				/* conference count announcement */
-	call_list_t *call_list = NULL;
-	switch_channel_t *channel;
-	const char *controls = NULL;
+	conference_member_t *member = NULL;
+	int count = 0;
 
 	switch_assert(conference != NULL);
-	switch_assert(member != NULL);
 
-	switch_mutex_lock(conference->mutex);
-	switch_mutex_lock(member->audio_in_mutex);
-	switch_mutex_lock(member->audio_out_mutex);
-	lock_member(member);
-	switch_mutex_lock(conference->member_mutex);
+	for (;;) {
+		switch_mutex_lock(conference->member_mutex);
+		for (member = conference->members; member; member = member->next) {
+			if (member->rec_sink && switch_test_flag(member, MFLAG_RUNNING) && (!path || !strcmp(path, member->rec_path))) {
+				switch_clear_flag_locked(member, MFLAG_RUNNING);
+				break;
+			}
+		}
+		switch_mutex_unlock(conference->member_mutex);
+
+		if (!member) {
+			break;
+		}
 
+		/* once it is out of the member list the mixer is done with it and the rest belongs to the writer */
+		conference_del_member(conference, member);
+		conference_rec_sink_close(member->rec_sink);
+		count++;
+	}
 
-	member->join_time = switch_epoch_time_now(NULL);
+	return count;
+}
+
+/* Record the conference mix to path through the shared writers */
+static void conference_record_start(conference_obj_t *conference, char *path)
+{
+	switch_memory_pool_t *pool;
+	conference_rec_sink_t *sink;
+	conference_member_t *member;
+	uint32_t samples = switch_samples_per_packet(conference->rate, conference->interval);
+
+	if (!globals.rec_writers) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "No recording writers running\n");
+		return;
+	}
+
+	if (switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Pool Failure\n");
+		return;
+	}
+
+	if (switch_thread_rwlock_tryrdlock(conference->rwlock) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Read Lock Fail\n");
+		switch_core_destroy_memory_pool(&pool);
+		return;
+	}
+
+	sink = switch_core_alloc(pool, sizeof(*sink));
+	sink->conference = conference;
+	sink->pool = pool;
+	sink->path = switch_core_strdup(pool, path);
+	sink->block_size = samples * 2 * (CONF_REC_BLOCK_MS / conference->interval);
+	sink->writer = switch_atomic_read(&globals.rec_next) % globals.rec_writer_threads;
+	switch_atomic_inc(&globals.rec_next);
+	switch_mutex_init(&sink->mutex, SWITCH_MUTEX_NESTED, pool);
+
+	member = &sink->member;
+	member->flags = MFLAG_CAN_HEAR | MFLAG_NOCHANNEL | MFLAG_RUNNING;
 	member->conference = conference;
-	member->next = conference->members;
-	member->energy_level = conference->energy_level;
-	member->score_iir = 0;
-	member->verbose_events = conference->verbose_events;
-	conference->members = member;
-	switch_set_flag_locked(member, MFLAG_INTREE);
-	switch_mutex_unlock(conference->member_mutex);
+	member->native_rate = conference->rate;
+	member->rec_path = sink->path;
+	member->rec_sink = sink;
+	member->id = next_member_id();
+	member->pool = pool;
 
-	if (!switch_test_flag(member, MFLAG_NOCHANNEL)) {
-		conference->count++;
+	member->frame_size = SWITCH_RECOMMENDED_BUFFER_SIZE;
+	member->frame = switch_core_alloc(member->pool, member->frame_size);
+	member->mux_frame = switch_core_alloc(member->pool, member->frame_size);
 
-		if (switch_test_flag(member, MFLAG_ENDCONF)) {
-			if (conference->end_count++);
+	switch_mutex_init(&member->write_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_mutex_init(&member->flag_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_mutex_init(&member->audio_in_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_mutex_init(&member->audio_out_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_mutex_init(&member->read_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_thread_rwlock_create(&member->rwlock, pool);
+
+	switch_atomic_inc(&globals.rec_sinks);
+
+	/* Setup an audio buffer for the incoming audio, the mixer looks at it like any other member's */
+	if (switch_buffer_create_spsc(&member->audio_buffer, CONF_RING_SIZE) != SWITCH_STATUS_SUCCESS ||
+		switch_buffer_create_spsc(&member->mux_buffer, CONF_RING_SIZE) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
+		conference_rec_sink_finish(sink);
+		return;
+	}
+
+	if (conference_add_member(conference, member) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Joining Conference\n");
+		conference_rec_sink_finish(sink);
+		return;
+	}
+}
+
+/* Start the shared recording writers */
+static void launch_conference_rec_writers(void)
+{
+	uint32_t x;
+
+	globals.rec_writers = switch_core_alloc(globals.conference_pool, sizeof(*globals.rec_writers) * globals.rec_writer_threads);
+
+	switch_atomic_add(&globals.threads, globals.rec_writer_threads);
+
+	for (x = 0; x < globals.rec_writer_threads; x++) {
+		switch_queue_create(&globals.rec_writers[x].queue, SWITCH_CORE_QUEUE_LEN, globals.conference_pool);
+		launch_thread_detached(conference_rec_writer_run, globals.conference_pool, &globals.rec_writers[x]);
+	}
+}
+
+
+static conference_track_chunk_t *conference_track_chunk_get(conference_track_rec_t *rec)
+{
+	conference_track_chunk_t *chunk;
+
+	switch_mutex_lock(rec->mutex);
+	if ((chunk = rec->free_chunks)) {
+		rec->free_chunks = chunk->next;
+	} else {
+		chunk = switch_core_alloc(rec->pool, rec->chunk_size);
+	}
+	switch_mutex_unlock(rec->mutex);
+
+	return chunk;
+}
+
+static void conference_track_chunk_put(conference_track_rec_t *rec, conference_track_chunk_t *chunk)
+{
+	switch_mutex_lock(rec->mutex);
+	chunk->next = rec->free_chunks;
+	rec->free_chunks = chunk;
+	switch_mutex_unlock(rec->mutex);
+}
+
+/* Queue the frame of everyone the mixer read audio from this tick. The input thread only hands the mixer
+   audio while a member is talking so silent members cost nothing here or on disk. Called with conference->mutex held. */
+static void conference_track_rec_feed(conference_track_rec_t *rec, conference_mix_table_t *table)
+{
+	conference_track_chunk_t *chunk;
+	uint32_t i;
+
+	for (i = 0; i < table->count; i++) {
+		if (!table->read[i] || (table->flags[i] & MFLAG_NOCHANNEL) || !(table->flags[i] & MFLAG_CAN_SPEAK)) {
+			continue;
 		}
 
-		if (switch_event_create(&event, SWITCH_EVENT_PRESENCE_IN) == SWITCH_STATUS_SUCCESS) {
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "proto", CONF_CHAT_PROTO);
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "login", conference->name);
-			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "from", "%s@%s", conference->name, conference->domain);
-			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "status", "Active (%d caller%s)", conference->count, conference->count == 1 ? "" : "s");
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "event_type", "presence");
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "alt_event_type", "dialog");
-			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "event_count", "%d", EC++);
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "unique-id", conference->name);
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "channel-state", "CS_ROUTING");
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "answer-state", conference->count == 1 ? "early" : "confirmed");
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "presence-call-direction", conference->count == 1 ? "outbound" : "inbound");
-			switch_event_fire(&event);
+		if (!(chunk = conference_track_chunk_get(rec))) {
+			rec->dropped++;
+			continue;
 		}
 
-		channel = switch_core_session_get_channel(member->session);
-		switch_channel_set_variable_printf(channel, "conference_member_id", "%d", member->id);
-		switch_channel_set_variable_printf(channel, "conference_moderator", "%s", switch_test_flag(member, MFLAG_MOD) ? "true" : "false");
-		switch_channel_set_variable(channel, CONFERENCE_UUID_VARIABLE, conference->uuid_str);
-		
-		if (switch_test_flag(conference, CFLAG_WAIT_MOD) && switch_test_flag(member, MFLAG_MOD)) {
-			switch_clear_flag(conference, CFLAG_WAIT_MOD);
+		chunk->member_id = table->member[i]->id;
+		chunk->tick = rec->tick;
+		chunk->datalen = table->read[i];
+		memcpy(chunk->data, table->frame[i], chunk->datalen);
+
+		if (switch_queue_trypush(rec->queue, chunk) != SWITCH_STATUS_SUCCESS) {
+			conference_track_chunk_put(rec, chunk);
+			rec->dropped++;
 		}
+	}
 
-		if (conference->count > 1) {
-			if (conference->moh_sound && !switch_test_flag(conference, CFLAG_WAIT_MOD)) {
-				/* stop MoH if any */
-				conference_stop_file(conference, FILE_STOP_ASYNC);
-			}
+	rec->tick++;
+}
 
-			if (!switch_channel_test_app_flag_key("conf_silent", channel, CONF_SILENT_REQ) && !zstr(conference->enter_sound)) {
-                                const char * enter_sound = switch_channel_get_variable(channel, "conference_enter_sound");
-				if (switch_test_flag(conference, CFLAG_ENTER_SOUND)) {
-					if (!zstr(enter_sound)) {
-				     	conference_play_file(conference, (char *)enter_sound, CONF_DEFAULT_LEADIN,
-						     	switch_core_session_get_channel(member->session), !switch_test_flag(conference, CFLAG_WAIT_MOD) ? 0 : 1);
-			        } else {	
-				     		conference_play_file(conference, conference->enter_sound, CONF_DEFAULT_LEADIN, switch_core_session_get_channel(member->session),
-								!switch_test_flag(conference, CFLAG_WAIT_MOD) ? 0 : 1);
-					}
-				}
-			}
+/* Tell the writer a member left so its track is closed now rather than when the recording stops */
+static void conference_track_rec_leave(conference_track_rec_t *rec, conference_member_t *member)
+{
+	conference_track_chunk_t *chunk;
+
+	if ((chunk = conference_track_chunk_get(rec))) {
+		chunk->member_id = member->id;
+		chunk->tick = rec->tick;
+		chunk->datalen = 0;
+		if (switch_queue_trypush(rec->queue, chunk) != SWITCH_STATUS_SUCCESS) {
+			conference_track_chunk_put(rec, chunk);
 		}
+	}
+}
+
+/* Close the segment in progress, the index gets one "<start ms> <duration ms> <file offset ms>" line per segment */
+static void conference_track_end_segment(conference_track_rec_t *rec, conference_track_t *track)
+{
+	if (!track->segment_samples) {
+		return;
+	}
+
+	if (track->idx) {
+		fprintf(track->idx, "%" SWITCH_SIZE_T_FMT " %" SWITCH_SIZE_T_FMT " %" SWITCH_SIZE_T_FMT "\n",
+				(switch_size_t) track->segment_tick * rec->interval,
+				track->segment_samples * 1000 / rec->rate,
+				(track->samples - track->segment_samples) * 1000 / rec->rate);
+	}
+
+	track->segment_samples = 0;
+}
+
+static void conference_track_close(conference_track_rec_t *rec, conference_track_t *track)
+{
+	conference_track_end_segment(rec, track);
+
+	if (track->idx) {
+		fclose(track->idx);
+	}
+
+	if (switch_test_flag((&track->fh), SWITCH_FILE_OPEN)) {
+		switch_core_file_close(&track->fh);
+	}
+
+	free(track);
+}
+
+static void conference_track_write(conference_track_rec_t *rec, conference_track_chunk_t *chunk)
+{
+	conference_track_t *track;
+	char key[16];
+	char *path;
+	switch_size_t len;
+
+	switch_snprintf(key, sizeof(key), "%u", chunk->member_id);
+	track = switch_core_hash_find(rec->tracks, key);
+
+	if (!chunk->datalen) {
+		if (track) {
+			switch_core_hash_delete(rec->tracks, key);
+			conference_track_close(rec, track);
+		}
+		return;
+	}
+
+	if (!track) {
+		switch_zmalloc(track, sizeof(*track));
+		track->fh.channels = 1;
+		track->fh.samplerate = rec->rate;
+		track->fh.pre_buffer_datalen = SWITCH_DEFAULT_FILE_BUFFER_LEN;
+
+		path = switch_mprintf("%s-%u.%s", rec->base, chunk->member_id, rec->ext);
+		if (switch_core_file_open(&track->fh, path, 1, rec->rate, SWITCH_FILE_FLAG_WRITE | SWITCH_FILE_DATA_SHORT, NULL) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Opening File [%s]\n", path);
+		}
+		switch_safe_free(path);
+
+		path = switch_mprintf("%s-%u.idx", rec->base, chunk->member_id);
+		if (!(track->idx = fopen(path, "w"))) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Opening File [%s]\n", path);
+		}
+		switch_safe_free(path);
+
+		switch_core_hash_insert(rec->tracks, key, track);
+	}
+
+	if (!switch_test_flag((&track->fh), SWITCH_FILE_OPEN)) {
+		return;
+	}
+
+	if (track->segment_samples && chunk->tick != track->last_tick + 1) {
+		conference_track_end_segment(rec, track);
+	}
+
+	if (!track->segment_samples) {
+		track->segment_tick = chunk->tick;
+	}
+
+	len = chunk->datalen / 2;
+	if (switch_core_file_write(&track->fh, chunk->data, &len) == SWITCH_STATUS_SUCCESS) {
+		track->samples += len;
+		track->segment_samples += len;
+	}
+	track->last_tick = chunk->tick;
+}
+
+static void *SWITCH_THREAD_FUNC conference_track_thread_run(switch_thread_t *thread, void *obj)
+{
+	conference_track_rec_t *rec = (conference_track_rec_t *) obj;
+	switch_memory_pool_t *pool = rec->pool;
+	switch_hash_index_t *hi;
+	void *pop, *val;
+
+	switch_atomic_inc(&globals.threads);
+
+	for (;;) {
+		if (switch_queue_pop_timeout(rec->queue, &pop, 100000) == SWITCH_STATUS_SUCCESS) {
+			conference_track_write(rec, (conference_track_chunk_t *) pop);
+			conference_track_chunk_put(rec, (conference_track_chunk_t *) pop);
+		} else if (!rec->running) {
+			/* the mixer let go of us before clearing running so whatever it queued is already here */
+			while (switch_queue_trypop(rec->queue, &pop) == SWITCH_STATUS_SUCCESS) {
+				conference_track_write(rec, (conference_track_chunk_t *) pop);
+			}
+			break;
+		}
+	}
+
+	while ((hi = switch_hash_first(NULL, rec->tracks))) {
+		const void *key;
+
+		switch_hash_this(hi, &key, NULL, &val);
+		switch_core_hash_delete(rec->tracks, (const char *) key);
+		conference_track_close(rec, (conference_track_t *) val);
+	}
+	switch_core_hash_destroy(&rec->tracks);
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Track recording of %s Stopped\n", rec->path);
+
+	switch_core_destroy_memory_pool(&pool);
+
+	switch_atomic_dec(&globals.threads);
+
+	return NULL;
+}
+
+/* Start writing one track per speaker, <base>-<member id>.<ext> plus a <base>-<member id>.idx segment index */
+static switch_status_t conference_tracks_start(conference_obj_t *conference, const char *path)
+{
+	switch_memory_pool_t *pool;
+	conference_track_rec_t *rec;
+	switch_threadattr_t *thd_attr = NULL;
+	switch_thread_t *thread;
+	switch_event_t *event;
+	char *p;
+
+	if (switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Pool Failure\n");
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	rec = switch_core_alloc(pool, sizeof(*rec));
+	rec->pool = pool;
+	rec->path = switch_core_strdup(pool, path);
+	rec->base = switch_core_strdup(pool, path);
+	rec->ext = "wav";
+	if ((p = strrchr(rec->base, '.')) && !strchr(p, '/')) {
+		*p++ = '\0';
+		rec->ext = p;
+	}
+	rec->rate = conference->rate;
+	rec->interval = conference->interval;
+	rec->chunk_size = sizeof(conference_track_chunk_t) + switch_samples_per_packet(conference->rate, conference->interval) * 2;
+	rec->running = 1;
+	switch_mutex_init(&rec->mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_queue_create(&rec->queue, CONF_TRACK_QUEUE_LEN, pool);
+	switch_core_hash_init(&rec->tracks, NULL);
+
+	switch_mutex_lock(conference->mutex);
+	if (conference->track_rec) {
+		switch_mutex_unlock(conference->mutex);
+		switch_core_hash_destroy(&rec->tracks);
+		switch_core_destroy_memory_pool(&pool);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_threadattr_create(&thd_attr, pool);
+	switch_threadattr_detach_set(thd_attr, 1);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	switch_thread_create(&thread, thd_attr, conference_track_thread_run, rec, pool);
+
+	conference->track_rec = rec;
+	switch_mutex_unlock(conference->mutex);
+
+	if (test_eflag(conference, EFLAG_RECORD) &&
+		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
+		conference_add_event_data(conference, event);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "start-recording");
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Path", path);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Mode", "tracks");
+		switch_event_fire(&event);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* Detach the track recording from the mixer, its thread drains what was queued and cleans up after itself */
+static switch_status_t conference_tracks_stop(conference_obj_t *conference)
+{
+	conference_track_rec_t *rec;
+	switch_event_t *event;
+
+	switch_mutex_lock(conference->mutex);
+	rec = conference->track_rec;
+	conference->track_rec = NULL;
+	switch_mutex_unlock(conference->mutex);
+
+	if (!rec) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (rec->dropped) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Track recording of %s dropped %u frames\n", rec->path, rec->dropped);
+	}
+
+	if (test_eflag(conference, EFLAG_RECORD) &&
+		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
+		conference_add_event_data(conference, event);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "stop-recording");
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Path", rec->path);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Mode", "tracks");
+		switch_event_fire(&event);
+	}
+
+	/* rec belongs to the writer thread from here on */
+	rec->running = 0;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* Add a custom relationship to a member */
+static conference_relationship_t *member_add_relationship(conference_member_t *member, uint32_t id)
+{
+	conference_relationship_t *rel = NULL;
+
+	if (member == NULL || id == 0 || !(rel = switch_core_alloc(member->pool, sizeof(*rel))))
+		return NULL;
+
+	rel->id = id;
+
+
+	lock_member(member);
+	switch_mutex_lock(member->conference->member_mutex);
+	member->conference->relationship_total++;
+	member->conference->relationship_version++;
+	switch_mutex_unlock(member->conference->member_mutex);
+	rel->next = member->relationships;
+	member->relationships = rel;
+	unlock_member(member);
+
+	return rel;
+}
+
+/* Remove a custom relationship from a member */
+static switch_status_t member_del_relationship(conference_member_t *member, uint32_t id)
+{
+	switch_status_t status = SWITCH_STATUS_FALSE;
+	conference_relationship_t *rel, *last = NULL;
+
+	if (member == NULL || id == 0)
+		return status;
+
+	lock_member(member);
+	for (rel = member->relationships; rel; rel = rel->next) {
+		if (rel->id == id) {
+			/* we just forget about rel here cos it was allocated by the member's pool 
+			   it will be freed when the member is */
+			status = SWITCH_STATUS_SUCCESS;
+			if (last) {
+				last->next = rel->next;
+			} else {
+				member->relationships = rel->next;
+			}
+
+			switch_mutex_lock(member->conference->member_mutex);
+			member->conference->relationship_total--;
+			member->conference->relationship_version++;
+			switch_mutex_unlock(member->conference->member_mutex);
+
+		}
+		last = rel;
+	}
+	unlock_member(member);
+
+	return status;
+}
+
+/* Gain exclusive access and add the member to the list */
+static switch_status_t conference_add_member(conference_obj_t *conference, conference_member_t *member)
+{
+	switch_status_t status = SWITCH_STATUS_FALSE;
+	switch_event_t *event;
+	char msg[512];				/* conference count announcement */
+	call_list_t *call_list = NULL;
+	switch_channel_t *channel;
+	const char *controls = NULL;
+
+	switch_assert(conference != NULL);
+	switch_assert(member != NULL);
+
+	switch_mutex_lock(conference->mutex);
+	switch_mutex_lock(member->audio_in_mutex);
+	switch_mutex_lock(member->audio_out_mutex);
+	lock_member(member);
+	switch_mutex_lock(conference->member_mutex);
+
+
+	member->join_time = switch_epoch_time_now(NULL);
+	member->conference = conference;
+	member->next = conference->members;
+	member->energy_level = conference->energy_level;
+	member->score_iir = 0;
+	member->verbose_events = conference->verbose_events;
+	conference->members = member;
+	conference->members_version++;
+	switch_set_flag_locked(member, MFLAG_INTREE);
+	conference_member_attach_encoder(conference, member);
+	switch_mutex_unlock(conference->member_mutex);
+
+	conference_state_delta(conference, CONF_DELTA_ADD_MEMBER, member, 0);
+
+	if (!switch_test_flag(member, MFLAG_NOCHANNEL)) {
+		conference->count++;
+
+		if (switch_test_flag(member, MFLAG_ENDCONF)) {
+			if (conference->end_count++);
+		}
+
+		if (switch_event_create(&event, SWITCH_EVENT_PRESENCE_IN) == SWITCH_STATUS_SUCCESS) {
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "proto", CONF_CHAT_PROTO);
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "login", conference->name);
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "from", "%s@%s", conference->name, conference->domain);
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "status", "Active (%d caller%s)", conference->count, conference->count == 1 ? "" : "s");
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "event_type", "presence");
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "alt_event_type", "dialog");
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "event_count", "%d", EC++);
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "unique-id", conference->name);
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "channel-state", "CS_ROUTING");
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "answer-state", conference->count == 1 ? "early" : "confirmed");
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "presence-call-direction", conference->count == 1 ? "outbound" : "inbound");
+			switch_event_fire(&event);
+		}
+
+		channel = switch_core_session_get_channel(member->session);
+		switch_channel_set_variable_printf(channel, "conference_member_id", "%d", member->id);
+		switch_channel_set_variable_printf(channel, "conference_moderator", "%s", switch_test_flag(member, MFLAG_MOD) ? "true" : "false");
+		switch_channel_set_variable(channel, CONFERENCE_UUID_VARIABLE, conference->uuid_str);
+		
+		if (switch_test_flag(conference, CFLAG_WAIT_MOD) && switch_test_flag(member, MFLAG_MOD)) {
+			switch_clear_flag(conference, CFLAG_WAIT_MOD);
+		}
+
+		if (conference->count > 1) {
+			if (conference->moh_sound && !switch_test_flag(conference, CFLAG_WAIT_MOD)) {
+				/* stop MoH if any */
+				conference_stop_file(conference, FILE_STOP_ASYNC);
+			}
+
+			if (!switch_channel_test_app_flag_key("conf_silent", channel, CONF_SILENT_REQ) && !zstr(conference->enter_sound)) {
+                                const char * enter_sound = switch_channel_get_variable(channel, "conference_enter_sound");
+				if (switch_test_flag(conference, CFLAG_ENTER_SOUND)) {
+					if (!zstr(enter_sound)) {
+				     	conference_play_file(conference, (char *)enter_sound, CONF_DEFAULT_LEADIN,
+						     	switch_core_session_get_channel(member->session), !switch_test_flag(conference, CFLAG_WAIT_MOD) ? 0 : 1);
+			        } else {	
+				     		conference_play_file(conference, conference->enter_sound, CONF_DEFAULT_LEADIN, switch_core_session_get_channel(member->session),
+								!switch_test_flag(conference, CFLAG_WAIT_MOD) ? 0 : 1);
+					}
+				}
+			}
+		}
+
+
+		call_list = (call_list_t *) switch_channel_get_private(channel, "_conference_autocall_list_");
+
+		if (call_list) {
+			char saymsg[1024];
+			switch_snprintf(saymsg, sizeof(saymsg), "Auto Calling %d parties", call_list->iteration);
+			conference_member_say(member, saymsg, 0);
+		} else {
+
+			if (!switch_channel_test_app_flag_key("conf_silent", channel, CONF_SILENT_REQ)) {
+				/* announce the total number of members in the conference */
+				if (conference->count >= conference->announce_count && conference->announce_count > 1) {
+					switch_snprintf(msg, sizeof(msg), "There are %d callers", conference->count);
+					conference_member_say(member, msg, CONF_DEFAULT_LEADIN);
+				} else if (conference->count == 1 && !conference->perpetual_sound && !switch_test_flag(conference, CFLAG_WAIT_MOD)) {
+					/* as long as its not a bridge_to conference, announce if person is alone */
+					if (!switch_test_flag(conference, CFLAG_BRIDGE_TO)) {
+						if (conference->alone_sound) {
+							conference_stop_file(conference, FILE_STOP_ASYNC);
+							conference_play_file(conference, conference->alone_sound, CONF_DEFAULT_LEADIN,
+												 switch_core_session_get_channel(member->session), 1);
+						} else {
+							switch_snprintf(msg, sizeof(msg), "You are currently the only person in this conference.");
+							conference_member_say(member, msg, CONF_DEFAULT_LEADIN);
+						}
+					}
+
+				}
+			}
+		}
+
+		if (conference->count == 1) {
+			conference->floor_holder = member;
+			conference_state_delta(conference, CONF_DELTA_FLOOR_CHANGE, member, 0);
+		}
+
+		if (conference->min && conference->count >= conference->min) {
+			switch_set_flag(conference, CFLAG_ENFORCE_MIN);
+		}
+
+		if (!switch_channel_test_app_flag_key("conf_silent", channel, CONF_SILENT_REQ) &&
+			switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
+			conference_add_event_member_data(member, event);
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "add-member");
+			switch_event_fire(&event);
+		}
+
+		switch_channel_clear_app_flag_key("conf_silent", channel, CONF_SILENT_REQ);
+		switch_channel_set_app_flag_key("conf_silent", channel, CONF_SILENT_DONE);
+
+		switch_ivr_dmachine_create(&member->dmachine, "mod_conference", NULL, 
+				conference->ivr_dtmf_timeout, conference->ivr_input_timeout, NULL, NULL, NULL);
+
+		controls = switch_channel_get_variable(channel, "conference_controls");
+
+		if (zstr(controls)) {
+			if (!switch_test_flag(member, MFLAG_MOD) || !conference->moderator_controls) {
+				controls = conference->caller_controls;
+			} else {
+				controls = conference->moderator_controls;
+			}
+		}
+
+		if (zstr(controls)) {
+			controls = "default";
+		}
+
+		if (strcasecmp(controls, "none")) {
+			member_bind_controls(member, controls);
+		}
+		
+	}
+	unlock_member(member);
+	switch_mutex_unlock(member->audio_out_mutex);
+	switch_mutex_unlock(member->audio_in_mutex);
+
+	switch_mutex_unlock(conference->mutex);
+	status = SWITCH_STATUS_SUCCESS;
+
+	return status;
+}
+
+/* Gain exclusive access and remove the member from the list */
+static switch_status_t conference_del_member(conference_obj_t *conference, conference_member_t *member)
+{
+	switch_status_t status = SWITCH_STATUS_FALSE;
+	conference_member_t *imember, *last = NULL;
+	switch_event_t *event;
+	conference_file_node_t *member_fnode;
+	switch_speech_handle_t *member_sh;
+	const char *exit_sound = NULL;
+
+	switch_assert(conference != NULL);
+	switch_assert(member != NULL);
+
+	switch_thread_rwlock_wrlock(member->rwlock);
+
+	if (member->session && (exit_sound = switch_channel_get_variable(switch_core_session_get_channel(member->session), "conference_exit_sound"))) {
+		conference_play_file(conference, (char *)exit_sound, CONF_DEFAULT_LEADIN,
+							 switch_core_session_get_channel(member->session), !switch_test_flag(conference, CFLAG_WAIT_MOD) ? 0 : 1);
+	}
+
+
+	lock_member(member);
+	member_fnode = member->fnode;
+	member_sh = member->sh;
+	member->fnode = NULL;
+	member->sh = NULL;
+	unlock_member(member);
+
+	switch_ivr_dmachine_destroy(&member->dmachine);
+
+	switch_mutex_lock(conference->mutex);
+	switch_mutex_lock(conference->member_mutex);
+	switch_mutex_lock(member->audio_in_mutex);
+	switch_mutex_lock(member->audio_out_mutex);
+	lock_member(member);
+	switch_clear_flag(member, MFLAG_INTREE);
+
+	for (imember = conference->members; imember; imember = imember->next) {
+		if (imember == member) {
+			if (last) {
+				last->next = imember->next;
+			} else {
+				conference->members = imember->next;
+			}
+			conference->members_version++;
+			break;
+		}
+		last = imember;
+	}
+
+	/* the mixer can't reach us anymore so whatever is still queued is ours to give back */
+	conference_member_flush_mux_queue(member);
+
+	if (conference->track_rec && !switch_test_flag(member, MFLAG_NOCHANNEL)) {
+		conference_track_rec_leave(conference->track_rec, member);
+	}
+
+	if (member->encoder) {
+		member->encoder->users--;
+		member->encoder = NULL;
+	}
+
+	switch_thread_rwlock_unlock(member->rwlock);
+	
+	/* Close Unused Handles */
+	if (member_fnode) {
+		conference_file_node_t *fnode, *cur;
+		switch_memory_pool_t *pool;
+
+		fnode = member_fnode;
+		while (fnode) {
+			cur = fnode;
+			fnode = fnode->next;
+
+			conference_file_node_close(cur);
+
+			pool = cur->pool;
+			switch_core_destroy_memory_pool(&pool);
+		}
+	}
+
+	if (member_sh) {
+		switch_speech_flag_t flags = SWITCH_SPEECH_FLAG_NONE;
+		switch_core_speech_close(&member->lsh, &flags);
+	}
+
+	if (member == member->conference->floor_holder) {
+		member->conference->floor_holder = NULL;
+		conference_state_delta(conference, CONF_DELTA_FLOOR_CHANGE, NULL, 0);
+	}
+
+	member->conference = NULL;
+	conference_state_delta(conference, CONF_DELTA_DEL_MEMBER, member, 0);
+
+	if (!switch_test_flag(member, MFLAG_NOCHANNEL)) {
+		conference->count--;
+
+		if (switch_test_flag(member, MFLAG_ENDCONF)) {
+			if (!--conference->end_count) {
+				switch_set_flag_locked(conference, CFLAG_DESTRUCT);
+			}
+		}
+
+
+		if (switch_event_create(&event, SWITCH_EVENT_PRESENCE_IN) == SWITCH_STATUS_SUCCESS) {
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "proto", CONF_CHAT_PROTO);
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "login", conference->name);
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "from", "%s@%s", conference->name, conference->domain);
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "status", "Active (%d caller%s)", conference->count, conference->count == 1 ? "" : "s");
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "event_type", "presence");
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "alt_event_type", "dialog");
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "event_count", "%d", EC++);
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "unique-id", conference->name);
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "channel-state", "CS_ROUTING");
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "answer-state", conference->count == 1 ? "early" : "confirmed");
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "call-direction", conference->count == 1 ? "outbound" : "inbound");
+			switch_event_fire(&event);
+		}
+
+		if ((conference->min && switch_test_flag(conference, CFLAG_ENFORCE_MIN) && conference->count < conference->min)
+			|| (switch_test_flag(conference, CFLAG_DYNAMIC) && conference->count == 0)) {
+			switch_set_flag(conference, CFLAG_DESTRUCT);
+		} else {
+			if (!exit_sound && conference->exit_sound && switch_test_flag(conference, CFLAG_EXIT_SOUND)) {
+				conference_play_file(conference, conference->exit_sound, 0, switch_core_session_get_channel(member->session), 0);
+			}
+			if (conference->count == 1 && conference->alone_sound && !switch_test_flag(conference, CFLAG_WAIT_MOD)) {
+				conference_stop_file(conference, FILE_STOP_ASYNC);
+				conference_play_file(conference, conference->alone_sound, 0, switch_core_session_get_channel(member->session), 1);
+			}
+		}
+
+		if (conference->count == 1 && conference->floor_holder != conference->members) {
+			conference->floor_holder = conference->members;
+			conference_state_delta(conference, CONF_DELTA_FLOOR_CHANGE, conference->floor_holder, 0);
+		}
+
+		if (test_eflag(conference, EFLAG_DEL_MEMBER) &&
+			switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
+			conference_add_event_member_data(member, event);
+			conference_add_event_data(conference, event);
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "del-member");
+			switch_event_fire(&event);
+		}
+	}
+	switch_mutex_unlock(conference->member_mutex);
+	unlock_member(member);
+	switch_mutex_unlock(member->audio_out_mutex);
+	switch_mutex_unlock(member->audio_in_mutex);
+	switch_mutex_unlock(conference->mutex);
+	status = SWITCH_STATUS_SUCCESS;
+
+	return status;
+}
+
+struct vid_helper {
+	conference_member_t *member_a;
+	conference_member_t *member_b;
+	int up;
+};
+
+/* Thread bridging video between two members, there will be two threads if video briding is used */
+static void *SWITCH_THREAD_FUNC conference_video_bridge_thread_run(switch_thread_t *thread, void *obj)
+{
+	struct vid_helper *vh = obj;
+	switch_channel_t *channel_a = switch_core_session_get_channel(vh->member_a->session);
+	switch_channel_t *channel_b = switch_core_session_get_channel(vh->member_b->session);
+	switch_status_t status;
+	switch_frame_t *read_frame;
+	
+	/* Acquire locks for both sessions so the helper object and member structures don't get destroyed before we exit */
+	if (switch_core_session_read_lock(vh->member_a->session) != SWITCH_STATUS_SUCCESS) {
+		return NULL;
+	}
+	
+	if (switch_core_session_read_lock(vh->member_b->session) != SWITCH_STATUS_SUCCESS) {
+		switch_core_session_rwunlock(vh->member_a->session);
+		return NULL;
+	}
+
+	vh->up = 1;
+	while (switch_test_flag(vh->member_a, MFLAG_RUNNING) && switch_test_flag(vh->member_b, MFLAG_RUNNING) &&
+		   switch_channel_ready(channel_a) && switch_channel_ready(channel_b))  {
+			status = switch_core_session_read_video_frame(vh->member_a->session, &read_frame, SWITCH_IO_FLAG_NONE, 0);
+			if (!SWITCH_READ_ACCEPTABLE(status)) {
+				break;
+			}
+
+			if (!switch_test_flag(read_frame, SFF_CNG)) {
+				if (switch_core_session_write_video_frame(vh->member_b->session, read_frame, SWITCH_IO_FLAG_NONE, 0) != SWITCH_STATUS_SUCCESS) {
+					break;
+				}
+			}
+	}
+	
+	switch_core_session_rwunlock(vh->member_a->session);
+	switch_core_session_rwunlock(vh->member_b->session);
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "%s video thread ended.\n", switch_channel_get_name(channel_a));
+	
+	vh->up = 0;
+	return NULL;
+}
+
+
+/* Main video monitor thread (1 per distinct conference room) */
+static void *SWITCH_THREAD_FUNC conference_video_thread_run(switch_thread_t *thread, void *obj)
+{
+	conference_obj_t *conference = (conference_obj_t *) obj;
+	conference_member_t *imember;
+	switch_frame_t *vid_frame;
+	switch_status_t status;
+	int has_vid = 1;// req_iframe = 0;
+	int yield = 0;
+	uint32_t last_member = 0;
+	switch_core_session_t *session;
+
+	conference->video_running = 1;
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Video thread started for conference %s\n", conference->name);
+
+	while (has_vid && conference->video_running == 1 && globals.running && !switch_test_flag(conference, CFLAG_DESTRUCT)) {
+		if (yield) {
+			switch_yield(yield);
+			yield = 0;
+		}
+
+		switch_mutex_lock(conference->member_mutex);
+
+		if (!conference->floor_holder) {
+			yield = 100000;
+			goto do_continue;
+		}
+
+		if (!switch_channel_test_flag(switch_core_session_get_channel(conference->floor_holder->session), CF_VIDEO)) {
+			yield = 100000;
+			goto do_continue;
+		}
+
+		session = conference->floor_holder->session;
+		switch_core_session_read_lock(session);
+		switch_mutex_unlock(conference->member_mutex);
+		status = switch_core_session_read_video_frame(session, &vid_frame, SWITCH_IO_FLAG_NONE, 0);
+		switch_mutex_lock(conference->member_mutex);
+		switch_core_session_rwunlock(session);
+
+		if (!SWITCH_READ_ACCEPTABLE(status) || !conference->floor_holder || switch_test_flag(vid_frame, SFF_CNG)) {
+			if (conference->floor_holder) {
+				conference->floor_holder = NULL;
+				conference_state_delta(conference, CONF_DELTA_FLOOR_CHANGE, NULL, 0);
+			}
+			//req_iframe = 0;
+			goto do_continue;
+		}
+
+		if (conference->floor_holder->id != last_member) {
+			int iframe = 0;
+#if 0
+			switch_core_session_message_t msg = { 0 };
+
+
+			if (!req_iframe) {
+				/* Tell the channel to request a fresh vid frame */
+				msg.from = __FILE__;
+				msg.message_id = SWITCH_MESSAGE_INDICATE_VIDEO_REFRESH_REQ;
+				switch_core_session_receive_message(conference->floor_holder->session, &msg);
+				req_iframe = 1;
+			}
+#endif
+
+			if (vid_frame->codec->implementation->ianacode == 34) {	/* h.263 */
+				//iframe = (*((int16_t *) vid_frame->data) >> 12 == 6);
+				iframe = 1;
+			} else if (vid_frame->codec->implementation->ianacode == 115) {	/* h.263-1998 */
+				int y = *((int8_t *) vid_frame->data + 2) & 0xfe;
+				iframe = (y == 0x80 || y == 0x82);
+			} else if (vid_frame->codec->implementation->ianacode == 99) {	/* h.264 */
+				uint8_t * hdr = vid_frame->data;
+                uint8_t fragment_type = hdr[0] & 0x1f;
+                uint8_t nal_type = hdr[1] & 0x1f;
+                uint8_t start_bit = hdr[1] & 0x80;
+                iframe = (((fragment_type == 28 || fragment_type == 29) && nal_type == 5 && start_bit == 128) || fragment_type == 5);
+			} else {			/* we need more defs */
+				iframe = 1;
+			}
+
+			if (!iframe) {
+				goto do_continue;
+			}
+
+			//req_iframe = 0;
+		}
+
+		last_member = conference->floor_holder->id;
+
+		switch_mutex_unlock(conference->member_mutex);
+		switch_mutex_lock(conference->member_mutex);
+		has_vid = 0;
+		for (imember = conference->members; imember; imember = imember->next) {
+			if (imember->session && switch_channel_test_flag(switch_core_session_get_channel(imember->session), CF_VIDEO)) {
+				has_vid++;
+				switch_core_session_write_video_frame(imember->session, vid_frame, SWITCH_IO_FLAG_NONE, 0);
+			}
+		}
+
+	  do_continue:
+
+		switch_mutex_unlock(conference->member_mutex);
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Video thread ending for conference %s\n", conference->name);
+	conference->video_running = 0;
+
+	return NULL;
+}
+
+/* Everything the mixer carries from one tick of a conference to the next */
+typedef struct conference_mix_state {
+	uint32_t samples;
+	uint32_t bytes;
+	int divisor;
+	uint8_t *file_frame;
+	uint8_t *async_file_frame;
+	conference_mix_table_t table;
+	struct conference_mix_crew *crew;
+} conference_mix_state_t;
+
+/* Helper threads that build listener frames for very large conferences, the mixer itself works shard 0 */
+typedef struct conference_mix_crew {
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *start_cond;
+	switch_thread_cond_t *done_cond;
+	uint32_t threads;
+	uint32_t shards;
+	uint32_t generation;
+	uint32_t pending;
+	int running;
+	conference_obj_t *conference;
+	conference_mix_state_t *state;
+	const int32_t *main_frame;
+	conference_mix_frame_t *shared_frame;
+} conference_mix_crew_t;
+
+typedef struct conference_mix_shard {
+	conference_mix_crew_t *crew;
+	uint32_t id;
+} conference_mix_shard_t;
+
+static void conference_mix_state_init(conference_obj_t *conference, conference_mix_state_t *state)
+{
+	memset(state, 0, sizeof(*state));
+
+	state->samples = switch_samples_per_packet(conference->rate, conference->interval);
+	state->bytes = state->samples * 2;
+
+	if (!(state->divisor = conference->rate / 8000)) {
+		state->divisor = 1;
+	}
+
+	state->file_frame = switch_core_alloc(conference->pool, SWITCH_RECOMMENDED_BUFFER_SIZE);
+	state->async_file_frame = switch_core_alloc(conference->pool, SWITCH_RECOMMENDED_BUFFER_SIZE);
+
+	conference->is_recording = 0;
+	conference->record_count = 0;
+}
+
+/* The frame everyone who is not talking and not excluding anyone hears */
+static conference_mix_frame_t *conference_mix_shared_frame(conference_obj_t *conference, conference_mix_state_t *state, const int32_t *main_frame)
+{
+	conference_mix_frame_t *shared_frame = conference_mix_frame_get(conference);
+
+	shared_frame->datalen = state->bytes;
+	switch_mix_sln_subtract_saturate(shared_frame->data, main_frame, NULL, state->bytes / 2);
+	conference_mix_frame_encode(conference, shared_frame);
+
+	return shared_frame;
+}
+
+/* Build and deliver the frames of listeners [from, to) in the member table */
+static void conference_mix_listeners(conference_obj_t *conference, conference_mix_state_t *state, const int32_t *main_frame,
+												conference_mix_frame_t **shared_frame, uint32_t from, uint32_t to)
+{
+	conference_mix_table_t *table = &state->table;
+	conference_member_t *omember;
+	int32_t rel_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+	uint32_t bytes = state->bytes;
+	int16_t *bptr;
+	uint32_t i, j;
+
+	/* Create write frame once per member who is not deaf for each sample in the main frame
+	   check if our audio is involved and if so, subtract it from the sample so we don't hear ourselves.
+	   Since main frame was 32 bit int, we did not lose any detail, now that we have to convert to 16 bit we can
+	   cut it off at the min and max range if need be and write the frame to the output buffer.
+	   Everyone who did not contribute audio hears exactly the same thing so that frame is built once and shared.
+	 */
+	for (i = from; i < to; i++) {
+		conference_mix_frame_t *mframe;
+		int16_t *write_frame;
+		uint32_t oflags = table->flags[i];
+
+		omember = table->member[i];
+
+		if (!(oflags & MFLAG_RUNNING)) {
+			continue;
+		}
+
+		if (!(oflags & (MFLAG_CAN_HEAR | MFLAG_WASTE_BANDWIDTH)) && !switch_test_flag(conference, CFLAG_WASTE_BANDWIDTH)) {
+			continue;
+		}
+
+		if (!(oflags & MFLAG_HAS_AUDIO) && !table->exclude_count[i]) {
+			if (!*shared_frame) {
+				*shared_frame = conference_mix_shared_frame(conference, state, main_frame);
+			}
+
+			conference_member_send_mix(omember, *shared_frame);
+			continue;
+		}
+
+		mframe = conference_mix_frame_get(conference);
+		mframe->datalen = bytes;
+		write_frame = mframe->data;
+		bptr = table->frame[i];
+
+		/* the common case: no relationships, so this is just the mix minus our own audio */
+		if (!table->exclude_count[i]) {
+			switch_mix_sln_subtract_saturate(write_frame, main_frame, (oflags & MFLAG_HAS_AUDIO) ? bptr : NULL, bytes / 2);
+		} else {
+			uint32_t *row = table->exclude + i * table->words;
+
+			/* otherwise take everyone we are not supposed to hear out of a copy of the mix, a whole frame at a time */
+			memcpy(rel_frame, main_frame, (bytes / 2) * sizeof(rel_frame[0]));
+
+			for (j = 0; j < table->count; j++) {
+				if (!row[j / 32]) {
+					j |= 31;
+					continue;
+				}
+
+				if ((row[j / 32] & (1U << (j % 32))) &&
+					(table->flags[j] & (MFLAG_RUNNING | MFLAG_HAS_AUDIO)) == (MFLAG_RUNNING | MFLAG_HAS_AUDIO)) {
+					switch_mix_sln_subtract(rel_frame, table->frame[j], table->read[j] / 2);
+				}
+			}
+
+			switch_mix_sln_subtract_saturate(write_frame, rel_frame, (oflags & MFLAG_HAS_AUDIO) ? bptr : NULL, bytes / 2);
+		}
+		
+		conference_member_send_mix(omember, mframe);
+		conference_mix_frame_release(conference, mframe);
+	}
+}
+
+static void conference_mix_shard_range(conference_mix_crew_t *crew, uint32_t shard, uint32_t *from, uint32_t *to)
+{
+	uint32_t count = crew->state->table.count;
+	uint32_t per = (count + crew->shards - 1) / crew->shards;
+
+	*from = shard * per;
+	*to = *from + per;
 
+	if (*from > count) {
+		*from = count;
+	}
 
-		call_list = (call_list_t *) switch_channel_get_private(channel, "_conference_autocall_list_");
+	if (*to > count) {
+		*to = count;
+	}
+}
 
-		if (call_list) {
-			char saymsg[1024];
-			switch_snprintf(saymsg, sizeof(saymsg), "Auto Calling %d parties", call_list->iteration);
-			conference_member_say(member, saymsg, 0);
-		} else {
+static void *SWITCH_THREAD_FUNC conference_mix_shard_run(switch_thread_t *thread, void *obj)
+{
+	conference_mix_shard_t *shard = (conference_mix_shard_t *) obj;
+	conference_mix_crew_t *crew = shard->crew;
+	uint32_t seen = 0;
 
-			if (!switch_channel_test_app_flag_key("conf_silent", channel, CONF_SILENT_REQ)) {
-				/* announce the total number of members in the conference */
-				if (conference->count >= conference->announce_count && conference->announce_count > 1) {
-					switch_snprintf(msg, sizeof(msg), "There are %d callers", conference->count);
-					conference_member_say(member, msg, CONF_DEFAULT_LEADIN);
-				} else if (conference->count == 1 && !conference->perpetual_sound && !switch_test_flag(conference, CFLAG_WAIT_MOD)) {
-					/* as long as its not a bridge_to conference, announce if person is alone */
-					if (!switch_test_flag(conference, CFLAG_BRIDGE_TO)) {
-						if (conference->alone_sound) {
-							conference_stop_file(conference, FILE_STOP_ASYNC);
-							conference_play_file(conference, conference->alone_sound, CONF_DEFAULT_LEADIN,
-												 switch_core_session_get_channel(member->session), 1);
-						} else {
-							switch_snprintf(msg, sizeof(msg), "You are currently the only person in this conference.");
-							conference_member_say(member, msg, CONF_DEFAULT_LEADIN);
-						}
-					}
+	switch_mutex_lock(crew->mutex);
+	seen = crew->generation;
 
-				}
-			}
-		}
+	while (crew->running) {
+		uint32_t from, to;
 
-		if (conference->count == 1) {
-			conference->floor_holder = member;
+		if (seen == crew->generation) {
+			switch_thread_cond_wait(crew->start_cond, crew->mutex);
+			continue;
 		}
 
-		if (conference->min && conference->count >= conference->min) {
-			switch_set_flag(conference, CFLAG_ENFORCE_MIN);
+		seen = crew->generation;
+		conference_mix_shard_range(crew, shard->id, &from, &to);
+		switch_mutex_unlock(crew->mutex);
+
+		conference_mix_listeners(crew->conference, crew->state, crew->main_frame, &crew->shared_frame, from, to);
+
+		switch_mutex_lock(crew->mutex);
+		if (!--crew->pending) {
+			switch_thread_cond_signal(crew->done_cond);
 		}
+	}
 
-		if (!switch_channel_test_app_flag_key("conf_silent", channel, CONF_SILENT_REQ) &&
-			switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
-			conference_add_event_member_data(member, event);
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "add-member");
-			switch_event_fire(&event);
+	crew->threads--;
+	switch_thread_cond_signal(crew->done_cond);
+	switch_mutex_unlock(crew->mutex);
+
+	return NULL;
+}
+
+static conference_mix_crew_t *conference_mix_crew_create(conference_obj_t *conference, conference_mix_state_t *state)
+{
+	conference_mix_crew_t *crew = switch_core_alloc(conference->pool, sizeof(*crew));
+	uint32_t x;
+
+	switch_mutex_init(&crew->mutex, SWITCH_MUTEX_DEFAULT, conference->pool);
+	switch_thread_cond_create(&crew->start_cond, conference->pool);
+	switch_thread_cond_create(&crew->done_cond, conference->pool);
+	crew->conference = conference;
+	crew->state = state;
+	crew->running = 1;
+
+	switch_mutex_lock(crew->mutex);
+	for (x = 0; x < conference->parallel_mix_threads; x++) {
+		conference_mix_shard_t *shard = switch_core_alloc(conference->pool, sizeof(*shard));
+
+		shard->crew = crew;
+		shard->id = crew->threads + 1;
+
+		/* the barrier waits on every counted thread so only count the ones that really started */
+		if (!launch_thread_detached(conference_mix_shard_run, conference->pool, shard)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Conference %s could not start mix shard thread\n", conference->name);
+			continue;
 		}
 
-		switch_channel_clear_app_flag_key("conf_silent", channel, CONF_SILENT_REQ);
-		switch_channel_set_app_flag_key("conf_silent", channel, CONF_SILENT_DONE);
+		crew->threads++;
+	}
+	/* the mixer thread takes shard 0 */
+	crew->shards = crew->threads + 1;
+	switch_mutex_unlock(crew->mutex);
 
-		switch_ivr_dmachine_create(&member->dmachine, "mod_conference", NULL, 
-				conference->ivr_dtmf_timeout, conference->ivr_input_timeout, NULL, NULL, NULL);
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Conference %s mixing in %u shards\n", conference->name, crew->shards);
 
-		controls = switch_channel_get_variable(channel, "conference_controls");
+	return crew;
+}
 
-		if (zstr(controls)) {
-			if (!switch_test_flag(member, MFLAG_MOD) || !conference->moderator_controls) {
-				controls = conference->caller_controls;
-			} else {
-				controls = conference->moderator_controls;
-			}
-		}
+static void conference_mix_crew_destroy(conference_mix_crew_t *crew)
+{
+	switch_mutex_lock(crew->mutex);
+	crew->running = 0;
+	switch_thread_cond_broadcast(crew->start_cond);
+	while (crew->threads) {
+		switch_thread_cond_wait(crew->done_cond, crew->mutex);
+	}
+	switch_mutex_unlock(crew->mutex);
+}
 
-		if (zstr(controls)) {
-			controls = "default";
-		}
+/* Build every listener's frame, split across the crew with a barrier at the end once the room is big enough */
+static void conference_mix_all_listeners(conference_obj_t *conference, conference_mix_state_t *state, const int32_t *main_frame,
+										 conference_mix_frame_t **shared_frame)
+{
+	conference_mix_crew_t *crew;
+	uint32_t from, to, i;
 
-		if (strcasecmp(controls, "none")) {
-			member_bind_controls(member, controls);
+	if (!conference->parallel_mix_threshold || state->table.count < conference->parallel_mix_threshold) {
+		conference_mix_listeners(conference, state, main_frame, shared_frame, 0, state->table.count);
+		return;
+	}
+
+	if (!(crew = state->crew)) {
+		crew = state->crew = conference_mix_crew_create(conference, state);
+	}
+
+	/* the shards can't build the shared frame lazily, do it up front if anyone will want it */
+	for (i = 0; i < state->table.count && !*shared_frame; i++) {
+		if ((state->table.flags[i] & MFLAG_RUNNING) && !(state->table.flags[i] & MFLAG_HAS_AUDIO) && !state->table.exclude_count[i]) {
+			*shared_frame = conference_mix_shared_frame(conference, state, main_frame);
 		}
-		
 	}
-	unlock_member(member);
-	switch_mutex_unlock(member->audio_out_mutex);
-	switch_mutex_unlock(member->audio_in_mutex);
 
-	switch_mutex_unlock(conference->mutex);
-	status = SWITCH_STATUS_SUCCESS;
+	switch_mutex_lock(crew->mutex);
+	crew->main_frame = main_frame;
+	crew->shared_frame = *shared_frame;
+	crew->pending = crew->threads;
+	crew->generation++;
+	switch_thread_cond_broadcast(crew->start_cond);
+	switch_mutex_unlock(crew->mutex);
 
-	return status;
+	conference_mix_shard_range(crew, 0, &from, &to);
+	conference_mix_listeners(conference, state, main_frame, shared_frame, from, to);
+
+	switch_mutex_lock(crew->mutex);
+	while (crew->pending) {
+		switch_thread_cond_wait(crew->done_cond, crew->mutex);
+	}
+	switch_mutex_unlock(crew->mutex);
 }
 
-/* Gain exclusive access and remove the member from the list */
-static switch_status_t conference_del_member(conference_obj_t *conference, conference_member_t *member)
+/* Drop a reference to a cached prompt, the last one frees the audio */
+static void conference_prompt_release(conference_prompt_t *prompt)
 {
-	switch_status_t status = SWITCH_STATUS_FALSE;
-	conference_member_t *imember, *last = NULL;
-	switch_event_t *event;
-	conference_file_node_t *member_fnode;
-	switch_speech_handle_t *member_sh;
-	const char *exit_sound = NULL;
+	if (switch_atomic_dec(&prompt->refs)) {
+		return;
+	}
 
-	switch_assert(conference != NULL);
-	switch_assert(member != NULL);
+	free((int16_t *) prompt->data);
+	switch_safe_free(prompt->key);
+	free(prompt);
+}
 
-	switch_thread_rwlock_wrlock(member->rwlock);
+/* Remove a prompt from the LRU list.  Call with prompt_mutex held. */
+static void conference_prompt_detach(conference_prompt_t *prompt)
+{
+	if (prompt->prev) {
+		prompt->prev->next = prompt->next;
+	} else {
+		globals.prompt_head = prompt->next;
+	}
 
-	if (member->session && (exit_sound = switch_channel_get_variable(switch_core_session_get_channel(member->session), "conference_exit_sound"))) {
-		conference_play_file(conference, (char *)exit_sound, CONF_DEFAULT_LEADIN,
-							 switch_core_session_get_channel(member->session), !switch_test_flag(conference, CFLAG_WAIT_MOD) ? 0 : 1);
+	if (prompt->next) {
+		prompt->next->prev = prompt->prev;
+	} else {
+		globals.prompt_tail = prompt->prev;
 	}
 
+	prompt->prev = prompt->next = NULL;
+}
 
-	lock_member(member);
-	member_fnode = member->fnode;
-	member_sh = member->sh;
-	member->fnode = NULL;
-	member->sh = NULL;
-	unlock_member(member);
+/* Take a prompt out of the cache, playing nodes keep their own references.  Call with prompt_mutex held. */
+static void conference_prompt_unlink(conference_prompt_t *prompt)
+{
+	if (!prompt->cached) {
+		return;
+	}
 
-	switch_ivr_dmachine_destroy(&member->dmachine);
+	switch_core_hash_delete(globals.prompt_hash, prompt->key);
+	conference_prompt_detach(prompt);
+	prompt->cached = 0;
+	globals.prompt_bytes -= prompt->samples * 2;
+	globals.prompt_count--;
 
-	switch_mutex_lock(conference->mutex);
-	switch_mutex_lock(conference->member_mutex);
-	switch_mutex_lock(member->audio_in_mutex);
-	switch_mutex_lock(member->audio_out_mutex);
-	lock_member(member);
-	switch_clear_flag(member, MFLAG_INTREE);
+	conference_prompt_release(prompt);
+}
 
-	for (imember = conference->members; imember; imember = imember->next) {
-		if (imember == member) {
-			if (last) {
-				last->next = imember->next;
-			} else {
-				conference->members = imember->next;
-			}
-			break;
-		}
-		last = imember;
+/* Most recently used first.  Call with prompt_mutex held. */
+static void conference_prompt_push_front(conference_prompt_t *prompt)
+{
+	prompt->prev = NULL;
+	prompt->next = globals.prompt_head;
+
+	if (globals.prompt_head) {
+		globals.prompt_head->prev = prompt;
+	} else {
+		globals.prompt_tail = prompt;
 	}
 
-	switch_thread_rwlock_unlock(member->rwlock);
-	
-	/* Close Unused Handles */
-	if (member_fnode) {
-		conference_file_node_t *fnode, *cur;
-		switch_memory_pool_t *pool;
+	globals.prompt_head = prompt;
+}
 
-		fnode = member_fnode;
-		while (fnode) {
-			cur = fnode;
-			fnode = fnode->next;
+/* Decode a whole file at the given rate, giving up on anything too big to be worth caching */
+static conference_prompt_t *conference_prompt_load(const char *path, uint32_t rate, const char *key, time_t mtime)
+{
+	switch_file_handle_t fh = { 0 };
+	conference_prompt_t *prompt;
+	switch_size_t max_samples = globals.prompt_max_bytes / 8;
+	switch_size_t alloced = 0, samples = 0, len;
+	int16_t *data = NULL, *tmp;
+
+	if (switch_core_file_open(&fh, path, 1, rate, SWITCH_FILE_FLAG_READ | SWITCH_FILE_DATA_SHORT, NULL) != SWITCH_STATUS_SUCCESS) {
+		return NULL;
+	}
 
-			if (cur->type != NODE_TYPE_SPEECH) {
-				switch_core_file_close(&cur->fh);
+	for (;;) {
+		if (alloced - samples < SWITCH_RECOMMENDED_BUFFER_SIZE / 2) {
+			alloced += rate;
+			if (alloced > max_samples || !(tmp = realloc(data, alloced * 2))) {
+				switch_core_file_close(&fh);
+				switch_safe_free(data);
+				return NULL;
 			}
+			data = tmp;
+		}
 
-			pool = cur->pool;
-			switch_core_destroy_memory_pool(&pool);
+		len = SWITCH_RECOMMENDED_BUFFER_SIZE / 2;
+		if (switch_core_file_read(&fh, data + samples, &len) != SWITCH_STATUS_SUCCESS || !len) {
+			break;
 		}
+		samples += len;
 	}
 
-	if (member_sh) {
-		switch_speech_flag_t flags = SWITCH_SPEECH_FLAG_NONE;
-		switch_core_speech_close(&member->lsh, &flags);
-	}
+	switch_core_file_close(&fh);
 
-	if (member == member->conference->floor_holder) {
-		member->conference->floor_holder = NULL;
+	if (!samples) {
+		switch_safe_free(data);
+		return NULL;
 	}
 
-	member->conference = NULL;
+	switch_zmalloc(prompt, sizeof(*prompt));
+	prompt->data = data;
+	prompt->samples = samples;
+	prompt->key = strdup(key);
+	prompt->mtime = mtime;
+	prompt->checked = switch_epoch_time_now(NULL);
+	switch_atomic_set(&prompt->refs, 1);
 
-	if (!switch_test_flag(member, MFLAG_NOCHANNEL)) {
-		conference->count--;
+	return prompt;
+}
 
-		if (switch_test_flag(member, MFLAG_ENDCONF)) {
-			if (!--conference->end_count) {
-				switch_set_flag_locked(conference, CFLAG_DESTRUCT);
-			}
-		}
+/* Find or decode a prompt, returns it with a reference for the caller or NULL when it should be played from the file.
+   A hit does not touch the file, it is only stat()ed again every CONF_PROMPT_RECHECK_SEC or after reloadxml.
+   Callers on the mixer thread pass load as false so a miss never decodes a whole file inside a tick. */
+static conference_prompt_t *conference_prompt_get(const char *path, uint32_t rate, switch_bool_t load)
+{
+	conference_prompt_t *prompt, *loaded;
+	time_t now = switch_epoch_time_now(NULL);
+	struct stat st;
+	int recheck = 0;
+	char *key;
+
+	/* plain local files only, anything with parameters or a url scheme goes the long way */
+	if (!globals.prompt_max_bytes || !globals.prompt_hash || zstr(path) || *path == '[' || strstr(path, SWITCH_URL_SEPARATOR)) {
+		return NULL;
+	}
 
+	key = switch_mprintf("%u:%s", rate, path);
 
-		if (switch_event_create(&event, SWITCH_EVENT_PRESENCE_IN) == SWITCH_STATUS_SUCCESS) {
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "proto", CONF_CHAT_PROTO);
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "login", conference->name);
-			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "from", "%s@%s", conference->name, conference->domain);
-			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "status", "Active (%d caller%s)", conference->count, conference->count == 1 ? "" : "s");
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "event_type", "presence");
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "alt_event_type", "dialog");
-			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "event_count", "%d", EC++);
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "unique-id", conference->name);
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "channel-state", "CS_ROUTING");
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "answer-state", conference->count == 1 ? "early" : "confirmed");
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "call-direction", conference->count == 1 ? "outbound" : "inbound");
-			switch_event_fire(&event);
+	switch_mutex_lock(globals.prompt_mutex);
+	if ((prompt = switch_core_hash_find(globals.prompt_hash, key))) {
+		if (prompt != globals.prompt_head) {
+			conference_prompt_detach(prompt);
+			conference_prompt_push_front(prompt);
 		}
+		switch_atomic_inc(&prompt->refs);
+		globals.prompt_hits++;
 
-		if ((conference->min && switch_test_flag(conference, CFLAG_ENFORCE_MIN) && conference->count < conference->min)
-			|| (switch_test_flag(conference, CFLAG_DYNAMIC) && conference->count == 0)) {
-			switch_set_flag(conference, CFLAG_DESTRUCT);
-		} else {
-			if (!exit_sound && conference->exit_sound && switch_test_flag(conference, CFLAG_EXIT_SOUND)) {
-				conference_play_file(conference, conference->exit_sound, 0, switch_core_session_get_channel(member->session), 0);
-			}
-			if (conference->count == 1 && conference->alone_sound && !switch_test_flag(conference, CFLAG_WAIT_MOD)) {
-				conference_stop_file(conference, FILE_STOP_ASYNC);
-				conference_play_file(conference, conference->alone_sound, 0, switch_core_session_get_channel(member->session), 1);
-			}
+		if (prompt->checked <= globals.prompt_stale || now - prompt->checked >= CONF_PROMPT_RECHECK_SEC) {
+			/* whoever gets here first looks at the file, everyone else keeps playing this copy meanwhile */
+			prompt->checked = now;
+			recheck = 1;
 		}
+	} else {
+		globals.prompt_misses++;
+	}
+	switch_mutex_unlock(globals.prompt_mutex);
 
-		if (conference->count == 1) {
-			conference->floor_holder = conference->members;
+	if (prompt && recheck && (stat(path, &st) || st.st_mtime != prompt->mtime)) {
+		switch_mutex_lock(globals.prompt_mutex);
+		if (switch_core_hash_find(globals.prompt_hash, key) == prompt) {
+			conference_prompt_unlink(prompt);
+			globals.prompt_reloads++;
 		}
+		globals.prompt_hits--;
+		globals.prompt_misses++;
+		switch_mutex_unlock(globals.prompt_mutex);
 
-		if (test_eflag(conference, EFLAG_DEL_MEMBER) &&
-			switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
-			conference_add_event_member_data(member, event);
-			conference_add_event_data(conference, event);
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "del-member");
-			switch_event_fire(&event);
+		conference_prompt_release(prompt);
+		prompt = NULL;
+
+		if (!load) {
+			free(key);
+			return NULL;
 		}
+	} else if (prompt || !load || stat(path, &st)) {
+		free(key);
+		return prompt;
 	}
-	switch_mutex_unlock(conference->member_mutex);
-	unlock_member(member);
-	switch_mutex_unlock(member->audio_out_mutex);
-	switch_mutex_unlock(member->audio_in_mutex);
-	switch_mutex_unlock(conference->mutex);
-	status = SWITCH_STATUS_SUCCESS;
 
-	return status;
+	if ((switch_size_t) st.st_size > globals.prompt_max_bytes / 4 || !(loaded = conference_prompt_load(path, rate, key, st.st_mtime))) {
+		free(key);
+		return NULL;
+	}
+
+	switch_mutex_lock(globals.prompt_mutex);
+	if ((prompt = switch_core_hash_find(globals.prompt_hash, key))) {
+		/* somebody else decoded it first */
+		switch_atomic_inc(&prompt->refs);
+		switch_mutex_unlock(globals.prompt_mutex);
+		conference_prompt_release(loaded);
+		free(key);
+		return prompt;
+	}
+
+	prompt = loaded;
+	prompt->cached = 1;
+	switch_core_hash_insert(globals.prompt_hash, prompt->key, prompt);
+	conference_prompt_push_front(prompt);
+	globals.prompt_bytes += prompt->samples * 2;
+	globals.prompt_count++;
+
+	while (globals.prompt_bytes > globals.prompt_max_bytes && globals.prompt_tail != prompt) {
+		conference_prompt_unlink(globals.prompt_tail);
+		globals.prompt_evictions++;
+	}
+
+	switch_atomic_inc(&prompt->refs);
+	switch_mutex_unlock(globals.prompt_mutex);
+	free(key);
+
+	return prompt;
 }
 
-struct vid_helper {
-	conference_member_t *member_a;
-	conference_member_t *member_b;
-	int up;
-};
+/* Empty the prompt cache, prompts still playing live on until their nodes finish */
+static void conference_prompt_flush(void)
+{
+	if (!globals.prompt_mutex) {
+		return;
+	}
 
-/* Thread bridging video between two members, there will be two threads if video briding is used */
-static void *SWITCH_THREAD_FUNC conference_video_bridge_thread_run(switch_thread_t *thread, void *obj)
+	switch_mutex_lock(globals.prompt_mutex);
+	while (globals.prompt_head) {
+		conference_prompt_unlink(globals.prompt_head);
+	}
+	switch_mutex_unlock(globals.prompt_mutex);
+}
+
+/* Point at the next frame of a cached prompt, zero once it is over.  The audio is shared, never write to it. */
+static switch_size_t conference_file_node_peek_prompt(conference_file_node_t *fnode, const int16_t **frame, switch_size_t len)
 {
-	struct vid_helper *vh = obj;
-	switch_channel_t *channel_a = switch_core_session_get_channel(vh->member_a->session);
-	switch_channel_t *channel_b = switch_core_session_get_channel(vh->member_b->session);
-	switch_status_t status;
-	switch_frame_t *read_frame;
-	
-	/* Acquire locks for both sessions so the helper object and member structures don't get destroyed before we exit */
-	if (switch_core_session_read_lock(vh->member_a->session) != SWITCH_STATUS_SUCCESS) {
-		return NULL;
+	conference_prompt_t *prompt = fnode->prompt;
+
+	if (fnode->prompt_pos >= prompt->samples) {
+		return 0;
 	}
-	
-	if (switch_core_session_read_lock(vh->member_b->session) != SWITCH_STATUS_SUCCESS) {
-		switch_core_session_rwunlock(vh->member_a->session);
-		return NULL;
+
+	if (len > prompt->samples - fnode->prompt_pos) {
+		len = prompt->samples - fnode->prompt_pos;
 	}
 
-	vh->up = 1;
-	while (switch_test_flag(vh->member_a, MFLAG_RUNNING) && switch_test_flag(vh->member_b, MFLAG_RUNNING) &&
-		   switch_channel_ready(channel_a) && switch_channel_ready(channel_b))  {
-			status = switch_core_session_read_video_frame(vh->member_a->session, &read_frame, SWITCH_IO_FLAG_NONE, 0);
-			if (!SWITCH_READ_ACCEPTABLE(status)) {
-				break;
-			}
+	*frame = prompt->data + fnode->prompt_pos;
+	fnode->prompt_pos += len;
 
-			if (!switch_test_flag(read_frame, SFF_CNG)) {
-				if (switch_core_session_write_video_frame(vh->member_b->session, read_frame, SWITCH_IO_FLAG_NONE, 0) != SWITCH_STATUS_SUCCESS) {
-					break;
-				}
-			}
+	return len;
+}
+
+/* Close whatever a non speech file node is playing from */
+static void conference_file_node_close(conference_file_node_t *fnode)
+{
+	if (fnode->prompt) {
+		conference_prompt_release(fnode->prompt);
+		fnode->prompt = NULL;
+	} else if (fnode->type != NODE_TYPE_SPEECH) {
+		switch_core_file_close(&fnode->fh);
 	}
-	
-	switch_core_session_rwunlock(vh->member_a->session);
-	switch_core_session_rwunlock(vh->member_b->session);
+}
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "%s video thread ended.\n", switch_channel_get_name(channel_a));
-	
-	vh->up = 0;
-	return NULL;
+/* Drop a reference to a conference file node, the last one closes it */
+static void conference_file_node_release(conference_file_node_t *fnode)
+{
+	switch_memory_pool_t *pool;
+
+	if (switch_atomic_dec(&fnode->refs)) {
+		return;
+	}
+
+	conference_file_node_close(fnode);
+
+	switch_buffer_destroy(&fnode->pcm);
+	pool = fnode->pool;
+	switch_core_destroy_memory_pool(&pool);
 }
 
+/* Give a new conference file node its first reference and, when the prefetch pool runs, a ring to decode into */
+static void conference_file_node_setup(conference_obj_t *conference, conference_file_node_t *fnode)
+{
+	switch_atomic_set(&fnode->refs, 1);
+	fnode->conference = conference;
+	fnode->frame_bytes = switch_samples_per_packet(conference->rate, conference->interval) * 2;
 
-/* Main video monitor thread (1 per distinct conference room) */
-static void *SWITCH_THREAD_FUNC conference_video_thread_run(switch_thread_t *thread, void *obj)
+	if (globals.prefetch_queue && !fnode->prompt && switch_buffer_create_spsc(&fnode->pcm, fnode->frame_bytes * CONF_PREFETCH_FRAMES) != SWITCH_STATUS_SUCCESS) {
+		fnode->pcm = NULL;
+	}
+}
+
+/* Ask the prefetch pool to top up a node once it is half drained */
+static void conference_file_node_prefetch(conference_file_node_t *fnode)
 {
-	conference_obj_t *conference = (conference_obj_t *) obj;
-	conference_member_t *imember;
-	switch_frame_t *vid_frame;
-	switch_status_t status;
-	int has_vid = 1;// req_iframe = 0;
-	int yield = 0;
-	uint32_t last_member = 0;
-	switch_core_session_t *session;
+	if (!fnode->pcm || !globals.running || fnode->done || switch_atomic_read(&fnode->eof) || switch_atomic_read(&fnode->queued) ||
+		switch_buffer_inuse(fnode->pcm) >= fnode->frame_bytes * (CONF_PREFETCH_FRAMES / 2)) {
+		return;
+	}
 
-	conference->video_running = 1;
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Video thread started for conference %s\n", conference->name);
+	switch_atomic_set(&fnode->queued, 1);
+	switch_atomic_inc(&fnode->refs);
+	switch_atomic_inc(&fnode->conference->prefetch_pending);
 
-	while (has_vid && conference->video_running == 1 && globals.running && !switch_test_flag(conference, CFLAG_DESTRUCT)) {
-		if (yield) {
-			switch_yield(yield);
-			yield = 0;
-		}
+	if (switch_queue_trypush(globals.prefetch_queue, fnode) != SWITCH_STATUS_SUCCESS) {
+		switch_atomic_dec(&fnode->conference->prefetch_pending);
+		switch_atomic_set(&fnode->queued, 0);
+		conference_file_node_release(fnode);
+	}
+}
 
-		switch_mutex_lock(conference->member_mutex);
+/* Prefetch reader side, decode until the ring is full or the node runs out */
+static void conference_file_node_fill(conference_file_node_t *fnode)
+{
+	int16_t frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
 
-		if (!conference->floor_holder) {
-			yield = 100000;
-			goto do_continue;
+	while (!fnode->done && !switch_atomic_read(&fnode->eof) && switch_buffer_freespace(fnode->pcm) >= fnode->frame_bytes) {
+		switch_size_t len = fnode->frame_bytes / 2;
+
+		if (fnode->type == NODE_TYPE_SPEECH) {
+			switch_speech_flag_t flags = SWITCH_SPEECH_FLAG_BLOCKING;
+			switch_size_t data_len = fnode->frame_bytes;
+
+			/* the speech handle is shared by the whole conference */
+			switch_mutex_lock(fnode->conference->tts_mutex);
+			if (!fnode->done && switch_core_speech_read_tts(fnode->sh, frame, &data_len, &flags) == SWITCH_STATUS_SUCCESS) {
+				len = data_len / 2;
+			} else {
+				len = 0;
+			}
+			switch_mutex_unlock(fnode->conference->tts_mutex);
+		} else {
+			switch_core_file_read(&fnode->fh, frame, &len);
 		}
 
-		if (!switch_channel_test_flag(switch_core_session_get_channel(conference->floor_holder->session), CF_VIDEO)) {
-			yield = 100000;
-			goto do_continue;
+		if (!len) {
+			switch_atomic_set(&fnode->eof, 1);
+			break;
 		}
 
-		session = conference->floor_holder->session;
-		switch_core_session_read_lock(session);
-		switch_mutex_unlock(conference->member_mutex);
-		status = switch_core_session_read_video_frame(session, &vid_frame, SWITCH_IO_FLAG_NONE, 0);
-		switch_mutex_lock(conference->member_mutex);
-		switch_core_session_rwunlock(session);
+		switch_buffer_write(fnode->pcm, frame, len * 2);
+	}
+}
 
-		if (!SWITCH_READ_ACCEPTABLE(status) || !conference->floor_holder || switch_test_flag(vid_frame, SFF_CNG)) {
-			conference->floor_holder = NULL;
-			//req_iframe = 0;
-			goto do_continue;
-		}
+/* Take the next frame of a conference file node.  SWITCH_STATUS_FALSE means the node is over and
+   SWITCH_STATUS_BREAK that the prefetch has fallen behind, in which case the frame goes out without it.
+   pcm is pointed at the audio, that is frame unless it is a cached prompt played in place. */
+static switch_status_t conference_file_node_read(conference_obj_t *conference, conference_file_node_t *fnode, int16_t *frame,
+												 const int16_t **pcm, switch_size_t *len)
+{
+	switch_size_t bytes = *len * 2;
+	switch_size_t got;
 
-		if (conference->floor_holder->id != last_member) {
-			int iframe = 0;
-#if 0
-			switch_core_session_message_t msg = { 0 };
+	*pcm = frame;
 
+	if (fnode->prompt) {
+		*len = conference_file_node_peek_prompt(fnode, pcm, *len);
+		return *len ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+	}
 
-			if (!req_iframe) {
-				/* Tell the channel to request a fresh vid frame */
-				msg.from = __FILE__;
-				msg.message_id = SWITCH_MESSAGE_INDICATE_VIDEO_REFRESH_REQ;
-				switch_core_session_receive_message(conference->floor_holder->session, &msg);
-				req_iframe = 1;
-			}
-#endif
+	if (!fnode->pcm) {
+		if (fnode->type == NODE_TYPE_SPEECH) {
+			switch_speech_flag_t flags = SWITCH_SPEECH_FLAG_BLOCKING;
 
-			if (vid_frame->codec->implementation->ianacode == 34) {	/* h.263 */
-				//iframe = (*((int16_t *) vid_frame->data) >> 12 == 6);
-				iframe = 1;
-			} else if (vid_frame->codec->implementation->ianacode == 115) {	/* h.263-1998 */
-				int y = *((int8_t *) vid_frame->data + 2) & 0xfe;
-				iframe = (y == 0x80 || y == 0x82);
-			} else if (vid_frame->codec->implementation->ianacode == 99) {	/* h.264 */
-				uint8_t * hdr = vid_frame->data;
-                uint8_t fragment_type = hdr[0] & 0x1f;
-                uint8_t nal_type = hdr[1] & 0x1f;
-                uint8_t start_bit = hdr[1] & 0x80;
-                iframe = (((fragment_type == 28 || fragment_type == 29) && nal_type == 5 && start_bit == 128) || fragment_type == 5);
-			} else {			/* we need more defs */
-				iframe = 1;
+			if (switch_core_speech_read_tts(fnode->sh, frame, &bytes, &flags) != SWITCH_STATUS_SUCCESS) {
+				bytes = 0;
 			}
+			*len = bytes / 2;
+		} else {
+			switch_core_file_read(&fnode->fh, frame, len);
+		}
 
-			if (!iframe) {
-				goto do_continue;
-			}
+		return *len ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+	}
 
-			//req_iframe = 0;
+	if (!(got = switch_buffer_read(fnode->pcm, frame, bytes)) && switch_atomic_read(&fnode->eof)) {
+		/* the reader may have queued its last frame right before flagging the end */
+		got = switch_buffer_read(fnode->pcm, frame, bytes);
+	}
+
+	*len = got / 2;
+
+	if (got) {
+		conference_file_node_prefetch(fnode);
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (switch_atomic_read(&fnode->eof)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	conference->prefetch_starved++;
+	conference_file_node_prefetch(fnode);
+
+	return SWITCH_STATUS_BREAK;
+}
+
+/* Fold a window of talk activity into one talk-summary event instead of per member start/stop/floor events.
+   Idle rooms stay quiet: one summary closes out a busy window and nothing more is sent until someone talks again. */
+static void conference_talk_summary(conference_obj_t *conference, conference_mix_table_t *table)
+{
+	uint32_t top_idx[CONF_TALK_SUMMARY_MAX_TOP];
+	uint32_t i, n, top = 0, talkers = 0, starts, stops, floors;
+	switch_time_t now = switch_micro_time_now();
+	switch_event_t *event;
+	char buf[CONF_TALK_SUMMARY_MAX_TOP * 24] = "";
+	switch_size_t len = 0;
+
+	if (now < conference->talk_summary_next) {
+		return;
+	}
+
+	conference->talk_summary_next = now + (switch_time_t) conference->talk_summary_interval * 1000;
+
+	/* take the window's counts without losing increments that land in between */
+	if ((starts = switch_atomic_read(&conference->talk_starts))) {
+		switch_atomic_add(&conference->talk_starts, (uint32_t) -starts);
+	}
+	if ((stops = switch_atomic_read(&conference->talk_stops))) {
+		switch_atomic_add(&conference->talk_stops, (uint32_t) -stops);
+	}
+	if ((floors = switch_atomic_read(&conference->floor_changes))) {
+		switch_atomic_add(&conference->floor_changes, (uint32_t) -floors);
+	}
+
+	/* keep the K loudest talkers, insertion into a small sorted array */
+	for (i = 0; i < table->count; i++) {
+		if ((table->flags[i] & (MFLAG_TALKING | MFLAG_CAN_SPEAK)) != (MFLAG_TALKING | MFLAG_CAN_SPEAK)) {
+			continue;
 		}
 
-		last_member = conference->floor_holder->id;
+		talkers++;
 
-		switch_mutex_unlock(conference->member_mutex);
-		switch_mutex_lock(conference->member_mutex);
-		has_vid = 0;
-		for (imember = conference->members; imember; imember = imember->next) {
-			if (imember->session && switch_channel_test_flag(switch_core_session_get_channel(imember->session), CF_VIDEO)) {
-				has_vid++;
-				switch_core_session_write_video_frame(imember->session, vid_frame, SWITCH_IO_FLAG_NONE, 0);
+		for (n = top; n > 0 && table->score[top_idx[n - 1]] < table->score[i]; n--) {
+			if (n < conference->talk_summary_top) {
+				top_idx[n] = top_idx[n - 1];
 			}
 		}
 
-	  do_continue:
+		if (n < conference->talk_summary_top) {
+			top_idx[n] = i;
+			if (top < conference->talk_summary_top) {
+				top++;
+			}
+		}
+	}
 
-		switch_mutex_unlock(conference->member_mutex);
+	if (!talkers && !starts && !stops && !floors) {
+		if (!conference->talk_summary_active) {
+			return;
+		}
+		conference->talk_summary_active = 0;
+	} else {
+		conference->talk_summary_active = 1;
 	}
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Video thread ending for conference %s\n", conference->name);
-	conference->video_running = 0;
+	if (!test_eflag(conference, EFLAG_TALK_SUMMARY) ||
+		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) != SWITCH_STATUS_SUCCESS) {
+		return;
+	}
 
-	return NULL;
+	conference_add_event_data(conference, event);
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "talk-summary");
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Summary-Interval", "%u", conference->talk_summary_interval);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Talking-Count", "%u", talkers);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Talk-Starts", "%u", starts);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Talk-Stops", "%u", stops);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Floor-Changes", "%u", floors);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Floor-Holder-ID", "%u", conference->floor_holder ? conference->floor_holder->id : 0);
+
+	for (n = 0; n < top; n++) {
+		switch_snprintf(buf + len, sizeof(buf) - len, "%s%u:%u", n ? "," : "", table->member[top_idx[n]]->id, table->score[top_idx[n]]);
+		len += strlen(buf + len);
+	}
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Top-Speakers", buf);
+
+	switch_event_fire(&event);
 }
 
-/* Main monitor thread (1 per distinct conference room) */
-static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, void *obj)
+/* Mix one frame for every member of the conference */
+static void conference_mix_tick(conference_obj_t *conference, conference_mix_state_t *state)
 {
-	conference_obj_t *conference = (conference_obj_t *) obj;
-	conference_member_t *imember, *omember;
-	uint32_t samples = switch_samples_per_packet(conference->rate, conference->interval);
-	uint32_t bytes = samples * 2;
+	conference_member_t *imember;
+	uint32_t samples = state->samples;
+	uint32_t bytes = state->bytes;
 	uint8_t ready = 0, total = 0;
-	switch_timer_t timer = { 0 };
 	switch_event_t *event;
-	uint8_t *file_frame;
-	uint8_t *async_file_frame;
-	int16_t *bptr;
 	uint32_t x = 0;
 	int32_t z = 0;
 	int member_score_sum = 0;
-	int divisor = 0;
-	
-	if (!(divisor = conference->rate / 8000)) {
-		divisor = 1;
-	}
+	int divisor = state->divisor;
+	uint32_t i;
+	switch_size_t file_sample_len = samples;
+	const int16_t *file_pcm = NULL;
+	switch_status_t fstatus;
+	int has_file_data = 0, members_with_video = 0;
+	uint32_t conf_energy = 0;
+	int nomoh = 0, recorders = 0;
+	conference_member_t *video_bridge_members[2] = { 0 };
 
-	file_frame = switch_core_alloc(conference->pool, SWITCH_RECOMMENDED_BUFFER_SIZE);
-	async_file_frame = switch_core_alloc(conference->pool, SWITCH_RECOMMENDED_BUFFER_SIZE);
+	switch_mutex_lock(conference->mutex);
+	has_file_data = ready = total = 0;
 
-	if (switch_core_timer_init(&timer, conference->timer_name, conference->interval, samples, conference->pool) == SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Setup timer success interval: %u  samples: %u\n", conference->interval, samples);
-	} else {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Timer Setup Failed.  Conference Cannot Start\n");
-		return NULL;
-	}
+	conference_mix_table_sync(conference, &state->table);
 
-	switch_mutex_lock(globals.hash_mutex);
-	globals.threads++;
-	switch_mutex_unlock(globals.hash_mutex);
+	/* Read one frame of audio from each member channel and save it for redistribution */
+	for (i = 0; i < state->table.count; i++) {
+		uint32_t buf_read = 0;
+		imember = state->table.member[i];
+		total++;
+		imember->read = 0;
 
-	conference->is_recording = 0;
-	conference->record_count = 0;
+		if (imember->session) {
+			if (switch_channel_test_flag(switch_core_session_get_channel(imember->session), CF_VIDEO)) {
+				members_with_video++;
+			}
 
-	while (globals.running && !switch_test_flag(conference, CFLAG_DESTRUCT)) {
-		switch_size_t file_sample_len = samples;
-		switch_size_t file_data_len = samples * 2;
-		int has_file_data = 0, members_with_video = 0;
-		uint32_t conf_energy = 0;
-		int nomoh = 0;
-		conference_member_t *video_bridge_members[2] = { 0 };
+			if (switch_test_flag(imember, MFLAG_NOMOH)) {
+				nomoh++;
+			}
+			
+			if (switch_test_flag(imember, MFLAG_VIDEO_BRIDGE)) {
+				if (!video_bridge_members[0]) {
+					video_bridge_members[0] = imember;
+				} else {
+					video_bridge_members[1] = imember;
+				}
+			}
+		}
 
-		/* Sync the conference to a single timing source */
-		if (switch_core_timer_next(&timer) != SWITCH_STATUS_SUCCESS) {
-			switch_set_flag(conference, CFLAG_DESTRUCT);
-			break;
+		if (imember->rec_sink) {
+			recorders++;
 		}
 
-		switch_mutex_lock(conference->mutex);
-		has_file_data = ready = total = 0;
+		switch_clear_flag_locked(imember, MFLAG_HAS_AUDIO);
 
+		/* the mixer is the only reader of the input ring so no lock is needed against the input thread */
+		if (switch_buffer_inuse(imember->audio_buffer) >= bytes
+			&& (buf_read = (uint32_t) switch_buffer_read(imember->audio_buffer, imember->frame, bytes))) {
+			imember->read = buf_read;
+			switch_set_flag_locked(imember, MFLAG_HAS_AUDIO);
+			ready++;
+		}
 
-		/* Read one frame of audio from each member channel and save it for redistribution */
-		for (imember = conference->members; imember; imember = imember->next) {
-			uint32_t buf_read = 0;
-			total++;
-			imember->read = 0;
+		state->table.flags[i] = imember->flags;
+		state->table.read[i] = imember->read;
+		state->table.score[i] = imember->score;
+	}
 
-			if (imember->session) {
-				if (switch_channel_test_flag(switch_core_session_get_channel(imember->session), CF_VIDEO)) {
-					members_with_video++;
-				}
+	if (conference->track_rec) {
+		conference_track_rec_feed(conference->track_rec, &state->table);
+	}
+
+	if (conference->max_active_speakers) {
+		conference_mix_table_select_speakers(conference, &state->table);
+	}
+
+	if (conference->perpetual_sound && !conference->async_fnode) {
+		conference_play_file(conference, conference->perpetual_sound, CONF_DEFAULT_LEADIN, NULL, 1);
+	} else if (conference->moh_sound && ((nomoh == 0 && conference->count == 1) 
+										 || switch_test_flag(conference, CFLAG_WAIT_MOD)) && !conference->async_fnode) {
+		conference_play_file(conference, conference->moh_sound, CONF_DEFAULT_LEADIN, NULL, 1);
+	}
 
-				if (switch_test_flag(imember, MFLAG_NOMOH)) {
-					nomoh++;
-				}
-				
-				if (switch_test_flag(imember, MFLAG_VIDEO_BRIDGE)) {
-					if (!video_bridge_members[0]) {
-						video_bridge_members[0] = imember;
-					} else {
-						video_bridge_members[1] = imember;
-					}
-				}
-			}
 
-			switch_clear_flag_locked(imember, MFLAG_HAS_AUDIO);
-			switch_mutex_lock(imember->audio_in_mutex);
+	/* Find if no one talked for more than x number of second */
+	if (conference->terminate_on_silence && conference->count > 1) {
+		int is_talking = 0;
 
-			if (switch_buffer_inuse(imember->audio_buffer) >= bytes
-				&& (buf_read = (uint32_t) switch_buffer_read(imember->audio_buffer, imember->frame, bytes))) {
-				imember->read = buf_read;
-				switch_set_flag_locked(imember, MFLAG_HAS_AUDIO);
-				ready++;
+		for (i = 0; i < state->table.count; i++) {
+			imember = state->table.member[i];
+			if (switch_epoch_time_now(NULL) - imember->join_time <= conference->terminate_on_silence) {
+				is_talking++;
+			} else if (imember->last_talking != 0 && switch_epoch_time_now(NULL) - imember->last_talking <= conference->terminate_on_silence) {
+				is_talking++;
 			}
-			switch_mutex_unlock(imember->audio_in_mutex);
 		}
-
-		if (conference->perpetual_sound && !conference->async_fnode) {
-			conference_play_file(conference, conference->perpetual_sound, CONF_DEFAULT_LEADIN, NULL, 1);
-		} else if (conference->moh_sound && ((nomoh == 0 && conference->count == 1) 
-											 || switch_test_flag(conference, CFLAG_WAIT_MOD)) && !conference->async_fnode) {
-			conference_play_file(conference, conference->moh_sound, CONF_DEFAULT_LEADIN, NULL, 1);
+		if (is_talking == 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Conference has been idle for over %d seconds, terminating\n", conference->terminate_on_silence);
+			switch_set_flag(conference, CFLAG_DESTRUCT);
 		}
+	}
 
+	if (conference->talk_summary_interval) {
+		conference_talk_summary(conference, &state->table);
+	}
 
-		/* Find if no one talked for more than x number of second */
-		if (conference->terminate_on_silence && conference->count > 1) {
-			int is_talking = 0;
-
-			for (imember = conference->members; imember; imember = imember->next) {
-				if (switch_epoch_time_now(NULL) - imember->join_time <= conference->terminate_on_silence) {
-					is_talking++;
-				} else if (imember->last_talking != 0 && switch_epoch_time_now(NULL) - imember->last_talking <= conference->terminate_on_silence) {
-					is_talking++;
-				}
-			}
-			if (is_talking == 0) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Conference has been idle for over %d seconds, terminating\n", conference->terminate_on_silence);
-				switch_set_flag(conference, CFLAG_DESTRUCT);
+	/* Start recording if there's more than one participant. */
+	if (conference->auto_record && !conference->is_recording && conference->count > 1) {
+		conference->is_recording = 1;
+		conference->record_count++;
+		imember = conference->members;
+		if (imember) {
+			switch_channel_t *channel = switch_core_session_get_channel(imember->session);
+			char *rfile = switch_channel_expand_variables(channel, conference->auto_record);
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Auto recording file: %s\n", rfile);
+			conference_record_start(conference, rfile);
+			if (rfile != conference->auto_record) {
+				switch_safe_free(rfile);
 			}
+		} else {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Auto Record Failed.  No members in conference.\n");
 		}
+	}
 
-		/* Start recording if there's more than one participant. */
-		if (conference->auto_record && !conference->is_recording && conference->count > 1) {
-			conference->is_recording = 1;
-			conference->record_count++;
-			imember = conference->members;
-			if (imember) {
-				switch_channel_t *channel = switch_core_session_get_channel(imember->session);
-				char *rfile = switch_channel_expand_variables(channel, conference->auto_record);
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Auto recording file: %s\n", rfile);
-				launch_conference_record_thread(conference, rfile);
-				if (rfile != conference->auto_record) {
-					switch_safe_free(rfile);
-				}
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Auto Record Failed.  No members in conference.\n");
-			}
+
+	if (members_with_video && conference->video_running != 1) {
+		if (!switch_test_flag(conference, CFLAG_VIDEO_BRIDGE)) {
+			launch_conference_video_thread(conference);	
+		} else if (video_bridge_members[0] && video_bridge_members[1]){
+			launch_conference_video_bridge_thread(video_bridge_members[0], video_bridge_members[1]);
 		}
+	}
 
+	/* If a file or speech event is being played */
+	if (conference->fnode) {
+		/* Lead in time */
+		if (conference->fnode->leadin) {
+			conference->fnode->leadin--;
+			conference_file_node_prefetch(conference->fnode);
+		} else if (!conference->fnode->done) {
+			file_sample_len = samples;
+			fstatus = conference_file_node_read(conference, conference->fnode, (int16_t *) state->file_frame, &file_pcm, &file_sample_len);
+
+			if (fstatus == SWITCH_STATUS_FALSE) {
+				if (test_eflag(conference, EFLAG_PLAY_FILE) &&
+					switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
+					conference_add_event_data(conference, event);
+					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "play-file-done");
+					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "File", conference->fnode->file);
+					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Async", "true");
+					switch_event_fire(&event);
+				}
 
-		if (members_with_video && conference->video_running != 1) {
-			if (!switch_test_flag(conference, CFLAG_VIDEO_BRIDGE)) {
-				launch_conference_video_thread(conference);	
-			} else if (video_bridge_members[0] && video_bridge_members[1]){
-				launch_conference_video_bridge_thread(video_bridge_members[0], video_bridge_members[1]);
+				conference->fnode->done++;
+			} else if (fstatus == SWITCH_STATUS_SUCCESS) {
+				has_file_data = 1;
 			}
 		}
+	}
 
-		/* If a file or speech event is being played */
-		if (conference->fnode) {
-			/* Lead in time */
-			if (conference->fnode->leadin) {
-				conference->fnode->leadin--;
-			} else if (!conference->fnode->done) {
-				file_sample_len = samples;
-				if (conference->fnode->type == NODE_TYPE_SPEECH) {
-					switch_speech_flag_t flags = SWITCH_SPEECH_FLAG_BLOCKING;
-
-					if (switch_core_speech_read_tts(conference->fnode->sh, file_frame, &file_data_len, &flags) == SWITCH_STATUS_SUCCESS) {
-						file_sample_len = file_data_len / 2;
-					} else {
-						file_sample_len = file_data_len = 0;
-					}
-				} else if (conference->fnode->type == NODE_TYPE_FILE) {
-					switch_core_file_read(&conference->fnode->fh, file_frame, &file_sample_len);
+	if (conference->async_fnode) {
+		/* Lead in time */
+		if (conference->async_fnode->leadin) {
+			conference->async_fnode->leadin--;
+			conference_file_node_prefetch(conference->async_fnode);
+		} else if (!conference->async_fnode->done) {
+			switch_size_t async_sample_len = samples;
+			const int16_t *async_pcm;
+
+			fstatus = conference_file_node_read(conference, conference->async_fnode, (int16_t *) state->async_file_frame, &async_pcm, &async_sample_len);
+
+			if (fstatus == SWITCH_STATUS_FALSE) {
+				if (test_eflag(conference, EFLAG_PLAY_FILE) &&
+					switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
+					conference_add_event_data(conference, event);
+					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "play-file-done");
+					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "File", conference->async_fnode->file);
+					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Async", "true");
+					switch_event_fire(&event);
 				}
+				conference->async_fnode->done++;
+			} else if (fstatus == SWITCH_STATUS_SUCCESS) {
+				if (has_file_data) {
+					int16_t *muxed = (int16_t *) state->file_frame;
+					switch_size_t x, both = file_sample_len;
+
+					/* either side may be a shared prompt, so sum into file_frame and stay within each one's length */
+					if (async_sample_len < both) {
+						both = async_sample_len;
+					}
 
-				if (file_sample_len <= 0) {
-					if (test_eflag(conference, EFLAG_PLAY_FILE) &&
-						switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
-						conference_add_event_data(conference, event);
-						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "play-file-done");
-						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "File", conference->fnode->file);
-						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Async", "true");
-						switch_event_fire(&event);
+					for (x = 0; x < both; x++) {
+						int32_t z = file_pcm[x] + async_pcm[x];
+
+						switch_normalize_to_16bit(z);
+						muxed[x] = (int16_t) z;
+					}
+
+					if (file_sample_len > both) {
+						memmove(muxed + both, file_pcm + both, (file_sample_len - both) * 2);
+					} else if (async_sample_len > both) {
+						memcpy(muxed + both, async_pcm + both, (async_sample_len - both) * 2);
+						file_sample_len = async_sample_len;
 					}
 
-					conference->fnode->done++;
+					file_pcm = muxed;
 				} else {
+					file_sample_len = async_sample_len;
+					file_pcm = async_pcm;
 					has_file_data = 1;
 				}
 			}
 		}
+	}
 
-		if (conference->async_fnode) {
-			/* Lead in time */
-			if (conference->async_fnode->leadin) {
-				conference->async_fnode->leadin--;
-			} else if (!conference->async_fnode->done) {
-				file_sample_len = samples;
-				switch_core_file_read(&conference->async_fnode->fh, async_file_frame, &file_sample_len);
-
-				if (file_sample_len <= 0) {
-					if (test_eflag(conference, EFLAG_PLAY_FILE) &&
-						switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
-						conference_add_event_data(conference, event);
-						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "play-file-done");
-						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "File", conference->async_fnode->file);
-						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Async", "true");
-						switch_event_fire(&event);
-					}
-					conference->async_fnode->done++;
-				} else {
-					if (has_file_data) {
-						switch_size_t x;
-
-						for (x = 0; x < file_sample_len; x++) {
-							int32_t z;
-							int16_t *muxed;
-
-							muxed = (int16_t *) file_frame;
-							bptr = (int16_t *) async_file_frame;
-							z = muxed[x] + bptr[x];
-							switch_normalize_to_16bit(z);
-							muxed[x] = (int16_t) z;
-						}
-					} else {
-						memcpy(file_frame, async_file_frame, file_sample_len * 2);
-						has_file_data = 1;
-					}
-				}
-			}
+	if (switch_test_flag(conference, CFLAG_WASTE_BANDWIDTH) && !has_file_data) {
+		file_sample_len = bytes / 2;
+
+		if (conference->comfort_noise_level) {
+			switch_generate_sln_silence((int16_t *) state->file_frame, file_sample_len, conference->comfort_noise_level);
+		} else {
+			memset(state->file_frame, 255, bytes);
 		}
+		file_pcm = (int16_t *) state->file_frame;
+		has_file_data = 1;
+	}
+	
+	if (ready || has_file_data) {
+		/* Use more bits in the main_frame to preserve the exact sum of the audio samples. */
+		int32_t main_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2] = { 0 };
+		conference_mix_frame_t *shared_frame = NULL;
 
-		if (switch_test_flag(conference, CFLAG_WASTE_BANDWIDTH) && !has_file_data) {
-			file_sample_len = bytes / 2;
 
-			if (conference->comfort_noise_level) {
-				switch_generate_sln_silence((int16_t *) file_frame, file_sample_len, conference->comfort_noise_level);
-			} else {
-				memset(file_frame, 255, bytes);
-			}
-			has_file_data = 1;
-		}
-		
-		if (ready || has_file_data) {
-			/* Use more bits in the main_frame to preserve the exact sum of the audio samples. */
-			int main_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2] = { 0 };
-			int16_t write_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2] = { 0 };
-
-
-			/* Init the main frame with file data if there is any. */
-			bptr = (int16_t *) file_frame;
-			if (has_file_data && file_sample_len) {
-				for (x = 0; x < bytes / 2; x++) {
-					if (x <= file_sample_len) {
-						main_frame[x] = (int32_t) bptr[x];
-					} else {
-						main_frame[x] = 255;
-					}
+		/* Init the main frame with file data if there is any. */
+		if (has_file_data && file_sample_len) {
+			for (x = 0; x < bytes / 2; x++) {
+				if (x < file_sample_len) {
+					main_frame[x] = (int32_t) file_pcm[x];
+				} else {
+					main_frame[x] = 255;
 				}
 			}
+		}
 
-			member_score_sum = 0;
-			conference->mux_loop_count = 0;
-			conference->member_loop_count = 0;
+		member_score_sum = 0;
+		conference->mux_loop_count = 0;
+		conference->member_loop_count = 0;
 
 
-			/* Copy audio from every member known to be producing audio into the main frame. */
-			for (omember = conference->members; omember; omember = omember->next) {
-				conference->member_loop_count++;
-				
-				if (!(switch_test_flag(omember, MFLAG_RUNNING) && switch_test_flag(omember, MFLAG_HAS_AUDIO))) {
-					continue;
-				}
+		/* Copy audio from every member known to be producing audio into the main frame. */
+		for (i = 0; i < state->table.count; i++) {
+			conference->member_loop_count++;
+			
+			if ((state->table.flags[i] & (MFLAG_RUNNING | MFLAG_HAS_AUDIO)) != (MFLAG_RUNNING | MFLAG_HAS_AUDIO)) {
+				continue;
+			}
 
-				if (conference->agc_level) {
-					if (switch_test_flag(omember, MFLAG_TALKING) && switch_test_flag(omember, MFLAG_CAN_SPEAK)) {
-						member_score_sum += omember->score;
-						conference->mux_loop_count++;
-					}
-				}
-				
-				bptr = (int16_t *) omember->frame;
-				for (x = 0; x < omember->read / 2; x++) {
-					main_frame[x] += (int32_t) bptr[x];
+			if (conference->agc_level) {
+				if ((state->table.flags[i] & (MFLAG_TALKING | MFLAG_CAN_SPEAK)) == (MFLAG_TALKING | MFLAG_CAN_SPEAK)) {
+					member_score_sum += state->table.score[i];
+					conference->mux_loop_count++;
 				}
 			}
-
-			if (conference->agc_level && conference->member_loop_count) {
-				conf_energy = 0;
 			
-				for (x = 0; x < bytes / 2; x++) {
-					z = abs(main_frame[x]);
-					switch_normalize_to_16bit(z);
-					conf_energy += (int16_t) z;
-				}
-				
-				conference->score = conf_energy / ((bytes / 2) / divisor) / conference->member_loop_count;
+			switch_mix_sln_accumulate(main_frame, state->table.frame[i], state->table.read[i] / 2);
+		}
 
-				conference->avg_tally += conference->score;
-				conference->avg_score = conference->avg_tally / ++conference->avg_itt;
-				if (!conference->avg_itt) conference->avg_tally = conference->score;
+		if (conference->agc_level && conference->member_loop_count) {
+			conf_energy = 0;
+		
+			for (x = 0; x < bytes / 2; x++) {
+				z = abs(main_frame[x]);
+				switch_normalize_to_16bit(z);
+				conf_energy += (int16_t) z;
 			}
 			
-			/* Create write frame once per member who is not deaf for each sample in the main frame
-			   check if our audio is involved and if so, subtract it from the sample so we don't hear ourselves.
-			   Since main frame was 32 bit int, we did not lose any detail, now that we have to convert to 16 bit we can
-			   cut it off at the min and max range if need be and write the frame to the output buffer.
-			 */
-			for (omember = conference->members; omember; omember = omember->next) {
-				switch_size_t ok = 1;
-
-				if (!switch_test_flag(omember, MFLAG_RUNNING)) {
-					continue;
-				}
-
-				if (!switch_test_flag(omember, MFLAG_CAN_HEAR) && !switch_test_flag(omember, MFLAG_WASTE_BANDWIDTH)
-					&& !switch_test_flag(conference, CFLAG_WASTE_BANDWIDTH)) {
-					continue;
-				}
-
-				bptr = (int16_t *) omember->frame;
-				for (x = 0; x < bytes / 2; x++) {
-					z = main_frame[x];
-					/* bptr[x] represents my own contribution to this audio sample */
-					if (switch_test_flag(omember, MFLAG_HAS_AUDIO) && x <= omember->read / 2) {
-						z -= (int32_t) bptr[x];
-					}
-
-					/* when there are relationships, we have to do more work by scouring all the members to see if there are any 
-					   reasons why we should not be hearing a paticular member, and if not, delete their samples as well.
-					 */
-					if (conference->relationship_total) {
-						for (imember = conference->members; imember; imember = imember->next) {
-							if (imember != omember && switch_test_flag(imember, MFLAG_HAS_AUDIO)) {
-								conference_relationship_t *rel;
-								switch_size_t found = 0;
-								int16_t *rptr = (int16_t *) imember->frame;
-								for (rel = imember->relationships; rel; rel = rel->next) {
-									if ((rel->id == omember->id || rel->id == 0) && !switch_test_flag(rel, RFLAG_CAN_SPEAK)) {
-										z -= (int32_t) rptr[x];
-										found = 1;
-										break;
-									}
-								}
-								if (!found) {
-									for (rel = omember->relationships; rel; rel = rel->next) {
-										if ((rel->id == imember->id || rel->id == 0) && !switch_test_flag(rel, RFLAG_CAN_HEAR)) {
-											z -= (int32_t) rptr[x];
-											break;
-										}
-									}
-								}
+			conference->score = conf_energy / ((bytes / 2) / divisor) / conference->member_loop_count;
 
-							}
-						}
-					}
+			conference->avg_tally += conference->score;
+			conference->avg_score = conference->avg_tally / ++conference->avg_itt;
+			if (!conference->avg_itt) conference->avg_tally = conference->score;
+		}
+		
+		conference_mix_all_listeners(conference, state, main_frame, &shared_frame);
 
-					/* Now we can convert to 16 bit. */
-					switch_normalize_to_16bit(z);
-					write_frame[x] = (int16_t) z;
-				}
-				
-				switch_mutex_lock(omember->audio_out_mutex);
-				ok = switch_buffer_write(omember->mux_buffer, write_frame, bytes);
-				switch_mutex_unlock(omember->audio_out_mutex);
+		if (shared_frame) {
+			conference_mix_frame_release(conference, shared_frame);
+		}
+	} else if (recorders) {
+		/* Nothing was mixed, keep the recordings in step with the wall clock */
+		memset(state->file_frame, 255, bytes);
 
-				if (!ok) {
-					switch_mutex_unlock(conference->mutex);
-					goto end;
-				}
+		for (i = 0; i < state->table.count; i++) {
+			imember = state->table.member[i];
+			if (imember->rec_sink && switch_test_flag(imember, MFLAG_RUNNING)) {
+				conference_rec_sink_write(imember->rec_sink, (int16_t *) state->file_frame, bytes);
 			}
 		}
+	}
 
-		if (conference->async_fnode && conference->async_fnode->done) {
-			switch_memory_pool_t *pool;
-			switch_core_file_close(&conference->async_fnode->fh);
-			pool = conference->async_fnode->pool;
-			conference->async_fnode = NULL;
-			switch_core_destroy_memory_pool(&pool);
-		}
+	if (conference->async_fnode && conference->async_fnode->done) {
+		conference_file_node_t *fnode = conference->async_fnode;
 
-		if (conference->fnode && conference->fnode->done) {
-			conference_file_node_t *fnode;
-			switch_memory_pool_t *pool;
+		conference->async_fnode = NULL;
+		conference_file_node_release(fnode);
+	}
 
-			if (conference->fnode->type != NODE_TYPE_SPEECH) {
-				switch_core_file_close(&conference->fnode->fh);
-			}
+	if (conference->fnode && conference->fnode->done) {
+		conference_file_node_t *fnode = conference->fnode;
 
-			fnode = conference->fnode;
-			conference->fnode = conference->fnode->next;
+		conference->fnode = conference->fnode->next;
+		conference_file_node_release(fnode);
+	}
 
-			pool = fnode->pool;
-			fnode = NULL;
-			switch_core_destroy_memory_pool(&pool);
-		}
+	switch_mutex_unlock(conference->mutex);
 
-		switch_mutex_unlock(conference->mutex);
+	/* Recordings end with the last caller */
+	if (recorders && !conference->count) {
+		conference_record_stop(conference, NULL);
 	}
-	/* Rinse ... Repeat */
-  end:
+}
+
+/* Tear the conference down once the mixer is done with it */
+static void conference_thread_finish(conference_obj_t *conference, conference_mix_state_t *state)
+{
+	conference_member_t *imember;
+	switch_event_t *event;
+	uint32_t x;
+
+	if (state->crew) {
+		conference_mix_crew_destroy(state->crew);
+		state->crew = NULL;
+	}
+
+	conference_mix_table_destroy(&state->table);
+
+	conference_tracks_stop(conference);
+	conference_record_stop(conference, NULL);
 
 	if (switch_test_flag(conference, CFLAG_OUTCALL)) {
 		conference->cancel_cause = SWITCH_CAUSE_ORIGINATOR_CANCEL;
@@ -1544,29 +3655,21 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 	/* Close Unused Handles */
 	if (conference->fnode) {
 		conference_file_node_t *fnode, *cur;
-		switch_memory_pool_t *pool;
 
 		fnode = conference->fnode;
 		while (fnode) {
 			cur = fnode;
 			fnode = fnode->next;
-
-			if (cur->type != NODE_TYPE_SPEECH) {
-				switch_core_file_close(&cur->fh);
-			}
-
-			pool = cur->pool;
-			switch_core_destroy_memory_pool(&pool);
+			cur->done++;
+			conference_file_node_release(cur);
 		}
 		conference->fnode = NULL;
 	}
 
 	if (conference->async_fnode) {
-		switch_memory_pool_t *pool;
-		switch_core_file_close(&conference->async_fnode->fh);
-		pool = conference->async_fnode->pool;
+		conference->async_fnode->done++;
+		conference_file_node_release(conference->async_fnode);
 		conference->async_fnode = NULL;
-		switch_core_destroy_memory_pool(&pool);
 	}
 
 	switch_mutex_lock(conference->member_mutex);
@@ -1601,12 +3704,7 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 	}
 
 	
-	switch_core_timer_destroy(&timer);
-	switch_mutex_lock(globals.hash_mutex);
-	if (switch_test_flag(conference, CFLAG_INHASH)) {
-		switch_core_hash_delete(globals.conference_hash, conference->name);
-	}
-	switch_mutex_unlock(globals.hash_mutex);
+	conference_registry_del(conference);
 
 	/* Wait till everybody is out */
 	switch_clear_flag_locked(conference, CFLAG_RUNNING);
@@ -1615,20 +3713,65 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 	switch_thread_rwlock_unlock(conference->rwlock);
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Write Lock OFF\n");
 
+	/* prefetch readers may still be finishing with our nodes and speech handle */
+	while (switch_atomic_read(&conference->prefetch_pending)) {
+		switch_cond_next();
+	}
+
 	if (conference->sh) {
 		switch_speech_flag_t flags = SWITCH_SPEECH_FLAG_NONE;
 		switch_core_speech_close(&conference->lsh, &flags);
 		conference->sh = NULL;
 	}
 
+	for (x = 0; x < conference->encoder_count; x++) {
+		if (conference->encoders[x]->failed) {
+			continue;
+		}
+		switch_core_codec_destroy(&conference->encoders[x]->codec);
+	}
+	conference->encoder_count = 0;
+
 	if (conference->pool) {
 		switch_memory_pool_t *pool = conference->pool;
 		switch_core_destroy_memory_pool(&pool);
 	}
 
-	switch_mutex_lock(globals.hash_mutex);
-	globals.threads--;
-	switch_mutex_unlock(globals.hash_mutex);
+	switch_atomic_dec(&globals.threads);
+
+}
+
+/* Main monitor thread (1 per distinct conference room) */
+static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, void *obj)
+{
+	conference_obj_t *conference = (conference_obj_t *) obj;
+	conference_mix_state_t state;
+	switch_timer_t timer = { 0 };
+
+	conference_mix_state_init(conference, &state);
+
+	if (switch_core_timer_init(&timer, conference->timer_name, conference->interval, state.samples, conference->pool) == SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Setup timer success interval: %u  samples: %u\n", conference->interval, state.samples);
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Timer Setup Failed.  Conference Cannot Start\n");
+		return NULL;
+	}
+
+	switch_atomic_inc(&globals.threads);
+
+	while (globals.running && !switch_test_flag(conference, CFLAG_DESTRUCT)) {
+		/* Sync the conference to a single timing source */
+		if (switch_core_timer_next(&timer) != SWITCH_STATUS_SUCCESS) {
+			switch_set_flag(conference, CFLAG_DESTRUCT);
+			break;
+		}
+
+		conference_mix_tick(conference, &state);
+		/* Rinse ... Repeat */
+	}
+
+	switch_core_timer_destroy(&timer);
+	conference_thread_finish(conference, &state);
 
 	return NULL;
 }
@@ -1678,6 +3821,7 @@ static void conference_loop_fn_lock_toggle(conference_member_t *member, caller_c
 		}
 
 		switch_set_flag_locked(member->conference, CFLAG_LOCKED);
+		conference_state_delta(member->conference, CONF_DELTA_LOCK, NULL, 0);
 		if (test_eflag(member->conference, EFLAG_LOCK) &&
 			switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 			conference_add_event_data(member->conference, event);
@@ -1690,6 +3834,7 @@ static void conference_loop_fn_lock_toggle(conference_member_t *member, caller_c
 		}
 
 		switch_clear_flag_locked(member->conference, CFLAG_LOCKED);
+		conference_state_delta(member->conference, CONF_DELTA_UNLOCK, NULL, 0);
 		if (test_eflag(member->conference, EFLAG_UNLOCK) &&
 			switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 			conference_add_event_data(member->conference, event);
@@ -1733,6 +3878,8 @@ static void conference_loop_fn_energy_up(conference_member_t *member, caller_con
 		member->energy_level = 1800;
 	}
 
+	conference_state_delta(member->conference, CONF_DELTA_ENERGY_LEVEL, member, member->energy_level);
+
 	if (test_eflag(member->conference, EFLAG_ENERGY_LEVEL) &&
 		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 		conference_add_event_member_data(member, event);
@@ -1765,6 +3912,8 @@ static void conference_loop_fn_energy_equ_conf(conference_member_t *member, call
 
 	member->energy_level = member->conference->energy_level;
 
+	conference_state_delta(member->conference, CONF_DELTA_ENERGY_LEVEL, member, member->energy_level);
+
 	if (test_eflag(member->conference, EFLAG_ENERGY_LEVEL) &&
 		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 		conference_add_event_member_data(member, event);
@@ -1797,6 +3946,8 @@ static void conference_loop_fn_energy_dn(conference_member_t *member, caller_con
 		member->energy_level = 0;
 	}
 
+	conference_state_delta(member->conference, CONF_DELTA_ENERGY_LEVEL, member, member->energy_level);
+
 	if (test_eflag(member->conference, EFLAG_ENERGY_LEVEL) &&
 		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 		conference_add_event_member_data(member, event);
@@ -1827,6 +3978,8 @@ static void conference_loop_fn_volume_talk_up(conference_member_t *member, calle
 	member->volume_out_level++;
 	switch_normalize_volume(member->volume_out_level);
 
+	conference_state_delta(member->conference, CONF_DELTA_VOLUME_OUT, member, member->volume_out_level);
+
 	if (test_eflag(member->conference, EFLAG_VOLUME_LEVEL) &&
 		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 		conference_add_event_member_data(member, event);
@@ -1858,6 +4011,8 @@ static void conference_loop_fn_volume_talk_zero(conference_member_t *member, cal
 
 	member->volume_out_level = 0;
 
+	conference_state_delta(member->conference, CONF_DELTA_VOLUME_OUT, member, member->volume_out_level);
+
 	if (test_eflag(member->conference, EFLAG_VOLUME_LEVEL) &&
 		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 		conference_add_event_member_data(member, event);
@@ -1890,6 +4045,8 @@ static void conference_loop_fn_volume_talk_dn(conference_member_t *member, calle
 	member->volume_out_level--;
 	switch_normalize_volume(member->volume_out_level);
 
+	conference_state_delta(member->conference, CONF_DELTA_VOLUME_OUT, member, member->volume_out_level);
+
 	if (test_eflag(member->conference, EFLAG_VOLUME_LEVEL) &&
 		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 		conference_add_event_member_data(member, event);
@@ -1921,6 +4078,8 @@ static void conference_loop_fn_volume_listen_up(conference_member_t *member, cal
 	member->volume_in_level++;
 	switch_normalize_volume(member->volume_in_level);
 
+	conference_state_delta(member->conference, CONF_DELTA_VOLUME_IN, member, member->volume_in_level);
+
 	if (test_eflag(member->conference, EFLAG_GAIN_LEVEL) &&
 		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 		conference_add_event_member_data(member, event);
@@ -1952,6 +4111,8 @@ static void conference_loop_fn_volume_listen_zero(conference_member_t *member, c
 
 	member->volume_in_level = 0;
 
+	conference_state_delta(member->conference, CONF_DELTA_VOLUME_IN, member, member->volume_in_level);
+
 	if (test_eflag(member->conference, EFLAG_GAIN_LEVEL) &&
 		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 		conference_add_event_member_data(member, event);
@@ -1984,6 +4145,8 @@ static void conference_loop_fn_volume_listen_dn(conference_member_t *member, cal
 	member->volume_in_level--;
 	switch_normalize_volume(member->volume_in_level);
 
+	conference_state_delta(member->conference, CONF_DELTA_VOLUME_IN, member, member->volume_in_level);
+
 	if (test_eflag(member->conference, EFLAG_GAIN_LEVEL) &&
 		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 		conference_add_event_member_data(member, event);
@@ -2188,293 +4351,308 @@ static void check_agc_levels(conference_member_t *member)
 
 
 
-/* marshall frames from the call leg to the conference thread for muxing to other call legs */
-static void *SWITCH_THREAD_FUNC conference_loop_input(switch_thread_t *thread, void *obj)
+/* Run one frame read from the call leg through talk detection and into the input buffer, FALSE ends the input side */
+static switch_status_t conference_member_input_frame(conference_member_t *member, switch_status_t status, switch_frame_t *read_frame)
 {
-    switch_event_t *event;
-	conference_member_t *member = obj;
-	switch_channel_t *channel;
-	switch_status_t status;
-	switch_frame_t *read_frame = NULL;
-	uint32_t hangover = 40, hangunder = 5, hangover_hits = 0, hangunder_hits = 0, diff_level = 400;
-	switch_core_session_t *session = member->session;
-	int check_floor_change;
-
-	switch_assert(member != NULL);
-
-	switch_clear_flag_locked(member, MFLAG_TALKING);
-
-	channel = switch_core_session_get_channel(session);
-
-	switch_core_session_get_read_impl(session, &member->read_impl);
+	switch_event_t *event;
+	switch_channel_t *channel = switch_core_session_get_channel(member->session);
+	uint32_t hangover = 40, hangunder = 5, diff_level = 400;
+	int check_floor_change = 0;
 
-	/* As long as we have a valid read, feed that data into an input buffer where the conference thread will take it 
-	   and mux it with any audio from other channels. */
+	switch_mutex_lock(member->read_mutex);
 
-	while (switch_test_flag(member, MFLAG_RUNNING) && switch_channel_ready(channel)) {
-		check_floor_change = 0;
+	/* end the loop, if appropriate */
+	if (!SWITCH_READ_ACCEPTABLE(status) || !switch_test_flag(member, MFLAG_RUNNING)) {
+		switch_mutex_unlock(member->read_mutex);
+		return SWITCH_STATUS_FALSE;
+	}
 
-		if (switch_channel_ready(channel) && switch_channel_test_app_flag(channel, CF_APP_TAGGED)) {
-			switch_yield(100000);
-			continue;
+	if (switch_test_flag(read_frame, SFF_CNG)) {
+		if (member->conference->agc_level) {
+			member->nt_tally++;
 		}
 
-		/* Read a frame. */
-		status = switch_core_session_read_frame(session, &read_frame, SWITCH_IO_FLAG_NONE, 0);
+		if (member->hangunder_hits) {
+			member->hangunder_hits--;
+		}
+		if (switch_test_flag(member, MFLAG_TALKING)) {
+			if (++member->hangover_hits >= hangover) {
+				member->hangover_hits = member->hangunder_hits = 0;
+				switch_clear_flag_locked(member, MFLAG_TALKING);
+				conference_state_delta(member->conference, CONF_DELTA_STOP_TALKING, member, 0);
+				check_agc_levels(member);
+				clear_avg(member);
+
+				if (member->conference->talk_summary_interval) {
+					switch_atomic_inc(&member->conference->talk_stops);
+				} else if (test_eflag(member->conference, EFLAG_STOP_TALKING) &&
+					switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
+					conference_add_event_member_data(member, event);
+					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "stop-talking");
+					switch_event_fire(&event);
+				}
+			}
+		}
 
-		switch_mutex_lock(member->read_mutex);
+		goto do_continue;
+	}
 
-		/* end the loop, if appropriate */
-		if (!SWITCH_READ_ACCEPTABLE(status) || !switch_test_flag(member, MFLAG_RUNNING)) {
-			switch_mutex_unlock(member->read_mutex);
-			break;
-		}
+	if (member->nt_tally > (member->read_impl.actual_samples_per_second / member->read_impl.samples_per_packet) * 3) {
+		member->agc_volume_in_level = 0;
+		clear_avg(member);
+	}
 
-		if (switch_test_flag(read_frame, SFF_CNG)) {
-			if (member->conference->agc_level) {
-				member->nt_tally++;
-			}
+	/* Check for input volume adjustments */
+	if (!member->conference->agc_level) {
+		member->conference->agc_level = 0;
+		clear_avg(member);
+	}
+	
 
-			if (hangunder_hits) {
-				hangunder_hits--;
-			}
-			if (switch_test_flag(member, MFLAG_TALKING)) {
-				if (++hangover_hits >= hangover) {
-					hangover_hits = hangunder_hits = 0;
-					switch_clear_flag_locked(member, MFLAG_TALKING);
-					check_agc_levels(member);
-					clear_avg(member);
+	/* if the member can speak, compute the audio energy level and */
+	/* generate events when the level crosses the threshold        */
+	if ((switch_test_flag(member, MFLAG_CAN_SPEAK) || switch_test_flag(member, MFLAG_MUTE_DETECT))) {
+		uint32_t energy = 0, i = 0, samples = 0, j = 0;
+		int16_t *data;
+		int agc_period = (member->read_impl.actual_samples_per_second / member->read_impl.samples_per_packet) / 4;
+		
 
-					if (test_eflag(member->conference, EFLAG_STOP_TALKING) &&
-						switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
-						conference_add_event_member_data(member, event);
-						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "stop-talking");
-						switch_event_fire(&event);
-					}
-				}
-			}
+		data = read_frame->data;
+		member->score = 0;
 
-			goto do_continue;
+		if (member->volume_in_level) {
+			switch_change_sln_volume(read_frame->data, read_frame->datalen / 2, member->volume_in_level);
 		}
 
-		if (member->nt_tally > (member->read_impl.actual_samples_per_second / member->read_impl.samples_per_packet) * 3) {
-			member->agc_volume_in_level = 0;
-			clear_avg(member);
+		if (member->agc_volume_in_level) {
+			switch_change_sln_volume_granular(read_frame->data, read_frame->datalen / 2, member->agc_volume_in_level);
+		}
+		
+		if ((samples = read_frame->datalen / sizeof(*data))) {
+			for (i = 0; i < samples; i++) {
+				energy += abs(data[j]);
+				j += member->read_impl.number_of_channels;
+			}
+			
+			member->score = energy / samples;
 		}
 
-		/* Check for input volume adjustments */
-		if (!member->conference->agc_level) {
-			member->conference->agc_level = 0;
-			clear_avg(member);
+		if (member->vol_period) {
+			member->vol_period--;
 		}
 		
-
-		/* if the member can speak, compute the audio energy level and */
-		/* generate events when the level crosses the threshold        */
-		if ((switch_test_flag(member, MFLAG_CAN_SPEAK) || switch_test_flag(member, MFLAG_MUTE_DETECT))) {
-			uint32_t energy = 0, i = 0, samples = 0, j = 0;
-			int16_t *data;
-			int agc_period = (member->read_impl.actual_samples_per_second / member->read_impl.samples_per_packet) / 4;
+		if (member->conference->agc_level && member->score && 
+			switch_test_flag(member, MFLAG_CAN_SPEAK) &&
+			noise_gate_check(member)
+			) {
+			int last_shift = abs(member->last_score - member->score);
 			
+			if (member->score && member->last_score && last_shift > 900) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG7,
+								  "AGC %s:%d drop anomalous shift of %d\n", 
+								  member->conference->name,
+								  member->id, last_shift);
 
-			data = read_frame->data;
-			member->score = 0;
-
-			if (member->volume_in_level) {
-				switch_change_sln_volume(read_frame->data, read_frame->datalen / 2, member->volume_in_level);
+			} else {
+				member->avg_tally += member->score;
+				member->avg_itt++;
+				if (!member->avg_itt) member->avg_itt++;
+				member->avg_score = member->avg_tally / member->avg_itt;
 			}
 
-			if (member->agc_volume_in_level) {
-				switch_change_sln_volume_granular(read_frame->data, read_frame->datalen / 2, member->agc_volume_in_level);
-			}
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG7,
+							  "AGC %s:%d diff:%d level:%d cur:%d avg:%d vol:%d\n", 
+							  member->conference->name,
+							  member->id, member->conference->agc_level - member->avg_score, member->conference->agc_level, 
+							  member->score, member->avg_score, member->agc_volume_in_level);
 			
-			if ((samples = read_frame->datalen / sizeof(*data))) {
-				for (i = 0; i < samples; i++) {
-					energy += abs(data[j]);
-					j += member->read_impl.number_of_channels;
+			if (++member->agc_concur >= agc_period) {
+				if (!member->vol_period) {
+					check_agc_levels(member);
 				}
-				
-				member->score = energy / samples;
+				member->agc_concur = 0;
 			}
+		} else {
+			member->nt_tally++;
+		}
 
-			if (member->vol_period) {
-				member->vol_period--;
-			}
-			
-			if (member->conference->agc_level && member->score && 
-				switch_test_flag(member, MFLAG_CAN_SPEAK) &&
-				noise_gate_check(member)
-				) {
-				int last_shift = abs(member->last_score - member->score);
-				
-				if (member->score && member->last_score && last_shift > 900) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG7,
-									  "AGC %s:%d drop anomalous shift of %d\n", 
-									  member->conference->name,
-									  member->id, last_shift);
+		member->score_iir = (int) (((1.0 - SCORE_DECAY) * (float) member->score) + (SCORE_DECAY * (float) member->score_iir));
 
-				} else {
-					member->avg_tally += member->score;
-					member->avg_itt++;
-					if (!member->avg_itt) member->avg_itt++;
-					member->avg_score = member->avg_tally / member->avg_itt;
-				}
+		if (member->score_iir > SCORE_MAX_IIR) {
+			member->score_iir = SCORE_MAX_IIR;
+		}
 
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG7,
-								  "AGC %s:%d diff:%d level:%d cur:%d avg:%d vol:%d\n", 
-								  member->conference->name,
-								  member->id, member->conference->agc_level - member->avg_score, member->conference->agc_level, 
-								  member->score, member->avg_score, member->agc_volume_in_level);
-				
-				if (++member->agc_concur >= agc_period) {
-					if (!member->vol_period) {
-						check_agc_levels(member);
-					}
-					member->agc_concur = 0;
-				}
-			} else {
-				member->nt_tally++;
+		if (noise_gate_check(member)) {
+			uint32_t diff = member->score - member->energy_level;
+			if (member->hangover_hits) {
+				member->hangover_hits--;
 			}
 
-			member->score_iir = (int) (((1.0 - SCORE_DECAY) * (float) member->score) + (SCORE_DECAY * (float) member->score_iir));
-
-			if (member->score_iir > SCORE_MAX_IIR) {
-				member->score_iir = SCORE_MAX_IIR;
+			if (member->conference->agc_level) {
+				member->nt_tally = 0;
 			}
 
-			if (noise_gate_check(member)) {
-				uint32_t diff = member->score - member->energy_level;
-				if (hangover_hits) {
-					hangover_hits--;
-				}
+			if (diff >= diff_level || ++member->hangunder_hits >= hangunder) { 
+				check_floor_change = 1;
 
-				if (member->conference->agc_level) {
-					member->nt_tally = 0;
-				}
+				member->hangover_hits = member->hangunder_hits = 0;
+				member->last_talking = switch_epoch_time_now(NULL);
 
-				if (diff >= diff_level || ++hangunder_hits >= hangunder) { 
-					check_floor_change = 1;
+				if (!switch_test_flag(member, MFLAG_TALKING)) {
+					switch_set_flag_locked(member, MFLAG_TALKING);
+					conference_state_delta(member->conference, CONF_DELTA_START_TALKING, member, 0);
+
+					if (member->conference->talk_summary_interval) {
+						switch_atomic_inc(&member->conference->talk_starts);
+					} else if (test_eflag(member->conference, EFLAG_START_TALKING) && switch_test_flag(member, MFLAG_CAN_SPEAK) &&
+						switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
+						conference_add_event_member_data(member, event);
+						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "start-talking");
+						switch_event_fire(&event);
+					}
 
-					hangover_hits = hangunder_hits = 0;
-					member->last_talking = switch_epoch_time_now(NULL);
+					if (switch_test_flag(member, MFLAG_MUTE_DETECT) && !switch_test_flag(member, MFLAG_CAN_SPEAK)) {
 
-					if (!switch_test_flag(member, MFLAG_TALKING)) {
-						switch_set_flag_locked(member, MFLAG_TALKING);
+						if (!zstr(member->conference->mute_detect_sound)) {
+							switch_set_flag(member, MFLAG_INDICATE_MUTE_DETECT);
+						}
 
-						if (test_eflag(member->conference, EFLAG_START_TALKING) && switch_test_flag(member, MFLAG_CAN_SPEAK) &&
+						if (test_eflag(member->conference, EFLAG_MUTE_DETECT) &&
 							switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 							conference_add_event_member_data(member, event);
-							switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "start-talking");
+							switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "mute-detect");
 							switch_event_fire(&event);
 						}
-
-						if (switch_test_flag(member, MFLAG_MUTE_DETECT) && !switch_test_flag(member, MFLAG_CAN_SPEAK)) {
-
-							if (!zstr(member->conference->mute_detect_sound)) {
-								switch_set_flag(member, MFLAG_INDICATE_MUTE_DETECT);
-							}
-
-							if (test_eflag(member->conference, EFLAG_MUTE_DETECT) &&
-								switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
-								conference_add_event_member_data(member, event);
-								switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "mute-detect");
-								switch_event_fire(&event);
-							}
-						}
 					}
 				}
-			} else {
-				if (hangunder_hits) {
-					hangunder_hits--;
-				}
+			}
+		} else {
+			if (member->hangunder_hits) {
+				member->hangunder_hits--;
+			}
 
-				if (member->conference->agc_level) {
-					member->nt_tally++;
-				}
+			if (member->conference->agc_level) {
+				member->nt_tally++;
+			}
 
-				if (switch_test_flag(member, MFLAG_TALKING) && switch_test_flag(member, MFLAG_CAN_SPEAK)) {
-					switch_event_t *event;
-					if (++hangover_hits >= hangover) {
-						hangover_hits = hangunder_hits = 0;
-						switch_clear_flag_locked(member, MFLAG_TALKING);
-						check_agc_levels(member);
-						clear_avg(member);
-						
-						if (test_eflag(member->conference, EFLAG_STOP_TALKING) &&
-							switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
-							conference_add_event_member_data(member, event);
-							switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "stop-talking");
-							switch_event_fire(&event);
-						}
+			if (switch_test_flag(member, MFLAG_TALKING) && switch_test_flag(member, MFLAG_CAN_SPEAK)) {
+				switch_event_t *event;
+				if (++member->hangover_hits >= hangover) {
+					member->hangover_hits = member->hangunder_hits = 0;
+					switch_clear_flag_locked(member, MFLAG_TALKING);
+					conference_state_delta(member->conference, CONF_DELTA_STOP_TALKING, member, 0);
+					check_agc_levels(member);
+					clear_avg(member);
+					
+					if (member->conference->talk_summary_interval) {
+						switch_atomic_inc(&member->conference->talk_stops);
+					} else if (test_eflag(member->conference, EFLAG_STOP_TALKING) &&
+						switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
+						conference_add_event_member_data(member, event);
+						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "stop-talking");
+						switch_event_fire(&event);
 					}
 				}
 			}
+		}
+
+
+		member->last_score = member->score;
+	}
+
+	/* skip frames that are not actual media or when we are muted or silent */
+	if ((switch_test_flag(member, MFLAG_TALKING) || member->energy_level == 0) && switch_test_flag(member, MFLAG_CAN_SPEAK) &&
+		!switch_test_flag(member->conference, CFLAG_WAIT_MOD)) {
+		switch_audio_resampler_t *read_resampler = member->read_resampler;
+		void *data;
+		uint32_t datalen;
+
+		if (read_resampler) {
+			int16_t *bptr = (int16_t *) read_frame->data;
+			int len = (int) read_frame->datalen;
+
+			switch_resample_process(read_resampler, bptr, len / 2);
+			memcpy(member->resample_out, read_resampler->to, read_resampler->to_len * 2);
+			len = read_resampler->to_len * 2;
+			datalen = len;
+			data = member->resample_out;
+		} else {
+			data = read_frame->data;
+			datalen = read_frame->datalen;
+		}
+
+
+		if (datalen) {
+			/* Write the audio into the input buffer, if the mixer has fallen that far behind the frame is dropped */
+			if (!switch_buffer_write(member->audio_buffer, data, datalen)) {
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_DEBUG1, "Input buffer full, dropping frame\n");
+			}
+		}
+	}
+
+  do_continue:
+
+	switch_mutex_unlock(member->read_mutex);
 
+	if (check_floor_change) {
+		switch_mutex_lock(member->conference->member_mutex);
+		if ((!member->conference->floor_holder ||
+			 !switch_test_flag(member->conference->floor_holder, MFLAG_TALKING) ||
+			 ((member->score_iir > SCORE_IIR_SPEAKING_MAX) && (member->conference->floor_holder->score_iir < SCORE_IIR_SPEAKING_MIN))) &&
+			(!switch_test_flag(member->conference, CFLAG_VID_FLOOR) || switch_channel_test_flag(channel, CF_VIDEO))) {
 
-			member->last_score = member->score;
+			if (member->conference->talk_summary_interval) {
+				switch_atomic_inc(&member->conference->floor_changes);
+			} else if (test_eflag(member->conference, EFLAG_FLOOR_CHANGE) &&
+				switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
+				conference_add_event_member_data(member, event);
+				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "floor-change");
+				switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Old-ID", "%d",
+										member->conference->floor_holder ? member->conference->floor_holder->id : 0);
+				switch_event_add_header(event, SWITCH_STACK_BOTTOM, "New-ID", "%d", member->conference->floor_holder ? member->id : 0);
+				switch_event_fire(&event);
+			}
+			member->conference->floor_holder = member;
+			conference_state_delta(member->conference, CONF_DELTA_FLOOR_CHANGE, member, 0);
 		}
+		switch_mutex_unlock(member->conference->member_mutex);
+	}
 
-		/* skip frames that are not actual media or when we are muted or silent */
-		if ((switch_test_flag(member, MFLAG_TALKING) || member->energy_level == 0) && switch_test_flag(member, MFLAG_CAN_SPEAK) &&
-			!switch_test_flag(member->conference, CFLAG_WAIT_MOD)) {
-			switch_audio_resampler_t *read_resampler = member->read_resampler;
-			void *data;
-			uint32_t datalen;
+	return SWITCH_STATUS_SUCCESS;
+}
 
-			if (read_resampler) {
-				int16_t *bptr = (int16_t *) read_frame->data;
-				int len = (int) read_frame->datalen;
+/* marshall frames from the call leg to the conference thread for muxing to other call legs */
+static void *SWITCH_THREAD_FUNC conference_loop_input(switch_thread_t *thread, void *obj)
+{
+	conference_member_t *member = obj;
+	switch_channel_t *channel;
+	switch_status_t status;
+	switch_frame_t *read_frame = NULL;
+	switch_core_session_t *session = member->session;
 
-				switch_resample_process(read_resampler, bptr, len / 2);
-				memcpy(member->resample_out, read_resampler->to, read_resampler->to_len * 2);
-				len = read_resampler->to_len * 2;
-				datalen = len;
-				data = member->resample_out;
-			} else {
-				data = read_frame->data;
-				datalen = read_frame->datalen;
-			}
+	switch_assert(member != NULL);
 
+	switch_clear_flag_locked(member, MFLAG_TALKING);
 
-			if (datalen) {
-				switch_size_t ok = 1;
+	channel = switch_core_session_get_channel(session);
 
-				/* Write the audio into the input buffer */
-				switch_mutex_lock(member->audio_in_mutex);
-				ok = switch_buffer_write(member->audio_buffer, data, datalen);
-				switch_mutex_unlock(member->audio_in_mutex);
-				if (!ok) {
-					switch_mutex_unlock(member->read_mutex);
-					break;
-				}
-			}
-		}
+	switch_core_session_get_read_impl(session, &member->read_impl);
 
-	  do_continue:
+	/* As long as we have a valid read, feed that data into an input buffer where the conference thread will take it 
+	   and mux it with any audio from other channels. */
 
-		switch_mutex_unlock(member->read_mutex);
+	while (switch_test_flag(member, MFLAG_RUNNING) && switch_channel_ready(channel)) {
+		if (switch_channel_ready(channel) && switch_channel_test_app_flag(channel, CF_APP_TAGGED)) {
+			switch_yield(100000);
+			continue;
+		}
 
-		if (check_floor_change) {
-			switch_mutex_lock(member->conference->member_mutex);
-			if ((!member->conference->floor_holder ||
-				 !switch_test_flag(member->conference->floor_holder, MFLAG_TALKING) ||
-				 ((member->score_iir > SCORE_IIR_SPEAKING_MAX) && (member->conference->floor_holder->score_iir < SCORE_IIR_SPEAKING_MIN))) &&
-				(!switch_test_flag(member->conference, CFLAG_VID_FLOOR) || switch_channel_test_flag(channel, CF_VIDEO))) {
+		/* Read a frame. */
+		status = switch_core_session_read_frame(session, &read_frame, SWITCH_IO_FLAG_NONE, 0);
 
-				if (test_eflag(member->conference, EFLAG_FLOOR_CHANGE) &&
-					switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
-					conference_add_event_member_data(member, event);
-					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "floor-change");
-					switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Old-ID", "%d",
-											member->conference->floor_holder ? member->conference->floor_holder->id : 0);
-					switch_event_add_header(event, SWITCH_STACK_BOTTOM, "New-ID", "%d", member->conference->floor_holder ? member->id : 0);
-					switch_event_fire(&event);
-				}
-				member->conference->floor_holder = member;
-			}
-			switch_mutex_unlock(member->conference->member_mutex);
+		if (conference_member_input_frame(member, status, read_frame) != SWITCH_STATUS_SUCCESS) {
+			break;
 		}
-
 	}
 
 
@@ -2484,11 +4662,41 @@ static void *SWITCH_THREAD_FUNC conference_loop_input(switch_thread_t *thread, v
 	return NULL;
 }
 
+/* Service the call leg's reads from the output loop instead of a dedicated input thread, never blocks */
+static switch_status_t conference_member_poll_input(conference_member_t *member)
+{
+	switch_frame_t *read_frame = NULL;
+	switch_status_t status;
+	int x;
+
+	for (x = 0; x < CONF_INLINE_READ_MAX; x++) {
+		status = switch_core_session_read_frame(member->session, &read_frame, SWITCH_IO_FLAG_NOBLOCK, 0);
+
+		if (status == SWITCH_STATUS_BREAK || (SWITCH_READ_ACCEPTABLE(status) && switch_test_flag(read_frame, SFF_CNG))) {
+			/* nothing waiting, only count it as silence once a whole tick has gone by without media like a blocking read would */
+			if (!x && ++member->input_idle > 1) {
+				member->input_idle = 0;
+				return conference_member_input_frame(member, status, read_frame);
+			}
+			break;
+		}
+
+		member->input_idle = 0;
+
+		if (conference_member_input_frame(member, status, read_frame) != SWITCH_STATUS_SUCCESS) {
+			return SWITCH_STATUS_FALSE;
+		}
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 
 static void member_add_file_data(conference_member_t *member, int16_t *data, switch_size_t file_data_len)
 {
 	switch_size_t file_sample_len = file_data_len / 2;
 	int16_t file_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2] = { 0 };
+	const int16_t *file_pcm = file_frame;
 
 	if (!member->fnode) {
 		return;
@@ -2499,9 +4707,7 @@ static void member_add_file_data(conference_member_t *member, int16_t *data, swi
 		conference_file_node_t *fnode;
 		switch_memory_pool_t *pool;
 
-		if (member->fnode->type != NODE_TYPE_SPEECH) {
-			switch_core_file_close(&member->fnode->fh);
-		}
+		conference_file_node_close(member->fnode);
 
 		fnode = member->fnode;
 		member->fnode = member->fnode->next;
@@ -2522,6 +4728,9 @@ static void member_add_file_data(conference_member_t *member, int16_t *data, swi
 				} else {
 					file_sample_len = file_data_len = 0;
 				}
+			} else if (member->fnode->prompt) {
+				file_sample_len = conference_file_node_peek_prompt(member->fnode, &file_pcm, file_sample_len);
+				file_data_len = file_sample_len * 2;
 			} else if (member->fnode->type == NODE_TYPE_FILE) {
 				switch_core_file_read(&member->fnode->fh, file_frame, &file_sample_len);
 				file_data_len = file_sample_len * 2;
@@ -2544,11 +4753,16 @@ static void member_add_file_data(conference_member_t *member, int16_t *data, swi
 
 				/* Check for output volume adjustments */
 				if (member->volume_out_level) {
+					if (file_pcm != file_frame) {
+						/* a cached prompt is shared, adjust a copy */
+						memcpy(file_frame, file_pcm, file_sample_len * 2);
+						file_pcm = file_frame;
+					}
 					switch_change_sln_volume(file_frame, file_sample_len, member->volume_out_level);
 				}
 
 				for (i = 0; i < file_sample_len; i++) {
-					sample = data[i] + file_frame[i];
+					sample = data[i] + file_pcm[i];
 					switch_normalize_to_16bit(sample);
 					data[i] = sample;
 				}
@@ -2629,8 +4843,15 @@ static void conference_loop_output(conference_member_t *member)
 
 	write_frame.codec = &member->write_codec;
 
-	/* Start the input thread */
-	launch_conference_loop_input(member, switch_core_session_get_pool(member->session));
+	if (member->conference->inline_input) {
+		/* reads are serviced from the loop below so the member only costs the session thread */
+		switch_clear_flag_locked(member, MFLAG_TALKING);
+		switch_core_session_get_read_impl(member->session, &member->read_impl);
+		switch_set_flag_locked(member, MFLAG_ITHREAD);
+	} else {
+		/* Start the input thread */
+		launch_conference_loop_input(member, switch_core_session_get_pool(member->session));
+	}
 
 	if ((call_list = switch_channel_get_private(channel, "_conference_autocall_list_"))) {
 		const char *cid_name = switch_channel_get_variable(channel, "conference_auto_outcall_caller_id_name");
@@ -2709,6 +4930,13 @@ static void conference_loop_output(conference_member_t *member)
 		int use_timer = 0;
 		switch_buffer_t *use_buffer = NULL;
 		uint32_t mux_used = 0;
+		conference_mix_frame_t *mframe = NULL;
+		void *pop;
+
+		if (member->conference->inline_input && conference_member_poll_input(member) != SWITCH_STATUS_SUCCESS) {
+			switch_clear_flag_locked(member, MFLAG_ITHREAD);
+			break;
+		}
 
 		switch_mutex_lock(member->write_mutex);
 
@@ -2762,6 +4990,16 @@ static void conference_loop_output(conference_member_t *member)
 		mux_used = (uint32_t) switch_buffer_inuse(member->mux_buffer);
 		
 		use_timer = 1;
+
+		if (member->mux_queue) {
+			if (switch_queue_size(member->mux_queue) > CONF_MUX_QUEUE_MAX) {
+				/* getting behind, clear the queue */
+				switch_set_flag_locked(member, MFLAG_FLUSH_BUFFER);
+			}
+			if (switch_queue_trypop(member->mux_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+				mframe = (conference_mix_frame_t *) pop;
+			}
+		}
 		
 		if (mux_used) {
 			if (mux_used < bytes) {
@@ -2775,13 +5013,35 @@ static void conference_loop_output(conference_member_t *member)
 			}
 		}
 
-		if (mux_used >= bytes) {
+		if (mframe || mux_used >= bytes) {
 			/* Flush the output buffer and write all the data (presumably muxed) back to the channel */
-			switch_mutex_lock(member->audio_out_mutex);
 			write_frame.data = data;
-			use_buffer = member->mux_buffer;
 			low_count = 0;
-			if ((write_frame.datalen = (uint32_t) switch_buffer_read(use_buffer, write_frame.data, bytes))) {
+			if (mframe) {
+				switch_bool_t written;
+				switch_status_t wstatus;
+
+				write_frame.timestamp = timer.samplecount;
+				wstatus = conference_member_write_encoded(member, mframe, &write_frame, &written);
+
+				if (written) {
+					conference_mix_frame_release(member->conference, mframe);
+					if (wstatus != SWITCH_STATUS_SUCCESS) {
+						switch_channel_hangup(channel, SWITCH_CAUSE_DESTINATION_OUT_OF_ORDER);
+						break;
+					}
+					goto flush;
+				}
+
+				/* the mixed frame may be shared with other listeners and the write path is free to modify what we hand it */
+				memcpy(write_frame.data, mframe->data, mframe->datalen);
+				write_frame.datalen = mframe->datalen;
+				conference_mix_frame_release(member->conference, mframe);
+			} else {
+				use_buffer = member->mux_buffer;
+				write_frame.datalen = (uint32_t) switch_buffer_read(use_buffer, write_frame.data, bytes);
+			}
+			if (write_frame.datalen) {
 				if (write_frame.datalen) {
 					write_frame.samples = write_frame.datalen / 2;
 				   
@@ -2800,13 +5060,10 @@ static void conference_loop_output(conference_member_t *member)
 					}
 					if (switch_core_session_write_frame(member->session, &write_frame, SWITCH_IO_FLAG_NONE, 0) != SWITCH_STATUS_SUCCESS) {
 						switch_channel_hangup(channel, SWITCH_CAUSE_DESTINATION_OUT_OF_ORDER);
-						switch_mutex_unlock(member->audio_out_mutex);
 						break;
 					}
 				}
 			}
-
-			switch_mutex_unlock(member->audio_out_mutex);
 		} else if (member->fnode) {
 			write_frame.datalen = bytes;
 			write_frame.samples = samples;
@@ -2836,12 +5093,12 @@ static void conference_loop_output(conference_member_t *member)
 			}
 		}
 
+	  flush:
 		if (switch_test_flag(member, MFLAG_FLUSH_BUFFER)) {
 			if (switch_buffer_inuse(member->mux_buffer)) {
-				switch_mutex_lock(member->audio_out_mutex);
 				switch_buffer_zero(member->mux_buffer);
-				switch_mutex_unlock(member->audio_out_mutex);
 			}
+			conference_member_flush_mux_queue(member);
 			switch_clear_flag_locked(member, MFLAG_FLUSH_BUFFER);
 		}
 
@@ -2915,227 +5172,17 @@ static void conference_loop_output(conference_member_t *member)
 		member->conference->bridge_hangup_cause = switch_channel_get_cause(channel);
 	}
 
+	if (member->conference->inline_input) {
+		switch_resample_destroy(&member->read_resampler);
+		switch_clear_flag_locked(member, MFLAG_ITHREAD);
+	}
+
 	/* Wait for the input thread to end */
 	while (switch_test_flag(member, MFLAG_ITHREAD)) {
 		switch_cond_next();
 	}
 }
 
-/* Sub-Routine called by a record entity inside a conference */
-static void *SWITCH_THREAD_FUNC conference_record_thread_run(switch_thread_t *thread, void *obj)
-{
-	int16_t *data_buf;
-	switch_file_handle_t fh = { 0 };
-	conference_member_t smember = { 0 }, *member;
-	conference_record_t *rec = (conference_record_t *) obj;
-	conference_obj_t *conference = rec->conference;
-	uint32_t samples = switch_samples_per_packet(conference->rate, conference->interval);
-	uint32_t mux_used;
-	char *vval;
-	switch_timer_t timer = { 0 };
-	uint32_t rlen;
-	switch_size_t data_buf_len;
-	switch_event_t *event;
-	int no_data = 0;
-	int lead_in = 20;
-	switch_size_t len = 0;
-
-	data_buf_len = samples * sizeof(int16_t);
-
-	switch_zmalloc(data_buf, data_buf_len);
-
-	if (switch_thread_rwlock_tryrdlock(conference->rwlock) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Read Lock Fail\n");
-		return NULL;
-	}
-
-	switch_mutex_lock(globals.hash_mutex);
-	globals.threads++;
-	switch_mutex_unlock(globals.hash_mutex);
-
-	member = &smember;
-
-	member->flags = MFLAG_CAN_HEAR | MFLAG_NOCHANNEL | MFLAG_RUNNING;
-
-	member->conference = conference;
-	member->native_rate = conference->rate;
-	member->rec_path = rec->path;
-	fh.channels = 1;
-	fh.samplerate = conference->rate;
-	member->id = next_member_id();
-	member->pool = rec->pool;
-
-	member->frame_size = SWITCH_RECOMMENDED_BUFFER_SIZE;
-	member->frame = switch_core_alloc(member->pool, member->frame_size);
-	member->mux_frame = switch_core_alloc(member->pool, member->frame_size);
-
-
-	switch_mutex_init(&member->write_mutex, SWITCH_MUTEX_NESTED, rec->pool);
-	switch_mutex_init(&member->flag_mutex, SWITCH_MUTEX_NESTED, rec->pool);
-	switch_mutex_init(&member->audio_in_mutex, SWITCH_MUTEX_NESTED, rec->pool);
-	switch_mutex_init(&member->audio_out_mutex, SWITCH_MUTEX_NESTED, rec->pool);
-	switch_mutex_init(&member->read_mutex, SWITCH_MUTEX_NESTED, rec->pool);
-	switch_thread_rwlock_create(&member->rwlock, rec->pool);
-
-	/* Setup an audio buffer for the incoming audio */
-	if (switch_buffer_create_dynamic(&member->audio_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, 0) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
-		goto end;
-	}
-
-	/* Setup an audio buffer for the outgoing audio */
-	if (switch_buffer_create_dynamic(&member->mux_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, 0) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
-		goto end;
-	}
-
-	if (conference_add_member(conference, member) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Joining Conference\n");
-		goto end;
-	}
-
-	fh.pre_buffer_datalen = SWITCH_DEFAULT_FILE_BUFFER_LEN;
-
-	if (switch_core_file_open(&fh,
-							  rec->path, (uint8_t) 1, conference->rate, SWITCH_FILE_FLAG_WRITE | SWITCH_FILE_DATA_SHORT,
-							  rec->pool) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Opening File [%s]\n", rec->path);
-		goto end;
-	}
-
-
-	if (switch_core_timer_init(&timer, conference->timer_name, conference->interval, samples, rec->pool) == SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Setup timer success interval: %u  samples: %u\n", conference->interval, samples);
-	} else {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Timer Setup Failed.  Conference Cannot Start\n");
-		goto end;
-	}
-
-	if ((vval = switch_mprintf("Conference %s", conference->name))) {
-		switch_core_file_set_string(&fh, SWITCH_AUDIO_COL_STR_TITLE, vval);
-		switch_safe_free(vval);
-	}
-
-	switch_core_file_set_string(&fh, SWITCH_AUDIO_COL_STR_ARTIST, "FreeSWITCH mod_conference Software Conference Module");
-
-	if (test_eflag(conference, EFLAG_RECORD) &&
-			switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
-		conference_add_event_data(conference, event);
-		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "start-recording");
-		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Path", rec->path);
-		switch_event_fire(&event);
-	}
-
-	while (switch_test_flag(member, MFLAG_RUNNING) && switch_test_flag(conference, CFLAG_RUNNING) && conference->count) {
-
-		len = 0;
-
-		if (lead_in) {
-			lead_in--;
-			goto loop;
-		}
-		
-		mux_used = (uint32_t) switch_buffer_inuse(member->mux_buffer);
-
-		if (switch_test_flag(member, MFLAG_FLUSH_BUFFER)) {
-			if (mux_used) {
-				switch_mutex_lock(member->audio_out_mutex);
-				switch_buffer_zero(member->mux_buffer);
-				switch_mutex_unlock(member->audio_out_mutex);
-				mux_used = 0;
-			}
-			switch_clear_flag_locked(member, MFLAG_FLUSH_BUFFER);
-		}
-
-	again:
-
-		if (switch_test_flag((&fh), SWITCH_FILE_PAUSE)) {
-			switch_set_flag_locked(member, MFLAG_FLUSH_BUFFER);
-			goto loop;
-		}
-
-		if (mux_used >= data_buf_len) {
-			/* Flush the output buffer and write all the data (presumably muxed) to the file */
-			switch_mutex_lock(member->audio_out_mutex);
-			//low_count = 0;
-
-			if ((rlen = (uint32_t) switch_buffer_read(member->mux_buffer, data_buf, data_buf_len))) {
-				len = (switch_size_t) rlen / sizeof(int16_t);
-				no_data = 0;
-			}
-			switch_mutex_unlock(member->audio_out_mutex);
-		}
-
-		if (len == 0) {
-			mux_used = (uint32_t) switch_buffer_inuse(member->mux_buffer);
-				
-			if (mux_used >= data_buf_len) {
-				goto again;
-			}
-
-			if (++no_data < 2) {
-				goto loop;
-			}
-
-			memset(data_buf, 255, (switch_size_t) data_buf_len);
-			len = (switch_size_t) samples;
-		}
-
-		if (!len || switch_core_file_write(&fh, data_buf, &len) != SWITCH_STATUS_SUCCESS) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Write Failed\n");
-			switch_clear_flag_locked(member, MFLAG_RUNNING);
-		}
-		
-	loop:
-
-		switch_core_timer_next(&timer);
-	}							/* Rinse ... Repeat */
-
-  end:
-
-	while(!no_data) {
-		switch_mutex_lock(member->audio_out_mutex);
-		if ((rlen = (uint32_t) switch_buffer_read(member->mux_buffer, data_buf, data_buf_len))) {
-			len = (switch_size_t) rlen / sizeof(int16_t);
-			switch_core_file_write(&fh, data_buf, &len);
-		} else {
-			no_data = 1;
-		}
-		switch_mutex_unlock(member->audio_out_mutex);
-	}
-
-
-	switch_safe_free(data_buf);
-	switch_core_timer_destroy(&timer);
-	conference_del_member(conference, member);
-	switch_buffer_destroy(&member->audio_buffer);
-	switch_buffer_destroy(&member->mux_buffer);
-	switch_clear_flag_locked(member, MFLAG_RUNNING);
-	if (switch_test_flag((&fh), SWITCH_FILE_OPEN)) {
-		switch_core_file_close(&fh);
-	}
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Recording of %s Stopped\n", rec->path);
-	if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
-		conference_add_event_data(conference, event);
-		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", "stop-recording");
-		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Path", rec->path);
-		switch_event_fire(&event);
-	}
-
-	if (rec->pool) {
-		switch_memory_pool_t *pool = rec->pool;
-		rec = NULL;
-		switch_core_destroy_memory_pool(&pool);
-	}
-
-	switch_mutex_lock(globals.hash_mutex);
-	globals.threads--;
-	switch_mutex_unlock(globals.hash_mutex);
-
-	switch_thread_rwlock_unlock(conference->rwlock);
-	return NULL;
-}
-
 /* Make files stop playing in a conference either the current one or all of them */
 static uint32_t conference_stop_file(conference_obj_t *conference, file_stop_t stop)
 {
@@ -3304,7 +5351,8 @@ static switch_status_t conference_play_file(conference_obj_t *conference, char *
 
 	/* Open the file */
 	fnode->fh.pre_buffer_datalen = SWITCH_DEFAULT_FILE_BUFFER_LEN;
-	if (switch_core_file_open(&fnode->fh, file, (uint8_t) 1, conference->rate, SWITCH_FILE_FLAG_READ | SWITCH_FILE_DATA_SHORT, pool) !=
+	if (!(fnode->prompt = conference_prompt_get(file, conference->rate, async ? SWITCH_FALSE : SWITCH_TRUE)) &&
+		switch_core_file_open(&fnode->fh, file, (uint8_t) 1, conference->rate, SWITCH_FILE_FLAG_READ | SWITCH_FILE_DATA_SHORT, pool) !=
 		SWITCH_STATUS_SUCCESS) {
 		switch_core_destroy_memory_pool(&pool);
 		status = SWITCH_STATUS_NOTFOUND;
@@ -3315,6 +5363,10 @@ static switch_status_t conference_play_file(conference_obj_t *conference, char *
 	fnode->async = async;
 	fnode->file = switch_core_strdup(fnode->pool, file);
 
+	/* start decoding before the lead in runs out */
+	conference_file_node_setup(conference, fnode);
+	conference_file_node_prefetch(fnode);
+
 	/* Queue the node */
 	switch_mutex_lock(conference->mutex);
 
@@ -3325,10 +5377,8 @@ static switch_status_t conference_play_file(conference_obj_t *conference, char *
 		conference->async_fnode = fnode;
 
 		if (nptr) {
-			switch_memory_pool_t *tmppool;
-			switch_core_file_close(&nptr->fh);
-			tmppool = nptr->pool;
-			switch_core_destroy_memory_pool(&tmppool);
+			nptr->done++;
+			conference_file_node_release(nptr);
 		}
 
 	} else {
@@ -3401,7 +5451,8 @@ static switch_status_t conference_member_play_file(conference_member_t *member,
 	fnode->leadin = leadin;
 	/* Open the file */
 	fnode->fh.pre_buffer_datalen = SWITCH_DEFAULT_FILE_BUFFER_LEN;
-	if (switch_core_file_open(&fnode->fh,
+	if (!(fnode->prompt = conference_prompt_get(file, member->conference->rate, SWITCH_TRUE)) &&
+		switch_core_file_open(&fnode->fh,
 							  file, (uint8_t) 1, member->conference->rate, SWITCH_FILE_FLAG_READ | SWITCH_FILE_DATA_SHORT,
 							  pool) != SWITCH_STATUS_SUCCESS) {
 		switch_core_destroy_memory_pool(&pool);
@@ -3565,6 +5616,7 @@ static switch_status_t conference_say(conference_obj_t *conference, const char *
 	}
 
 	fnode->pool = pool;
+	conference_file_node_setup(conference, fnode);
 
 	/* Queue the node */
 	switch_mutex_lock(conference->mutex);
@@ -3577,6 +5629,9 @@ static switch_status_t conference_say(conference_obj_t *conference, const char *
 	}
 
 	fnode->sh = conference->sh;
+
+	/* a prefetch reader may be pulling audio out of the same handle */
+	switch_mutex_lock(conference->tts_mutex);
 	if (*text == '#') {
 		char *tmp = (char *) text + 1;
 		char *vp = tmp, voice[128] = "";
@@ -3592,6 +5647,7 @@ static switch_status_t conference_say(conference_obj_t *conference, const char *
 	/* Begin Generation */
 	switch_sleep(200000);
 	switch_core_speech_feed_tts(fnode->sh, (char *) text, &flags);
+	switch_mutex_unlock(conference->tts_mutex);
 	switch_mutex_unlock(conference->mutex);
 	status = SWITCH_STATUS_SUCCESS;
 
@@ -3621,16 +5677,14 @@ static switch_status_t list_conferences(const char *line, const char *cursor, sw
 {
 	switch_console_callback_match_t *my_matches = NULL;
 	switch_status_t status = SWITCH_STATUS_FALSE;
-	switch_hash_index_t *hi;
-	void *val;
-	const void *vvar;
+	conference_obj_t **list = NULL;
+	uint32_t count, x;
 
-	switch_mutex_lock(globals.hash_mutex);
-	for (hi = switch_hash_first(NULL, globals.conference_hash); hi; hi = switch_hash_next(hi)) {
-		switch_hash_this(hi, &vvar, NULL, &val);
-		switch_console_push_match(&my_matches, (const char *) vvar);		
+	count = conference_registry_snapshot(&list);
+	for (x = 0; x < count; x++) {
+		switch_console_push_match(&my_matches, list[x]->name);
 	}
-	switch_mutex_unlock(globals.hash_mutex);
+	conference_registry_release(list, count);
 	
 	if (my_matches) {
 		*matches = my_matches;
@@ -3746,6 +5800,7 @@ static switch_status_t conf_api_sub_mute(conference_member_t *member, switch_str
 
 	switch_clear_flag_locked(member, MFLAG_CAN_SPEAK);
 	switch_clear_flag_locked(member, MFLAG_TALKING);
+	conference_state_delta(member->conference, CONF_DELTA_MUTE_MEMBER, member, 0);
 
 	switch_set_flag(member, MFLAG_INDICATE_MUTE);
 
@@ -3818,6 +5873,7 @@ static switch_status_t conf_api_sub_unmute(conference_member_t *member, switch_s
 
 	switch_set_flag_locked(member, MFLAG_CAN_SPEAK);
 	switch_set_flag(member, MFLAG_INDICATE_UNMUTE);
+	conference_state_delta(member->conference, CONF_DELTA_UNMUTE_MEMBER, member, 0);
 
 	if (stream != NULL) {
 		stream->write_function(stream, "OK unmute %u\n", member->id);
@@ -3841,6 +5897,7 @@ static switch_status_t conf_api_sub_deaf(conference_member_t *member, switch_str
 		return SWITCH_STATUS_GENERR;
 
 	switch_clear_flag_locked(member, MFLAG_CAN_HEAR);
+	conference_state_delta(member->conference, CONF_DELTA_DEAF_MEMBER, member, 0);
 	if (stream != NULL) {
 		stream->write_function(stream, "OK deaf %u\n", member->id);
 	}
@@ -3861,6 +5918,7 @@ static switch_status_t conf_api_sub_undeaf(conference_member_t *member, switch_s
 		return SWITCH_STATUS_GENERR;
 
 	switch_set_flag_locked(member, MFLAG_CAN_HEAR);
+	conference_state_delta(member->conference, CONF_DELTA_UNDEAF_MEMBER, member, 0);
 	if (stream != NULL) {
 		stream->write_function(stream, "OK undeaf %u\n", member->id);
 	}
@@ -3968,6 +6026,7 @@ static switch_status_t conf_api_sub_energy(conference_member_t *member, switch_s
 		lock_member(member);
 		member->energy_level = atoi((char *) data);
 		unlock_member(member);
+		conference_state_delta(member->conference, CONF_DELTA_ENERGY_LEVEL, member, member->energy_level);
 	}
 	if (stream != NULL) {
 		stream->write_function(stream, "Energy %u = %d\n", member->id, member->energy_level);
@@ -3995,6 +6054,7 @@ static switch_status_t conf_api_sub_volume_in(conference_member_t *member, switc
 		member->volume_in_level = atoi((char *) data);
 		switch_normalize_volume(member->volume_in_level);
 		unlock_member(member);
+		conference_state_delta(member->conference, CONF_DELTA_VOLUME_IN, member, member->volume_in_level);
 	}
 	if (stream != NULL) {
 		stream->write_function(stream, "Volume IN %u = %d\n", member->id, member->volume_in_level);
@@ -4022,6 +6082,7 @@ static switch_status_t conf_api_sub_volume_out(conference_member_t *member, swit
 		member->volume_out_level = atoi((char *) data);
 		switch_normalize_volume(member->volume_out_level);
 		unlock_member(member);
+		conference_state_delta(member->conference, CONF_DELTA_VOLUME_OUT, member, member->volume_out_level);
 	}
 	if (stream != NULL) {
 		stream->write_function(stream, "Volume OUT %u = %d\n", member->id, member->volume_out_level);
@@ -4041,8 +6102,9 @@ static switch_status_t conf_api_sub_list(conference_obj_t *conference, switch_st
 {
 	int ret_status = SWITCH_STATUS_GENERR;
 	int count = 0;
-	switch_hash_index_t *hi;
-	void *val;
+	conference_obj_t **list = NULL;
+	uint32_t list_count, x;
+	conference_list_filter_t filter;
 	char *d = ";";
 	int pretty = 0;
 	int summary = 0;
@@ -4072,16 +6134,32 @@ static switch_status_t conf_api_sub_list(conference_obj_t *conference, switch_st
 		}
 	}
 
+	conference_list_parse_filter(&filter, argc, argv);
+
 	if (conference == NULL) {
-		switch_mutex_lock(globals.hash_mutex);
-		for (hi = switch_hash_first(NULL, globals.conference_hash); hi; hi = switch_hash_next(hi)) {
-			switch_hash_this(hi, NULL, NULL, &val);
-			conference = (conference_obj_t *) val;
+		list_count = conference_registry_snapshot(&list);
+		for (x = 0; x < list_count; x++) {
+			conference = list[x];
+
+			if (!conference_list_filter_match(&filter, conference)) {
+				continue;
+			}
 
-			stream->write_function(stream, "Conference %s (%u member%s rate: %u%s)\n",
+			stream->write_function(stream, "Conference %s (%u member%s rate: %u%s",
 								   conference->name,
 								   conference->count,
 								   conference->count == 1 ? "" : "s", conference->rate, switch_test_flag(conference, CFLAG_LOCKED) ? " locked" : "");
+			if (conference->prefetch_starved) {
+				stream->write_function(stream, " prefetch-starved: %u", conference->prefetch_starved);
+			}
+			if (conference->mixer_late || conference->mixer_skipped) {
+				stream->write_function(stream, " mixer-late: %u mixer-skipped: %u", conference->mixer_late, conference->mixer_skipped);
+			}
+			if (conference->record_count || switch_atomic_read(&conference->rec_dropped)) {
+				stream->write_function(stream, " rec-backlog: %u rec-dropped: %u",
+									   switch_atomic_read(&conference->rec_backlog), switch_atomic_read(&conference->rec_dropped));
+			}
+			stream->write_function(stream, ")\n");
 			count++;
 			if (!summary) {
 				if (pretty) {
@@ -4091,7 +6169,7 @@ static switch_status_t conf_api_sub_list(conference_obj_t *conference, switch_st
 				}
 			}
 		}
-		switch_mutex_unlock(globals.hash_mutex);
+		conference_registry_release(list, list_count);
 	} else {
 		count++;
 		if (countonly) {
@@ -4103,235 +6181,538 @@ static switch_status_t conf_api_sub_list(conference_obj_t *conference, switch_st
 		}
 	}
 
-	if (!count) {
-		stream->write_function(stream, "No active conferences.\n");
+	if (!count) {
+		stream->write_function(stream, "No active conferences.\n");
+	}
+
+	ret_status = SWITCH_STATUS_SUCCESS;
+
+	return ret_status;
+}
+
+
+/* Simple '*' and '?' wildcard match for --room */
+static switch_bool_t conference_glob_match(const char *pat, const char *str)
+{
+	const char *star = NULL, *mark = NULL;
+
+	while (*str) {
+		if (*pat == '?' || *pat == *str) {
+			pat++;
+			str++;
+		} else if (*pat == '*') {
+			star = pat++;
+			mark = str;
+		} else if (star) {
+			pat = star + 1;
+			str = ++mark;
+		} else {
+			return SWITCH_FALSE;
+		}
+	}
+
+	while (*pat == '*') {
+		pat++;
+	}
+
+	return *pat ? SWITCH_FALSE : SWITCH_TRUE;
+}
+
+static void conference_list_parse_filter(conference_list_filter_t *filter, int argc, char **argv)
+{
+	int x;
+
+	memset(filter, 0, sizeof(*filter));
+
+	for (x = 0; x < argc; x++) {
+		if (zstr(argv[x]) || strncmp(argv[x], "--", 2)) {
+			continue;
+		}
+
+		if (!strncasecmp(argv[x], "--since=", 8)) {
+			filter->since = (uint32_t) strtoul(argv[x] + 8, NULL, 10);
+		} else if (!strncasecmp(argv[x], "--room=", 7) && !zstr(argv[x] + 7)) {
+			filter->room = argv[x] + 7;
+		} else if (!strncasecmp(argv[x], "--after=", 8) && !zstr(argv[x] + 8)) {
+			filter->after = argv[x] + 8;
+		} else if (!strncasecmp(argv[x], "--limit=", 8)) {
+			filter->limit = (uint32_t) strtoul(argv[x] + 8, NULL, 10);
+		}
+	}
+}
+
+static switch_bool_t conference_list_filter_match(conference_list_filter_t *filter, conference_obj_t *conference)
+{
+	if (filter->since && conference->list_seq <= filter->since) {
+		return SWITCH_FALSE;
 	}
 
-	ret_status = SWITCH_STATUS_SUCCESS;
+	if (filter->room && !conference_glob_match(filter->room, conference->name)) {
+		return SWITCH_FALSE;
+	}
 
-	return ret_status;
+	if (filter->after && strcmp(conference->name, filter->after) <= 0) {
+		return SWITCH_FALSE;
+	}
+
+	return SWITCH_TRUE;
 }
 
+static int conference_name_cmp(const void *a, const void *b)
+{
+	return strcmp((*(conference_obj_t * const *) a)->name, (*(conference_obj_t * const *) b)->name);
+}
 
-static switch_xml_t add_x_tag(switch_xml_t x_member, const char *name, const char *value, int off)
+/* Copy what the serializers need so member_mutex is only held for the copy, never while writing */
+static void conference_snap_take(conference_obj_t *conference, conference_snap_t *snap)
 {
-	switch_size_t dlen = strlen(value) * 3 + 1;
-	char *data;
-	switch_xml_t x_tag;
+	conference_member_t *member;
+	uint32_t n = 0;
+
+	memset(snap, 0, sizeof(*snap));
+	snap->name = conference->name;
+	snap->uuid = conference->uuid_str;
+	snap->flags = conference->flags;
+	snap->count = conference->count;
+	snap->rate = conference->rate;
+	snap->seq = conference->list_seq;
+	snap->version = conference->state_version;
+	snap->prefetch_starved = conference->prefetch_starved;
+	snap->record_count = conference->record_count;
+	snap->agc_level = conference->agc_level;
+	snap->run_time = conference->run_time;
+
+	switch_mutex_lock(conference->member_mutex);
+
+	for (member = conference->members; member; member = member->next) {
+		if (!switch_test_flag(member, MFLAG_NOCHANNEL)) {
+			n++;
+		}
+	}
+
+	if (n) {
+		switch_zmalloc(snap->members, n * sizeof(*snap->members));
+	}
+
+	for (member = conference->members; member && snap->member_count < n; member = member->next) {
+		conference_member_snap_t *msnap;
+		switch_channel_t *channel;
+		switch_caller_profile_t *profile;
 
-	x_tag = switch_xml_add_child_d(x_member, name, off);
-	switch_assert(x_tag);
+		if (switch_test_flag(member, MFLAG_NOCHANNEL)) {
+			continue;
+		}
 
-	switch_zmalloc(data, dlen);
+		msnap = &snap->members[snap->member_count++];
+		channel = switch_core_session_get_channel(member->session);
+		profile = switch_channel_get_caller_profile(channel);
 
-	switch_url_encode(value, data, dlen);
-	switch_xml_set_txt_d(x_tag, data);
-	free(data);
+		msnap->id = member->id;
+		msnap->flags = member->flags;
+		switch_copy_string(msnap->uuid, switch_core_session_get_uuid(member->session), sizeof(msnap->uuid));
+		switch_copy_string(msnap->caller_id_name, switch_str_nil(profile->caller_id_name), sizeof(msnap->caller_id_name));
+		switch_copy_string(msnap->caller_id_number, switch_str_nil(profile->caller_id_number), sizeof(msnap->caller_id_number));
+		msnap->join_time = member->join_time;
+		msnap->last_talking = member->last_talking;
+		msnap->energy_level = member->energy_level;
+		msnap->volume_in_level = member->volume_in_level;
+		msnap->volume_out_level = member->volume_out_level;
+		msnap->agc_volume_in_level = member->agc_volume_in_level;
+		msnap->has_video = switch_channel_test_flag(channel, CF_VIDEO) ? 1 : 0;
+		msnap->has_floor = (member == conference->floor_holder) ? 1 : 0;
+	}
 
-	return x_tag;
+	switch_mutex_unlock(conference->member_mutex);
 }
 
-static void conference_xlist(conference_obj_t *conference, switch_xml_t x_conference, int off)
+static void conference_snap_free(conference_snap_t *snap)
 {
-	conference_member_t *member = NULL;
-	switch_xml_t x_member = NULL, x_members = NULL, x_flags;
-	int moff = 0;
-	char i[30] = "";
-	char *ival = i;
-	switch_assert(conference != NULL);
-	switch_assert(x_conference != NULL);
-
-	switch_xml_set_attr_d(x_conference, "name", conference->name);
-	switch_snprintf(i, sizeof(i), "%d", conference->count);
-	switch_xml_set_attr_d(x_conference, "member-count", ival);
-	switch_snprintf(i, sizeof(i), "%u", conference->rate);
-	switch_xml_set_attr_d(x_conference, "rate", ival);
-	switch_xml_set_attr_d(x_conference, "uuid", conference->uuid_str);
-		
-	if (switch_test_flag(conference, CFLAG_LOCKED)) {
-		switch_xml_set_attr_d(x_conference, "locked", "true");
-	}
+	switch_safe_free(snap->members);
+}
 
-	if (switch_test_flag(conference, CFLAG_DESTRUCT)) {
-		switch_xml_set_attr_d(x_conference, "destruct", "true");
-	}
+/* Write an attribute or text value with the five xml entities escaped */
+static void conference_stream_xml_escaped(switch_stream_handle_t *stream, const char *s)
+{
+	const char *p;
 
-	if (switch_test_flag(conference, CFLAG_WAIT_MOD)) {
-		switch_xml_set_attr_d(x_conference, "wait_mod", "true");
+	for (p = s; *p; p++) {
+		switch (*p) {
+		case '&':
+			stream->write_function(stream, "&amp;");
+			break;
+		case '<':
+			stream->write_function(stream, "&lt;");
+			break;
+		case '>':
+			stream->write_function(stream, "&gt;");
+			break;
+		case '"':
+			stream->write_function(stream, "&quot;");
+			break;
+		case '\'':
+			stream->write_function(stream, "&apos;");
+			break;
+		default:
+			stream->write_function(stream, "%c", *p);
+			break;
+		}
 	}
+}
 
-	if (switch_test_flag(conference, CFLAG_RUNNING)) {
-		switch_xml_set_attr_d(x_conference, "running", "true");
-	}
+/* Member values are url encoded, same as the tree based xml_list always did */
+static void conference_stream_xml_tag(switch_stream_handle_t *stream, const char *name, const char *value)
+{
+	char buf[1024];
 
-	if (switch_test_flag(conference, CFLAG_ANSWERED)) {
-		switch_xml_set_attr_d(x_conference, "answered", "true");
-	}
+	switch_url_encode(value, buf, sizeof(buf));
+	stream->write_function(stream, "        <%s>%s</%s>\n", name, buf, name);
+}
 
-	if (switch_test_flag(conference, CFLAG_ENFORCE_MIN)) {
-		switch_xml_set_attr_d(x_conference, "enforce_min", "true");
+static void conference_stream_json_str(switch_stream_handle_t *stream, const char *s)
+{
+	const unsigned char *p;
+
+	stream->write_function(stream, "\"");
+	for (p = (const unsigned char *) s; *p; p++) {
+		if (*p == '"' || *p == '\\') {
+			stream->write_function(stream, "\\%c", *p);
+		} else if (*p < 0x20) {
+			stream->write_function(stream, "\\u%04x", *p);
+		} else {
+			stream->write_function(stream, "%c", *p);
+		}
 	}
+	stream->write_function(stream, "\"");
+}
+
+static const struct {
+	uint32_t flag;
+	const char *name;
+} conference_snap_cflags[] = {
+	{CFLAG_LOCKED, "locked"},
+	{CFLAG_DESTRUCT, "destruct"},
+	{CFLAG_WAIT_MOD, "wait_mod"},
+	{CFLAG_RUNNING, "running"},
+	{CFLAG_ANSWERED, "answered"},
+	{CFLAG_ENFORCE_MIN, "enforce_min"},
+	{CFLAG_BRIDGE_TO, "bridge_to"},
+	{CFLAG_DYNAMIC, "dynamic"},
+	{CFLAG_EXIT_SOUND, "exit_sound"},
+	{CFLAG_ENTER_SOUND, "enter_sound"}
+};
+
+/* member flags in xml_list order, has_video and has_floor are not member flags and come from the snapshot */
+static const struct {
+	uint32_t flag;
+	const char *name;
+} conference_snap_mflags[] = {
+	{MFLAG_CAN_HEAR, "can_hear"},
+	{MFLAG_CAN_SPEAK, "can_speak"},
+	{MFLAG_MUTE_DETECT, "mute_detect"},
+	{MFLAG_TALKING, "talking"},
+	{0, "has_video"},
+	{0, "has_floor"},
+	{MFLAG_MOD, "is_moderator"},
+	{MFLAG_ENDCONF, "end_conference"}
+};
 
-	if (switch_test_flag(conference, CFLAG_BRIDGE_TO)) {
-		switch_xml_set_attr_d(x_conference, "bridge_to", "true");
+static switch_bool_t conference_snap_mflag(conference_member_snap_t *msnap, int x)
+{
+	switch (x) {
+	case 4:
+		return msnap->has_video ? SWITCH_TRUE : SWITCH_FALSE;
+	case 5:
+		return msnap->has_floor ? SWITCH_TRUE : SWITCH_FALSE;
+	default:
+		return (msnap->flags & conference_snap_mflags[x].flag) ? SWITCH_TRUE : SWITCH_FALSE;
 	}
+}
+
+static void conference_snap_write_xml(conference_snap_t *snap, switch_stream_handle_t *stream, switch_time_t now)
+{
+	uint32_t m;
+	size_t x;
+	char tmp[50];
 
-	if (switch_test_flag(conference, CFLAG_DYNAMIC)) {
-		switch_xml_set_attr_d(x_conference, "dynamic", "true");
+	stream->write_function(stream, "  <conference name=\"");
+	conference_stream_xml_escaped(stream, snap->name);
+	stream->write_function(stream, "\" member-count=\"%u\" rate=\"%u\" uuid=\"%s\"", snap->count, snap->rate, switch_str_nil(snap->uuid));
+
+	for (x = 0; x < sizeof(conference_snap_cflags) / sizeof(conference_snap_cflags[0]); x++) {
+		if ((snap->flags & conference_snap_cflags[x].flag)) {
+			stream->write_function(stream, " %s=\"true\"", conference_snap_cflags[x].name);
+		}
 	}
 
-	if (switch_test_flag(conference, CFLAG_EXIT_SOUND)) {
-		switch_xml_set_attr_d(x_conference, "exit_sound", "true");
+	if (snap->record_count > 0) {
+		stream->write_function(stream, " recording=\"true\"");
 	}
-	
-	if (switch_test_flag(conference, CFLAG_ENTER_SOUND)) {
-		switch_xml_set_attr_d(x_conference, "enter_sound", "true");
+
+	stream->write_function(stream, " run_time=\"%d\" prefetch_starved=\"%u\" seq=\"%u\" version=\"%u\"",
+						   (int) (now - snap->run_time), snap->prefetch_starved, snap->seq, snap->version);
+
+	if (snap->agc_level) {
+		stream->write_function(stream, " agc=\"%d\"", snap->agc_level);
 	}
-	
-	if (conference->record_count > 0) {
-		switch_xml_set_attr_d(x_conference, "recording", "true");
+
+	stream->write_function(stream, ">\n    <members>\n");
+
+	for (m = 0; m < snap->member_count; m++) {
+		conference_member_snap_t *msnap = &snap->members[m];
+
+		stream->write_function(stream, "      <member>\n");
+
+		switch_snprintf(tmp, sizeof(tmp), "%u", msnap->id);
+		conference_stream_xml_tag(stream, "id", tmp);
+		conference_stream_xml_tag(stream, "uuid", msnap->uuid);
+		conference_stream_xml_tag(stream, "caller_id_name", msnap->caller_id_name);
+		conference_stream_xml_tag(stream, "caller_id_number", msnap->caller_id_number);
+		switch_snprintf(tmp, sizeof(tmp), "%d", (int) (now - msnap->join_time));
+		conference_stream_xml_tag(stream, "join_time", tmp);
+		switch_snprintf(tmp, sizeof(tmp), "%d", (int) (now - msnap->last_talking));
+		conference_stream_xml_tag(stream, "last_talking", msnap->last_talking ? tmp : "N/A");
+		switch_snprintf(tmp, sizeof(tmp), "%d", msnap->energy_level);
+		conference_stream_xml_tag(stream, "energy", tmp);
+		switch_snprintf(tmp, sizeof(tmp), "%d", msnap->volume_in_level);
+		conference_stream_xml_tag(stream, "volume_in", tmp);
+		switch_snprintf(tmp, sizeof(tmp), "%d", msnap->volume_out_level);
+		conference_stream_xml_tag(stream, "volume_out", tmp);
+
+		stream->write_function(stream, "        <flags>\n");
+		for (x = 0; x < sizeof(conference_snap_mflags) / sizeof(conference_snap_mflags[0]); x++) {
+			stream->write_function(stream, "          <%s>%s</%s>\n", conference_snap_mflags[x].name,
+								   conference_snap_mflag(msnap, (int) x) ? "true" : "false", conference_snap_mflags[x].name);
+		}
+		stream->write_function(stream, "        </flags>\n");
+
+		switch_snprintf(tmp, sizeof(tmp), "%d", msnap->volume_out_level);
+		conference_stream_xml_tag(stream, "output-volume", tmp);
+		switch_snprintf(tmp, sizeof(tmp), "%d", msnap->agc_volume_in_level ? msnap->agc_volume_in_level : msnap->volume_in_level);
+		conference_stream_xml_tag(stream, "input-volume", tmp);
+		switch_snprintf(tmp, sizeof(tmp), "%d", msnap->agc_volume_in_level);
+		conference_stream_xml_tag(stream, "auto-adjusted-input-volume", tmp);
+
+		stream->write_function(stream, "      </member>\n");
 	}
 
-	switch_snprintf(i, sizeof(i), "%d", switch_epoch_time_now(NULL) - conference->run_time);
-	switch_xml_set_attr_d(x_conference, "run_time", ival);
+	stream->write_function(stream, "    </members>\n  </conference>\n");
+}
+
+static void conference_snap_write_json(conference_snap_t *snap, switch_stream_handle_t *stream, switch_time_t now)
+{
+	uint32_t m;
+	size_t x;
+
+	stream->write_function(stream, "{\"name\":");
+	conference_stream_json_str(stream, snap->name);
+	stream->write_function(stream, ",\"member_count\":%u,\"rate\":%u,\"uuid\":", snap->count, snap->rate);
+	conference_stream_json_str(stream, switch_str_nil(snap->uuid));
 
-	if (conference->agc_level) {
-		char tmp[30] = "";
-		switch_snprintf(tmp, sizeof(tmp), "%d", conference->agc_level);
-		switch_xml_set_attr_d_buf(x_conference, "agc", tmp);
+	for (x = 0; x < sizeof(conference_snap_cflags) / sizeof(conference_snap_cflags[0]); x++) {
+		stream->write_function(stream, ",\"%s\":%s", conference_snap_cflags[x].name, (snap->flags & conference_snap_cflags[x].flag) ? "true" : "false");
 	}
 
-	x_members = switch_xml_add_child_d(x_conference, "members", 0);
-	switch_assert(x_members);
+	stream->write_function(stream, ",\"recording\":%s,\"run_time\":%d,\"prefetch_starved\":%u,\"seq\":%u,\"version\":%u,\"agc\":%d,\"members\":[",
+						   snap->record_count > 0 ? "true" : "false", (int) (now - snap->run_time), snap->prefetch_starved, snap->seq, snap->version,
+						   snap->agc_level);
 
-	switch_mutex_lock(conference->member_mutex);
+	for (m = 0; m < snap->member_count; m++) {
+		conference_member_snap_t *msnap = &snap->members[m];
 
-	for (member = conference->members; member; member = member->next) {
-		switch_channel_t *channel;
-		switch_caller_profile_t *profile;
-		char *uuid;
-		//char *name;
-		uint32_t count = 0;
-		switch_xml_t x_tag;
-		int toff = 0;
-		char tmp[50] = "";
+		stream->write_function(stream, "%s{\"id\":%u,\"uuid\":", m ? "," : "", msnap->id);
+		conference_stream_json_str(stream, msnap->uuid);
+		stream->write_function(stream, ",\"caller_id_name\":");
+		conference_stream_json_str(stream, msnap->caller_id_name);
+		stream->write_function(stream, ",\"caller_id_number\":");
+		conference_stream_json_str(stream, msnap->caller_id_number);
+		stream->write_function(stream, ",\"join_time\":%d", (int) (now - msnap->join_time));
 
-		if (switch_test_flag(member, MFLAG_NOCHANNEL)) {
-			continue;
+		if (msnap->last_talking) {
+			stream->write_function(stream, ",\"last_talking\":%d", (int) (now - msnap->last_talking));
+		} else {
+			stream->write_function(stream, ",\"last_talking\":null");
 		}
 
-		uuid = switch_core_session_get_uuid(member->session);
-		channel = switch_core_session_get_channel(member->session);
-		profile = switch_channel_get_caller_profile(channel);
-		//name = switch_channel_get_name(channel);
-
+		stream->write_function(stream, ",\"energy\":%d,\"volume_in\":%d,\"volume_out\":%d,\"flags\":{",
+							   msnap->energy_level, msnap->volume_in_level, msnap->volume_out_level);
 
-		x_member = switch_xml_add_child_d(x_members, "member", moff++);
-		switch_assert(x_member);
+		for (x = 0; x < sizeof(conference_snap_mflags) / sizeof(conference_snap_mflags[0]); x++) {
+			stream->write_function(stream, "%s\"%s\":%s", x ? "," : "", conference_snap_mflags[x].name, conference_snap_mflag(msnap, (int) x) ? "true" : "false");
+		}
 
-		switch_snprintf(i, sizeof(i), "%d", member->id);
+		stream->write_function(stream, "},\"output_volume\":%d,\"input_volume\":%d,\"auto_adjusted_input_volume\":%d}",
+							   msnap->volume_out_level, msnap->agc_volume_in_level ? msnap->agc_volume_in_level : msnap->volume_in_level,
+							   msnap->agc_volume_in_level);
+	}
 
-		add_x_tag(x_member, "id", i, toff++);
-		add_x_tag(x_member, "uuid", uuid, toff++);
-		add_x_tag(x_member, "caller_id_name", profile->caller_id_name, toff++);
-		add_x_tag(x_member, "caller_id_number", profile->caller_id_number, toff++);
+	stream->write_function(stream, "]}");
+}
 
+/* Stream xml_list/json_list one room at a time from per-room snapshots, filtered and paged by name */
+static switch_status_t conference_list_stream(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv, switch_bool_t json)
+{
+	conference_list_filter_t filter;
+	conference_obj_t **list = NULL, *one[1];
+	uint32_t list_count, x, emitted = 0, seq;
+	int32_t last = -1;
+	switch_bool_t more = SWITCH_FALSE;
+	switch_time_t now;
 
-		switch_snprintf(i, sizeof(i), "%d", switch_epoch_time_now(NULL) - member->join_time);
-		add_x_tag(x_member, "join_time", i, toff++);
-		
-		switch_snprintf(i, sizeof(i), "%d", switch_epoch_time_now(NULL) - member->last_talking);
-		add_x_tag(x_member, "last_talking", member->last_talking ? i : "N/A", toff++);
+	conference_list_parse_filter(&filter, argc, argv);
 
-		switch_snprintf(i, sizeof(i), "%d", member->energy_level);
-		add_x_tag(x_member, "energy", i, toff++);
+	/* read the sequence before looking at any room so a change racing with us shows up next time */
+	seq = switch_atomic_read(&globals.list_seq);
 
-		switch_snprintf(i, sizeof(i), "%d", member->volume_in_level);
-		add_x_tag(x_member, "volume_in", i, toff++);
+	if (conference) {
+		one[0] = conference;
+		list = one;
+		list_count = 1;
+	} else {
+		list_count = conference_registry_snapshot(&list);
+		if (list_count > 1) {
+			qsort(list, list_count, sizeof(*list), conference_name_cmp);
+		}
+	}
 
-		switch_snprintf(i, sizeof(i), "%d", member->volume_out_level);
-		add_x_tag(x_member, "volume_out", i, toff++);
-		
-		x_flags = switch_xml_add_child_d(x_member, "flags", count++);
-		switch_assert(x_flags);
+	/* pick the page first so the header can carry the cursor for the next one */
+	for (x = 0; x < list_count; x++) {
+		if (!conference_list_filter_match(&filter, list[x])) {
+			continue;
+		}
+		if (filter.limit && emitted == filter.limit) {
+			more = SWITCH_TRUE;
+			break;
+		}
+		emitted++;
+		last = (int32_t) x;
+	}
 
-		x_tag = switch_xml_add_child_d(x_flags, "can_hear", count++);
-		switch_xml_set_txt_d(x_tag, switch_test_flag(member, MFLAG_CAN_HEAR) ? "true" : "false");
+	if (json) {
+		stream->write_function(stream, "{\"seq\":%u,\"next\":", seq);
+		if (more) {
+			conference_stream_json_str(stream, list[last]->name);
+		} else {
+			stream->write_function(stream, "null");
+		}
+		stream->write_function(stream, ",\"conferences\":[");
+	} else {
+		stream->write_function(stream, "<?xml version=\"1.0\"?>\n<conferences seq=\"%u\"", seq);
+		if (more) {
+			stream->write_function(stream, " next=\"");
+			conference_stream_xml_escaped(stream, list[last]->name);
+			stream->write_function(stream, "\"");
+		}
+		stream->write_function(stream, ">\n");
+	}
 
-		x_tag = switch_xml_add_child_d(x_flags, "can_speak", count++);
-		switch_xml_set_txt_d(x_tag, switch_test_flag(member, MFLAG_CAN_SPEAK) ? "true" : "false");
+	now = switch_epoch_time_now(NULL);
+	emitted = 0;
 
-		x_tag = switch_xml_add_child_d(x_flags, "mute_detect", count++);
-		switch_xml_set_txt_d(x_tag, switch_test_flag(member, MFLAG_MUTE_DETECT) ? "true" : "false");
+	for (x = 0; last >= 0 && x <= (uint32_t) last; x++) {
+		conference_snap_t snap;
 
-		x_tag = switch_xml_add_child_d(x_flags, "talking", count++);
-		switch_xml_set_txt_d(x_tag, switch_test_flag(member, MFLAG_TALKING) ? "true" : "false");
+		if (!conference_list_filter_match(&filter, list[x])) {
+			continue;
+		}
 
-		x_tag = switch_xml_add_child_d(x_flags, "has_video", count++);
-		switch_xml_set_txt_d(x_tag, switch_channel_test_flag(switch_core_session_get_channel(member->session), CF_VIDEO) ? "true" : "false");
+		conference_snap_take(list[x], &snap);
 
-		x_tag = switch_xml_add_child_d(x_flags, "has_floor", count++);
-		switch_xml_set_txt_d(x_tag, (member == member->conference->floor_holder) ? "true" : "false");
+		if (json) {
+			if (emitted) {
+				stream->write_function(stream, ",");
+			}
+			conference_snap_write_json(&snap, stream, now);
+		} else {
+			conference_snap_write_xml(&snap, stream, now);
+		}
 
-		x_tag = switch_xml_add_child_d(x_flags, "is_moderator", count++);
-		switch_xml_set_txt_d(x_tag, switch_test_flag(member, MFLAG_MOD) ? "true" : "false");
+		conference_snap_free(&snap);
+		emitted++;
+	}
 
-		x_tag = switch_xml_add_child_d(x_flags, "end_conference", count++);
-		switch_xml_set_txt_d(x_tag, switch_test_flag(member, MFLAG_ENDCONF) ? "true" : "false");
+	if (json) {
+		stream->write_function(stream, "]}\n");
+	} else {
+		stream->write_function(stream, "</conferences>\n");
+	}
 
-		switch_snprintf(tmp, sizeof(tmp), "%d", member->volume_out_level);
-		x_tag = add_x_tag(x_member, "output-volume", tmp, toff++);
+	if (!conference) {
+		conference_registry_release(list, list_count);
+	}
 
-		switch_snprintf(tmp, sizeof(tmp), "%d", member->agc_volume_in_level ? member->agc_volume_in_level : member->volume_in_level);
-		x_tag = add_x_tag(x_member, "input-volume", tmp, toff++);
+	return SWITCH_STATUS_SUCCESS;
+}
 
-		switch_snprintf(tmp, sizeof(tmp), "%d", member->agc_volume_in_level);
-		x_tag = add_x_tag(x_member, "auto-adjusted-input-volume", tmp, toff++);
+/* conference cache stats|flush */
+static switch_status_t conf_api_sub_cache(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv)
+{
+	if (argc < 2 || zstr(argv[1]) || !strcasecmp(argv[1], "stats")) {
+		if (!globals.prompt_mutex) {
+			stream->write_function(stream, "Prompt cache disabled\n");
+			return SWITCH_STATUS_SUCCESS;
+		}
 
+		switch_mutex_lock(globals.prompt_mutex);
+		stream->write_function(stream, "entries: %u\nbytes: %" SWITCH_SIZE_T_FMT "\nmax-bytes: %" SWITCH_SIZE_T_FMT "\n"
+							   "hits: %" SWITCH_UINT64_T_FMT "\nmisses: %" SWITCH_UINT64_T_FMT "\n"
+							   "evictions: %" SWITCH_UINT64_T_FMT "\nreloads: %" SWITCH_UINT64_T_FMT "\n",
+							   globals.prompt_count, globals.prompt_bytes, globals.prompt_max_bytes,
+							   globals.prompt_hits, globals.prompt_misses, globals.prompt_evictions, globals.prompt_reloads);
+		switch_mutex_unlock(globals.prompt_mutex);
+	} else if (!strcasecmp(argv[1], "flush")) {
+		conference_prompt_flush();
+		stream->write_function(stream, "+OK prompt cache flushed\n");
+	} else {
+		stream->write_function(stream, "-ERR usage: cache stats|flush\n");
 	}
 
-	switch_mutex_unlock(conference->member_mutex);
+	return SWITCH_STATUS_SUCCESS;
 }
+
 static switch_status_t conf_api_sub_xml_list(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv)
 {
-	int count = 0;
-	switch_hash_index_t *hi;
-	void *val;
-	switch_xml_t x_conference, x_conferences;
-	int off = 0;
-	char *ebuf;
-
-	x_conferences = switch_xml_new("conferences");
-	switch_assert(x_conferences);
+	return conference_list_stream(conference, stream, argc, argv, SWITCH_FALSE);
+}
 
-	if (conference == NULL) {
-		switch_mutex_lock(globals.hash_mutex);
-		for (hi = switch_hash_first(NULL, globals.conference_hash); hi; hi = switch_hash_next(hi)) {
-			switch_hash_this(hi, NULL, NULL, &val);
-			conference = (conference_obj_t *) val;
+static switch_status_t conf_api_sub_json_list(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv)
+{
+	return conference_list_stream(conference, stream, argc, argv, SWITCH_TRUE);
+}
 
-			x_conference = switch_xml_add_child_d(x_conferences, "conference", off++);
-			switch_assert(conference);
+/* conference <name> changes [<version>]: replay the delta ring, or ask for a resync when it has moved past <version> */
+static switch_status_t conf_api_sub_changes(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv)
+{
+	conference_delta_t deltas[CONF_DELTA_RING];
+	uint32_t since = 0, version, oldest, v, n = 0, x;
 
-			count++;
-			conference_xlist(conference, x_conference, off);
+	switch_assert(conference != NULL);
+	switch_assert(stream != NULL);
 
-		}
-		switch_mutex_unlock(globals.hash_mutex);
-	} else {
-		x_conference = switch_xml_add_child_d(x_conferences, "conference", off++);
-		switch_assert(conference);
-		count++;
-		conference_xlist(conference, x_conference, off);
+	if (argc > 2 && !zstr(argv[2])) {
+		since = (uint32_t) strtoul(argv[2], NULL, 10);
 	}
 
+	switch_mutex_lock(conference->delta_mutex);
+	version = conference->state_version;
+	oldest = version > CONF_DELTA_RING ? version - CONF_DELTA_RING + 1 : 1;
+
+	if (since > version || since + 1 < oldest) {
+		switch_mutex_unlock(conference->delta_mutex);
+		stream->write_function(stream, "-ERR resync %u\n", version);
+		return SWITCH_STATUS_SUCCESS;
+	}
 
-	ebuf = switch_xml_toxml(x_conferences, SWITCH_TRUE);
+	for (v = since + 1; v <= version; v++) {
+		deltas[n++] = conference->deltas[v % CONF_DELTA_RING];
+	}
+	switch_mutex_unlock(conference->delta_mutex);
 
-	stream->write_function(stream, "%s", ebuf);
+	stream->write_function(stream, "+OK %u\n", version);
 
-	switch_xml_free(x_conferences);
-	free(ebuf);
+	for (x = 0; x < n; x++) {
+		stream->write_function(stream, "%u %s %u %d %" SWITCH_TIME_T_FMT "\n", deltas[x].version, conference_delta_names[deltas[x].type],
+							   deltas[x].member_id, deltas[x].value, deltas[x].time);
+	}
 
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -4584,6 +6965,9 @@ static switch_status_t conf_api_sub_relate(conference_obj_t *conference, switch_
 				if (nohear) {
 					switch_clear_flag(rel, RFLAG_CAN_HEAR);
 				}
+				switch_mutex_lock(conference->member_mutex);
+				conference->relationship_version++;
+				switch_mutex_unlock(conference->member_mutex);
 				stream->write_function(stream, "ok %u->%u set\n", id, oid);
 			} else {
 				stream->write_function(stream, "error!\n");
@@ -4616,6 +7000,7 @@ static switch_status_t conf_api_sub_lock(conference_obj_t *conference, switch_st
 	}
 
 	switch_set_flag_locked(conference, CFLAG_LOCKED);
+	conference_state_delta(conference, CONF_DELTA_LOCK, NULL, 0);
 	stream->write_function(stream, "OK %s locked\n", argv[0]);
 	if (test_eflag(conference, EFLAG_LOCK) && switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 		conference_add_event_data(conference, event);
@@ -4638,6 +7023,7 @@ static switch_status_t conf_api_sub_unlock(conference_obj_t *conference, switch_
 	}
 
 	switch_clear_flag_locked(conference, CFLAG_LOCKED);
+	conference_state_delta(conference, CONF_DELTA_UNLOCK, NULL, 0);
 	stream->write_function(stream, "OK %s unlocked\n", argv[0]);
 	if (test_eflag(conference, EFLAG_UNLOCK) && switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_MAINT) == SWITCH_STATUS_SUCCESS) {
 		conference_add_event_data(conference, event);
@@ -4874,7 +7260,7 @@ static switch_status_t conf_api_sub_record(conference_obj_t *conference, switch_
 
 	stream->write_function(stream, "Record file %s\n", argv[2]);
 	conference->record_count++;
-	launch_conference_record_thread(conference, argv[2]);
+	conference_record_start(conference, argv[2]);
 	return SWITCH_STATUS_SUCCESS;
 }
 
@@ -4912,6 +7298,37 @@ static switch_status_t conf_api_sub_norecord(conference_obj_t *conference, switc
 	return SWITCH_STATUS_SUCCESS;
 }
 
+static switch_status_t conf_api_sub_record_tracks(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv)
+{
+	switch_assert(conference != NULL);
+	switch_assert(stream != NULL);
+
+	if (argc <= 2)
+		return SWITCH_STATUS_GENERR;
+
+	if (conference_tracks_start(conference, argv[2]) != SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "-ERR track recording already running\n");
+	} else {
+		stream->write_function(stream, "Record tracks %s\n", argv[2]);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t conf_api_sub_norecord_tracks(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv)
+{
+	switch_assert(conference != NULL);
+	switch_assert(stream != NULL);
+
+	if (conference_tracks_stop(conference) != SWITCH_STATUS_SUCCESS) {
+		stream->write_function(stream, "-ERR no track recording\n");
+	} else {
+		stream->write_function(stream, "Stop recording tracks\n");
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 static switch_status_t conf_api_sub_pin(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv)
 {
 	switch_assert(conference != NULL);
@@ -4961,8 +7378,8 @@ typedef enum {
 /* API Interface Function sub-commands */
 /* Entries in this list should be kept in sync with the enum above */
 static api_command_t conf_api_sub_commands[] = {
-	{"list", (void_fn_t) & conf_api_sub_list, CONF_API_SUB_ARGS_SPLIT, "list", "[delim <string>]"},
-	{"xml_list", (void_fn_t) & conf_api_sub_xml_list, CONF_API_SUB_ARGS_SPLIT, "xml_list", ""},
+	{"list", (void_fn_t) & conf_api_sub_list, CONF_API_SUB_ARGS_SPLIT, "list", "[delim <string>] [--room=<glob>] [--since=<seq>]"},
+	{"xml_list", (void_fn_t) & conf_api_sub_xml_list, CONF_API_SUB_ARGS_SPLIT, "xml_list", "[--room=<glob>] [--since=<seq>] [--after=<name>] [--limit=<n>]"},
 	{"energy", (void_fn_t) & conf_api_sub_energy, CONF_API_SUB_MEMBER_TARGET, "energy", "<member_id|all|last> [<newval>]"},
 	{"volume_in", (void_fn_t) & conf_api_sub_volume_in, CONF_API_SUB_MEMBER_TARGET, "volume_in", "<member_id|all|last> [<newval>]"},
 	{"volume_out", (void_fn_t) & conf_api_sub_volume_out, CONF_API_SUB_MEMBER_TARGET, "volume_out", "<member_id|all|last> [<newval>]"},
@@ -4990,6 +7407,10 @@ static api_command_t conf_api_sub_commands[] = {
 	{"enter_sound", (void_fn_t) & conf_api_sub_enter_sound, CONF_API_SUB_ARGS_SPLIT, "enter_sound", "on|off|none|file <filename>"},
 	{"pin", (void_fn_t) & conf_api_sub_pin, CONF_API_SUB_ARGS_SPLIT, "pin", "<pin#>"},
 	{"nopin", (void_fn_t) & conf_api_sub_pin, CONF_API_SUB_ARGS_SPLIT, "nopin", ""},
+	{"json_list", (void_fn_t) & conf_api_sub_json_list, CONF_API_SUB_ARGS_SPLIT, "json_list", "[--room=<glob>] [--since=<seq>] [--after=<name>] [--limit=<n>]"},
+	{"changes", (void_fn_t) & conf_api_sub_changes, CONF_API_SUB_ARGS_SPLIT, "changes", "[<version>]"},
+	{"record_tracks", (void_fn_t) & conf_api_sub_record_tracks, CONF_API_SUB_ARGS_SPLIT, "record_tracks", "<filename>"},
+	{"norecord_tracks", (void_fn_t) & conf_api_sub_norecord_tracks, CONF_API_SUB_ARGS_SPLIT, "norecord_tracks", ""},
 };
 
 #define CONFFUNCAPISIZE (sizeof(conf_api_sub_commands)/sizeof(conf_api_sub_commands[0]))
@@ -5144,10 +7565,6 @@ SWITCH_STANDARD_API(conf_api_main)
 		conference_obj_t *conference = NULL;
 
 		if ((conference = conference_find(argv[0]))) {
-			if (switch_thread_rwlock_tryrdlock(conference->rwlock) != SWITCH_STATUS_SUCCESS) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Read Lock Fail\n");
-				goto done;
-			}
 			if (argc >= 2) {
 				conf_api_dispatch(conference, stream, argc, argv, cmd, 1);
 			} else {
@@ -5161,6 +7578,10 @@ SWITCH_STANDARD_API(conf_api_main)
 				conf_api_sub_list(NULL, stream, argc, argv);
 			} else if (strcasecmp(argv[0], "xml_list") == 0) {
 				conf_api_sub_xml_list(NULL, stream, argc, argv);
+			} else if (strcasecmp(argv[0], "json_list") == 0) {
+				conf_api_sub_json_list(NULL, stream, argc, argv);
+			} else if (strcasecmp(argv[0], "cache") == 0) {
+				conf_api_sub_cache(NULL, stream, argc, argv);
 			} else if (strcasecmp(argv[0], "help") == 0 || strcasecmp(argv[0], "commands") == 0) {
 				stream->write_function(stream, "%s\n", api_syntax);
 			} else if (argv[1] && strcasecmp(argv[1], "dial") == 0) {
@@ -5188,7 +7609,6 @@ SWITCH_STANDARD_API(conf_api_main)
 		}
 	}
 
-  done:
 	switch_safe_free(lbuf);
 
 	return status;
@@ -5648,6 +8068,8 @@ static void clear_eflags(char *events, uint32_t *f)
 				*f &= ~EFLAG_FLOOR_CHANGE;
 			} else if (!strcmp(event, "record")) {
 				*f &= ~EFLAG_RECORD;
+			} else if (!strcmp(event, "talk-summary")) {
+				*f &= ~EFLAG_TALK_SUMMARY;
 			}
 
 			event = next;
@@ -5731,56 +8153,174 @@ static int setup_media(conference_member_t *member, conference_obj_t *conference
 		}
 
 
-		member->resample_out = switch_core_alloc(member->pool, member->frame_size);
-		member->resample_out_len = member->frame_size;
+		member->resample_out = switch_core_alloc(member->pool, member->frame_size);
+		member->resample_out_len = member->frame_size;
+
+		/* Setup an audio buffer for the resampled audio */
+		if (switch_buffer_create_dynamic(&member->resample_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, CONF_DBUFFER_MAX)
+			!= SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
+			goto done;
+		}
+	}
+
+
+	/* Setup a Signed Linear codec for writing audio. */
+	if (switch_core_codec_init(&member->write_codec,
+							   "L16",
+							   NULL,
+							   conference->rate,
+							   read_impl.microseconds_per_packet / 1000,
+							   1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, member->pool) == SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_DEBUG,
+						  "Raw Codec Activation Success L16@%uhz 1 channel %dms\n", conference->rate, read_impl.microseconds_per_packet / 1000);
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_DEBUG, "Raw Codec Activation Failed L16@%uhz 1 channel %dms\n",
+						  conference->rate, read_impl.microseconds_per_packet / 1000);
+		goto codec_done2;
+	}
+
+	/* Setup an audio buffer for the incoming audio */
+	if (switch_buffer_create_spsc(&member->audio_buffer, CONF_RING_SIZE) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
+		goto codec_done1;
+	}
+
+	/* Setup an audio buffer for the outgoing audio */
+	if (switch_buffer_create_spsc(&member->mux_buffer, CONF_RING_SIZE) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
+		goto codec_done1;
+	}
+
+	/* Members on the conference ptime get their mixed frames by reference instead of through the mux buffer */
+	if (!member->mux_queue && read_impl.microseconds_per_packet / 1000 == conference->interval) {
+		switch_queue_create(&member->mux_queue, CONF_MUX_QUEUE_LEN, member->pool);
+	}
+
+	return 0;
+
+  codec_done1:
+	switch_core_codec_destroy(&member->read_codec);
+  codec_done2:
+	switch_core_codec_destroy(&member->write_codec);
+  done:
+
+	return -1;
+
+
+}
+
+static void conference_cfg_cache_release(conference_cfg_cache_t *cache)
+{
+	switch_memory_pool_t *pool;
+
+	if (!cache || switch_atomic_dec(&cache->refs)) {
+		return;
+	}
+
+	switch_core_hash_destroy(&cache->profiles);
+	switch_core_hash_destroy(&cache->controls);
+	switch_xml_free(cache->xml);
+	pool = cache->pool;
+	switch_core_destroy_memory_pool(&pool);
+}
+
+/* Parse conference.conf once into a private copy and index its profiles and control groups */
+static conference_cfg_cache_t *conference_cfg_cache_build(void)
+{
+	conference_cfg_cache_t *cache;
+	switch_memory_pool_t *pool = NULL;
+	switch_xml_t cxml, cfg, xsection, xnode, xml;
+	const char *name;
+
+	if (!(cxml = switch_xml_open_cfg(global_cf_name, &cfg, NULL))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Open of %s failed\n", global_cf_name);
+		return NULL;
+	}
+
+	xml = switch_xml_dup(cfg);
+	switch_xml_free(cxml);
+
+	if (!xml) {
+		return NULL;
+	}
+
+	if (switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
+		switch_xml_free(xml);
+		return NULL;
+	}
+
+	cache = switch_core_alloc(pool, sizeof(*cache));
+	cache->pool = pool;
+	cache->xml = xml;
+	cache->refs = 1;
+	switch_core_hash_init(&cache->profiles, pool);
+	switch_core_hash_init(&cache->controls, pool);
+
+	if ((xsection = switch_xml_child(xml, "profiles"))) {
+		for (xnode = switch_xml_child(xsection, "profile"); xnode; xnode = xnode->next) {
+			if (!zstr(name = switch_xml_attr(xnode, "name")) && !switch_core_hash_find(cache->profiles, name)) {
+				switch_core_hash_insert(cache->profiles, name, xnode);
+			}
+		}
+	}
 
-		/* Setup an audio buffer for the resampled audio */
-		if (switch_buffer_create_dynamic(&member->resample_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, CONF_DBUFFER_MAX)
-			!= SWITCH_STATUS_SUCCESS) {
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
-			goto done;
+	if ((xsection = switch_xml_child(xml, "caller-controls"))) {
+		for (xnode = switch_xml_child(xsection, "group"); xnode; xnode = xnode->next) {
+			if (!zstr(name = switch_xml_attr(xnode, "name")) && !switch_core_hash_find(cache->controls, name)) {
+				switch_core_hash_insert(cache->controls, name, xnode);
+			}
 		}
 	}
 
+	return cache;
+}
 
-	/* Setup a Signed Linear codec for writing audio. */
-	if (switch_core_codec_init(&member->write_codec,
-							   "L16",
-							   NULL,
-							   conference->rate,
-							   read_impl.microseconds_per_packet / 1000,
-							   1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, member->pool) == SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_DEBUG,
-						  "Raw Codec Activation Success L16@%uhz 1 channel %dms\n", conference->rate, read_impl.microseconds_per_packet / 1000);
-	} else {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_DEBUG, "Raw Codec Activation Failed L16@%uhz 1 channel %dms\n",
-						  conference->rate, read_impl.microseconds_per_packet / 1000);
-		goto codec_done2;
-	}
+/* Take a reference on the current config snapshot, NULL when caching is off */
+static conference_cfg_cache_t *conference_cfg_cache_get(void)
+{
+	conference_cfg_cache_t *cache = NULL;
 
-	/* Setup an audio buffer for the incoming audio */
-	if (switch_buffer_create_dynamic(&member->audio_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, CONF_DBUFFER_MAX) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
-		goto codec_done1;
+	if (!globals.cfg_rwlock) {
+		return NULL;
 	}
 
-	/* Setup an audio buffer for the outgoing audio */
-	if (switch_buffer_create_dynamic(&member->mux_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, CONF_DBUFFER_MAX) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
-		goto codec_done1;
+	switch_thread_rwlock_rdlock(globals.cfg_rwlock);
+	if ((cache = globals.cfg_cache)) {
+		switch_atomic_inc(&cache->refs);
 	}
+	switch_thread_rwlock_unlock(globals.cfg_rwlock);
 
-	return 0;
+	return cache;
+}
 
-  codec_done1:
-	switch_core_codec_destroy(&member->read_codec);
-  codec_done2:
-	switch_core_codec_destroy(&member->write_codec);
-  done:
+/* Swap in a freshly parsed snapshot; joins holding the old one keep it until they let go */
+static void conference_cfg_cache_refresh(void)
+{
+	conference_cfg_cache_t *cache, *old;
 
-	return -1;
+	if (!globals.cfg_rwlock || !(cache = conference_cfg_cache_build())) {
+		return;
+	}
 
+	switch_thread_rwlock_wrlock(globals.cfg_rwlock);
+	old = globals.cfg_cache;
+	globals.cfg_cache = cache;
+	switch_thread_rwlock_unlock(globals.cfg_rwlock);
 
+	conference_cfg_cache_release(old);
+}
+
+static void reload_event_handler(switch_event_t *event)
+{
+	conference_cfg_cache_refresh();
+
+	if (globals.prompt_mutex) {
+		/* prompts are checked against their files on their next play */
+		switch_mutex_lock(globals.prompt_mutex);
+		globals.prompt_stale = switch_epoch_time_now(NULL);
+		switch_mutex_unlock(globals.prompt_mutex);
+	}
 }
 
 #define validate_pin(buf, pin, mpin) \
@@ -5805,6 +8345,7 @@ SWITCH_STANDARD_APP(conference_function)
 	char *bridgeto = NULL;
 	char *profile_name = NULL;
 	switch_xml_t cxml = NULL, cfg = NULL, profiles = NULL;
+	conference_cfg_cache_t *cfg_cache = NULL;
 	const char *flags_str;
 	member_flag_t mflags = 0;
 	switch_core_session_message_t msg = { 0 };
@@ -5909,32 +8450,40 @@ SWITCH_STANDARD_APP(conference_function)
 	switch_event_add_header_string(params, SWITCH_STACK_BOTTOM, "conf_name", conf_name);
 	switch_event_add_header_string(params, SWITCH_STACK_BOTTOM, "profile_name", profile_name);
 
-	/* Open the config from the xml registry */
-	if (!(cxml = switch_xml_open_cfg(global_cf_name, &cfg, params))) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Open of %s failed\n", global_cf_name);
-		goto done;
+	/* Use the cached profile when we have one, only hit the xml registry for profiles it doesn't know */
+	if ((cfg_cache = conference_cfg_cache_get())) {
+		xml_cfg.profile = switch_core_hash_find(cfg_cache->profiles, profile_name);
 	}
 
-	if ((profiles = switch_xml_child(cfg, "profiles"))) {
-		xml_cfg.profile = switch_xml_find_child(profiles, "profile", "name", profile_name);
+	if (!xml_cfg.profile) {
+		/* Open the config from the xml registry */
+		if (!(cxml = switch_xml_open_cfg(global_cf_name, &cfg, params))) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Open of %s failed\n", global_cf_name);
+			goto done;
+		}
+
+		if ((profiles = switch_xml_child(cfg, "profiles"))) {
+			xml_cfg.profile = switch_xml_find_child(profiles, "profile", "name", profile_name);
+		}
 	}
 
 	/* if this is a bridging call, and it's not a duplicate, build a */
 	/* conference object, and skip pin handling, and locked checking */
 
-	if (!locked) {
-		switch_mutex_lock(globals.setup_mutex);
-		locked = 1;
-	}
-
 	if (isbr) {
 		char *uuid = switch_core_session_get_uuid(session);
 
+		if (!locked) {
+			switch_mutex_lock(globals.setup_mutex);
+			locked = 1;
+		}
+
 		if (!strcmp(conf_name, "_uuid_")) {
 			conf_name = uuid;
 		}
 
 		if ((conference = conference_find(conf_name))) {
+			rl++;
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Conference %s already exists!\n", conf_name);
 			goto done;
 		}
@@ -5973,13 +8522,22 @@ SWITCH_STANDARD_APP(conference_function)
 			enforce_security = switch_true(pvar);
 		}
 
-		if ((conference = conference_find(conf_name))) {
-			if (locked) {
+		/* joining a running conference needs no setup lock, only creating one does */
+		if (!(conference = conference_find(conf_name))) {
+			switch_mutex_lock(globals.setup_mutex);
+			locked = 1;
+
+			if ((conference = conference_find(conf_name))) {
 				switch_mutex_unlock(globals.setup_mutex);
 				locked = 0;
 			}
 		}
 
+		/* conference_find hands the room back already read locked */
+		if (conference) {
+			rl++;
+		}
+
 		/* if the conference exists, get the pointer to it */
 		if (!conference) {
 			const char *max_members_str;
@@ -6033,11 +8591,13 @@ SWITCH_STANDARD_APP(conference_function)
 		}
 
 		/* acquire a read lock on the thread so it can't leave without us */
-		if (switch_thread_rwlock_tryrdlock(conference->rwlock) != SWITCH_STATUS_SUCCESS) {
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_CRIT, "Read Lock Fail\n");
-			goto done;
+		if (!rl) {
+			if (switch_thread_rwlock_tryrdlock(conference->rwlock) != SWITCH_STATUS_SUCCESS) {
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_CRIT, "Read Lock Fail\n");
+				goto done;
+			}
+			rl++;
 		}
-		rl++;
 
 		if (zstr(dpin) && conference->pin) {
 			dpin = conference->pin;
@@ -6173,6 +8733,11 @@ SWITCH_STANDARD_APP(conference_function)
 		cxml = NULL;
 	}
 
+	if (cfg_cache) {
+		conference_cfg_cache_release(cfg_cache);
+		cfg_cache = NULL;
+	}
+
 	/* if we're using "bridge:" make an outbound call and bridge it in */
 	if (!zstr(bridgeto) && strcasecmp(bridgeto, "none")) {
 		switch_call_cause_t cause;
@@ -6210,6 +8775,7 @@ SWITCH_STANDARD_APP(conference_function)
 	switch_mutex_init(&member.read_mutex, SWITCH_MUTEX_NESTED, member.pool);
 	switch_mutex_init(&member.audio_in_mutex, SWITCH_MUTEX_NESTED, member.pool);
 	switch_mutex_init(&member.audio_out_mutex, SWITCH_MUTEX_NESTED, member.pool);
+	switch_mutex_init(&member.event_mutex, SWITCH_MUTEX_NESTED, member.pool);
 	switch_thread_rwlock_create(&member.rwlock, member.pool);
 
 	/* Install our Signed Linear codec so we get the audio in that format */
@@ -6248,108 +8814,426 @@ SWITCH_STANDARD_APP(conference_function)
 	msg.message_id = SWITCH_MESSAGE_INDICATE_UNBRIDGE;
 	switch_core_session_receive_message(session, &msg);
 
-	/* Remove the caller from the conference */
-	conference_del_member(member.conference, &member);
+	/* Remove the caller from the conference */
+	conference_del_member(member.conference, &member);
+
+	/* Put the original codec back */
+	switch_core_session_set_read_codec(member.session, NULL);
+
+	/* Clean Up. */
+
+  done:
+
+	if (locked) {
+		switch_mutex_unlock(globals.setup_mutex);
+		locked = 0;
+	}
+
+	if (member.read_resampler) {
+		switch_resample_destroy(&member.read_resampler);
+	}
+
+	switch_event_destroy(&params);
+	switch_buffer_destroy(&member.resample_buffer);
+	switch_buffer_destroy(&member.audio_buffer);
+	switch_buffer_destroy(&member.mux_buffer);
+
+	if (member.event_block) {
+		switch_event_destroy(&member.event_block);
+	}
+
+	if (conference) {
+		switch_mutex_lock(conference->mutex);
+		if (switch_test_flag(conference, CFLAG_DYNAMIC) && conference->count == 0) {
+			switch_set_flag_locked(conference, CFLAG_DESTRUCT);
+		}
+		switch_mutex_unlock(conference->mutex);
+	}
+
+	/* Release the config registry handle */
+	if (cxml) {
+		switch_xml_free(cxml);
+	}
+
+	if (cfg_cache) {
+		conference_cfg_cache_release(cfg_cache);
+	}
+
+	if (conference && switch_test_flag(&member, MFLAG_KICKED) && conference->kicked_sound) {
+		char *toplay = NULL;
+		char *dfile = NULL;
+		char *expanded = NULL;
+
+		if (!strncasecmp(conference->kicked_sound, "say:", 4)) {
+			if (conference->tts_engine && conference->tts_voice) {
+				switch_ivr_speak_text(session, conference->tts_engine, conference->tts_voice, conference->kicked_sound + 4, NULL);
+			}
+		} else {
+			if ((expanded = switch_channel_expand_variables(switch_core_session_get_channel(session), conference->kicked_sound)) != conference->kicked_sound) {
+				toplay = expanded;
+			} else {
+				expanded = NULL;
+				toplay = conference->kicked_sound; 
+			}
+
+			if (!switch_is_file_path(toplay) && conference->sound_prefix) {
+				dfile = switch_mprintf("%s%s%s", conference->sound_prefix, SWITCH_PATH_SEPARATOR, toplay);
+				switch_assert(dfile);
+				toplay = dfile;
+			}
+
+			switch_ivr_play_file(session, NULL, toplay, NULL);
+			switch_safe_free(dfile);
+			switch_safe_free(expanded);
+		}
+	}
+
+	switch_core_session_reset(session, SWITCH_TRUE, SWITCH_TRUE);
+
+	/* release the readlock */
+	if (rl) {
+		switch_thread_rwlock_unlock(conference->rwlock);
+	}
+
+	switch_channel_set_variable(channel, "last_transfered_conference", NULL);
+}
+
+/* Create a thread for the conference and launch it */
+static void launch_conference_thread(conference_obj_t *conference)
+{
+	switch_thread_t *thread;
+	switch_threadattr_t *thd_attr = NULL;
+
+	switch_set_flag_locked(conference, CFLAG_RUNNING);
+
+	/* hand the conference to the shared mixer pool if there is one and it ticks at a compatible rate */
+	if (globals.mixer_threads && globals.mixer_clock_running && !(conference->interval % globals.mixer_interval)) {
+		conference->mixer_state = switch_core_alloc(conference->pool, sizeof(*conference->mixer_state));
+		conference_mix_state_init(conference, conference->mixer_state);
+
+		switch_atomic_inc(&globals.threads);
+
+		switch_mutex_lock(globals.mixer_mutex);
+		conference->mixer_next = globals.mixer_conferences;
+		globals.mixer_conferences = conference;
+		switch_mutex_unlock(globals.mixer_mutex);
+		return;
+	}
+
+	switch_threadattr_create(&thd_attr, conference->pool);
+	switch_threadattr_detach_set(thd_attr, 1);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	switch_thread_create(&thread, thd_attr, conference_thread_run, conference, conference->pool);
+}
+
+static switch_thread_t *launch_thread_detached(switch_thread_start_t func, switch_memory_pool_t *pool, void *data)
+{
+	switch_thread_t *thread = NULL;
+	switch_threadattr_t *thd_attr = NULL;
+
+	switch_threadattr_create(&thd_attr, pool);
+	switch_threadattr_detach_set(thd_attr, 1);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+
+	if (switch_thread_create(&thread, thd_attr, func, data, pool) != SWITCH_STATUS_SUCCESS) {
+		return NULL;
+	}
+	
+	return thread;
+}
+
+static void *SWITCH_THREAD_FUNC conference_mixer_finish_run(switch_thread_t *thread, void *obj)
+{
+	conference_obj_t *conference = (conference_obj_t *) obj;
+
+	conference_thread_finish(conference, conference->mixer_state);
+
+	return NULL;
+}
+
+/* Mix one tick of a pooled conference, the clock never hands the same conference to two workers at once */
+static void conference_mixer_run(conference_obj_t *conference)
+{
+	if (!globals.running || switch_test_flag(conference, CFLAG_DESTRUCT)) {
+		conference->mixer_done = 1;
+	} else {
+		conference_mix_tick(conference, conference->mixer_state);
+
+		/* make up for the ticks the clock owed us while we were still mixing */
+		while (switch_atomic_read(&conference->mixer_owed) && globals.running && !switch_test_flag(conference, CFLAG_DESTRUCT)) {
+			switch_atomic_dec(&conference->mixer_owed);
+			conference_mix_tick(conference, conference->mixer_state);
+		}
+	}
+
+	switch_atomic_set(&conference->mixer_busy, 0);
+}
+
+static switch_status_t conference_mixer_next(conference_mixer_worker_t *worker, void **pop)
+{
+	uint32_t x;
+
+	if (switch_queue_trypop(worker->queue, pop) == SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	for (x = 1; x < globals.mixer_threads; x++) {
+		if (switch_queue_trypop(globals.mixer_workers[(worker->id + x) % globals.mixer_threads].queue, pop) == SWITCH_STATUS_SUCCESS) {
+			return SWITCH_STATUS_SUCCESS;
+		}
+	}
+
+	return SWITCH_STATUS_FALSE;
+}
+
+static void *SWITCH_THREAD_FUNC conference_mixer_worker_run(switch_thread_t *thread, void *obj)
+{
+	conference_mixer_worker_t *worker = (conference_mixer_worker_t *) obj;
+	void *pop;
+
+	while (globals.mixer_clock_running) {
+		if (switch_queue_pop_timeout(worker->queue, &pop, 100000) != SWITCH_STATUS_SUCCESS) {
+			continue;
+		}
+
+		do {
+			conference_mixer_run((conference_obj_t *) pop);
+		} while (conference_mixer_next(worker, &pop) == SWITCH_STATUS_SUCCESS);
+	}
+
+	switch_atomic_dec(&globals.threads);
+
+	return NULL;
+}
+
+/* The single timing source for every pooled conference */
+static void *SWITCH_THREAD_FUNC conference_mixer_clock_run(switch_thread_t *thread, void *obj)
+{
+	uint32_t w = 0;
+
+	for (;;) {
+		conference_obj_t *conference, *next, *last = NULL;
+		int busy;
+
+		if (switch_core_timer_next(&globals.mixer_timer) != SWITCH_STATUS_SUCCESS) {
+			switch_cond_next();
+		}
+
+		switch_mutex_lock(globals.mixer_mutex);
+		for (conference = globals.mixer_conferences; conference; conference = next) {
+			next = conference->mixer_next;
+
+			/* still mixing its last frame, the frames it misses meanwhile are owed to it up to CONF_MIXER_MAX_OWED */
+			if (switch_atomic_read(&conference->mixer_busy)) {
+				if (++conference->mixer_ticks >= conference->interval / globals.mixer_interval) {
+					conference->mixer_ticks = 0;
+					if (switch_atomic_read(&conference->mixer_owed) < CONF_MIXER_MAX_OWED) {
+						switch_atomic_inc(&conference->mixer_owed);
+						conference->mixer_late++;
+					} else {
+						conference->mixer_skipped++;
+					}
+				}
+				last = conference;
+				continue;
+			}
+
+			if (conference->mixer_done) {
+				if (last) {
+					last->mixer_next = next;
+				} else {
+					globals.mixer_conferences = next;
+				}
+				launch_thread_detached(conference_mixer_finish_run, conference->pool, conference);
+				continue;
+			}
+
+			last = conference;
+
+			if (++conference->mixer_ticks < conference->interval / globals.mixer_interval) {
+				continue;
+			}
+
+			conference->mixer_ticks = 0;
+			switch_atomic_set(&conference->mixer_busy, 1);
+
+			if (switch_queue_trypush(globals.mixer_workers[w].queue, conference) != SWITCH_STATUS_SUCCESS) {
+				switch_atomic_set(&conference->mixer_busy, 0);
+			}
+
+			w = (w + 1) % globals.mixer_threads;
+		}
+		busy = globals.running || globals.mixer_conferences;
+		switch_mutex_unlock(globals.mixer_mutex);
+
+		if (!busy) {
+			break;
+		}
+	}
+
+	globals.mixer_clock_running = 0;
+	switch_core_timer_destroy(&globals.mixer_timer);
 
-	/* Put the original codec back */
-	switch_core_session_set_read_codec(member.session, NULL);
+	switch_atomic_dec(&globals.threads);
 
-	/* Clean Up. */
+	return NULL;
+}
 
-  done:
+/* Start the shared mixer pool if the settings ask for one */
+static void launch_conference_mixer_pool(void)
+{
+	uint32_t x;
 
-	if (locked) {
-		switch_mutex_unlock(globals.setup_mutex);
-		locked = 0;
+	if (!globals.mixer_threads) {
+		return;
 	}
 
-	if (member.read_resampler) {
-		switch_resample_destroy(&member.read_resampler);
+	if (switch_core_timer_init(&globals.mixer_timer, globals.mixer_timer_name, globals.mixer_interval,
+							   switch_samples_per_packet(8000, globals.mixer_interval), globals.conference_pool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Mixer pool timer setup failed, every conference will run its own thread\n");
+		globals.mixer_threads = 0;
+		return;
 	}
 
-	switch_event_destroy(&params);
-	switch_buffer_destroy(&member.resample_buffer);
-	switch_buffer_destroy(&member.audio_buffer);
-	switch_buffer_destroy(&member.mux_buffer);
+	switch_mutex_init(&globals.mixer_mutex, SWITCH_MUTEX_NESTED, globals.conference_pool);
+	globals.mixer_workers = switch_core_alloc(globals.conference_pool, sizeof(*globals.mixer_workers) * globals.mixer_threads);
+	globals.mixer_clock_running = 1;
 
-	if (conference) {
-		switch_mutex_lock(conference->mutex);
-		if (switch_test_flag(conference, CFLAG_DYNAMIC) && conference->count == 0) {
-			switch_set_flag_locked(conference, CFLAG_DESTRUCT);
-		}
-		switch_mutex_unlock(conference->mutex);
-	}
+	switch_atomic_add(&globals.threads, globals.mixer_threads + 1);
 
-	/* Release the config registry handle */
-	if (cxml) {
-		switch_xml_free(cxml);
+	for (x = 0; x < globals.mixer_threads; x++) {
+		globals.mixer_workers[x].id = x;
+		switch_queue_create(&globals.mixer_workers[x].queue, SWITCH_CORE_QUEUE_LEN, globals.conference_pool);
+		launch_thread_detached(conference_mixer_worker_run, globals.conference_pool, &globals.mixer_workers[x]);
 	}
 
-	if (conference && switch_test_flag(&member, MFLAG_KICKED) && conference->kicked_sound) {
-		char *toplay = NULL;
-		char *dfile = NULL;
-		char *expanded = NULL;
+	launch_thread_detached(conference_mixer_clock_run, globals.conference_pool, NULL);
 
-		if (!strncasecmp(conference->kicked_sound, "say:", 4)) {
-			if (conference->tts_engine && conference->tts_voice) {
-				switch_ivr_speak_text(session, conference->tts_engine, conference->tts_voice, conference->kicked_sound + 4, NULL);
-			}
-		} else {
-			if ((expanded = switch_channel_expand_variables(switch_core_session_get_channel(session), conference->kicked_sound)) != conference->kicked_sound) {
-				toplay = expanded;
-			} else {
-				expanded = NULL;
-				toplay = conference->kicked_sound; 
-			}
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Mixer pool started with %u threads on a %ums %s timer\n",
+					  globals.mixer_threads, globals.mixer_interval, globals.mixer_timer_name);
+}
 
-			if (!switch_is_file_path(toplay) && conference->sound_prefix) {
-				dfile = switch_mprintf("%s%s%s", conference->sound_prefix, SWITCH_PATH_SEPARATOR, toplay);
-				switch_assert(dfile);
-				toplay = dfile;
-			}
+/* Decode conference file and speech nodes ahead of the mixers */
+static void *SWITCH_THREAD_FUNC conference_prefetch_run(switch_thread_t *thread, void *obj)
+{
+	void *pop;
 
-			switch_ivr_play_file(session, NULL, toplay, NULL);
-			switch_safe_free(dfile);
-			switch_safe_free(expanded);
+	for (;;) {
+		conference_file_node_t *fnode;
+		conference_obj_t *conference;
+
+		if (switch_queue_pop_timeout(globals.prefetch_queue, &pop, 100000) != SWITCH_STATUS_SUCCESS) {
+			if (!globals.running) {
+				break;
+			}
+			continue;
 		}
-	}
 
-	switch_core_session_reset(session, SWITCH_TRUE, SWITCH_TRUE);
+		fnode = (conference_file_node_t *) pop;
+		conference = fnode->conference;
 
-	/* release the readlock */
-	if (rl) {
-		switch_thread_rwlock_unlock(conference->rwlock);
+		if (globals.running) {
+			conference_file_node_fill(fnode);
+		}
+
+		switch_atomic_set(&fnode->queued, 0);
+		conference_file_node_release(fnode);
+		switch_atomic_dec(&conference->prefetch_pending);
 	}
 
-	switch_channel_set_variable(channel, "last_transfered_conference", NULL);
+	switch_atomic_dec(&globals.threads);
+
+	return NULL;
 }
 
-/* Create a thread for the conference and launch it */
-static void launch_conference_thread(conference_obj_t *conference)
+/* Start the playback prefetch readers */
+static void launch_conference_prefetch_pool(void)
 {
-	switch_thread_t *thread;
-	switch_threadattr_t *thd_attr = NULL;
+	uint32_t x;
 
-	switch_set_flag_locked(conference, CFLAG_RUNNING);
-	switch_threadattr_create(&thd_attr, conference->pool);
-	switch_threadattr_detach_set(thd_attr, 1);
-	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
-	switch_mutex_lock(globals.hash_mutex);
-	switch_mutex_unlock(globals.hash_mutex);
-	switch_thread_create(&thread, thd_attr, conference_thread_run, conference, conference->pool);
+	if (!globals.prefetch_threads) {
+		return;
+	}
+
+	switch_queue_create(&globals.prefetch_queue, SWITCH_CORE_QUEUE_LEN, globals.conference_pool);
+
+	switch_atomic_add(&globals.threads, globals.prefetch_threads);
+
+	for (x = 0; x < globals.prefetch_threads; x++) {
+		launch_thread_detached(conference_prefetch_run, globals.conference_pool, NULL);
+	}
 }
 
-static switch_thread_t *launch_thread_detached(switch_thread_start_t func, switch_memory_pool_t *pool, void *data)
+/* Read the global <settings> section */
+static void conference_load_settings(void)
 {
-	switch_thread_t *thread;
-	switch_threadattr_t *thd_attr = NULL;
+	switch_xml_t cxml, cfg, settings, param;
 
-	switch_threadattr_create(&thd_attr, pool);
-	switch_threadattr_detach_set(thd_attr, 1);
-	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
-	switch_thread_create(&thread, thd_attr, func, data, pool);
-	
-	return thread;
+	globals.mixer_threads = 0;
+	globals.mixer_interval = 10;
+	globals.mixer_timer_name = "soft";
+	globals.prefetch_threads = 2;
+	globals.prompt_max_bytes = 16 * 1024 * 1024;
+	globals.profile_cache = SWITCH_FALSE;
+	globals.rec_writer_threads = 2;
+
+	if (!(cxml = switch_xml_open_cfg(global_cf_name, &cfg, NULL))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Open of %s failed\n", global_cf_name);
+		return;
+	}
+
+	if ((settings = switch_xml_child(cfg, "settings"))) {
+		for (param = switch_xml_child(settings, "param"); param; param = param->next) {
+			char *var = (char *) switch_xml_attr_soft(param, "name");
+			char *val = (char *) switch_xml_attr_soft(param, "value");
+
+			if (!strcasecmp(var, "mixer-threads") && !zstr(val)) {
+				if (!strcasecmp(val, "auto")) {
+#ifdef WIN32
+					SYSTEM_INFO sysinfo;
+					GetSystemInfo(&sysinfo);
+					globals.mixer_threads = sysinfo.dwNumberOfProcessors;
+#else
+					globals.mixer_threads = (uint32_t) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+				} else {
+					globals.mixer_threads = atoi(val);
+				}
+			} else if (!strcasecmp(var, "mixer-interval") && !zstr(val)) {
+				int tmp = atoi(val);
+				if (tmp > 0 && !(tmp % 5)) {
+					globals.mixer_interval = tmp;
+				} else {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "mixer-interval must be a multiple of 5\n");
+				}
+			} else if (!strcasecmp(var, "mixer-timer-name") && !zstr(val)) {
+				globals.mixer_timer_name = switch_core_strdup(globals.conference_pool, val);
+			} else if (!strcasecmp(var, "prefetch-threads") && !zstr(val)) {
+				int tmp = atoi(val);
+				if (tmp >= 0 && tmp <= 64) {
+					globals.prefetch_threads = tmp;
+				} else {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "prefetch-threads must be between 0 and 64\n");
+				}
+			} else if (!strcasecmp(var, "prompt-cache-size") && !zstr(val)) {
+				int tmp = atoi(val);
+				if (tmp >= 0) {
+					globals.prompt_max_bytes = (switch_size_t) tmp * 1024;
+				}
+			} else if (!strcasecmp(var, "profile-cache") && !zstr(val)) {
+				globals.profile_cache = switch_true(val);
+			} else if (!strcasecmp(var, "record-writer-threads") && !zstr(val)) {
+				int tmp = atoi(val);
+				if (tmp >= 1 && tmp <= 64) {
+					globals.rec_writer_threads = tmp;
+				} else {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "record-writer-threads must be between 1 and 64\n");
+				}
+			}
+		}
+	}
+
+	switch_xml_free(cxml);
 }
 
 /* Create a video thread for the conference and launch it */
@@ -6377,35 +9261,6 @@ static void launch_conference_video_bridge_thread(conference_member_t *member_a,
 	member_a->conference->video_running = 1;
 }
 
-static void launch_conference_record_thread(conference_obj_t *conference, char *path)
-{
-	switch_thread_t *thread;
-	switch_threadattr_t *thd_attr = NULL;
-	switch_memory_pool_t *pool;
-	conference_record_t *rec;
-
-	/* Setup a memory pool to use. */
-	if (switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Pool Failure\n");
-	}
-
-	/* Create a node object */
-	if (!(rec = switch_core_alloc(pool, sizeof(*rec)))) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Alloc Failure\n");
-		switch_core_destroy_memory_pool(&pool);
-		return;
-	}
-
-	rec->conference = conference;
-	rec->path = switch_core_strdup(pool, path);
-	rec->pool = pool;
-
-	switch_threadattr_create(&thd_attr, rec->pool);
-	switch_threadattr_detach_set(thd_attr, 1);
-	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
-	switch_thread_create(&thread, thd_attr, conference_record_thread_run, rec, rec->pool);
-}
-
 static switch_status_t chat_send(switch_event_t *message_event)
 {
 	char name[512] = "", *p, *lbuf = NULL;
@@ -6454,10 +9309,12 @@ static switch_status_t chat_send(switch_event_t *message_event)
 			conference_list_pretty(conference, &stream);
 			/* provide help */
 		} else {
+			switch_thread_rwlock_unlock(conference->rwlock);
 			return SWITCH_STATUS_SUCCESS;
 		}
 	}
 
+	switch_thread_rwlock_unlock(conference->rwlock);
 	switch_safe_free(lbuf);
 
 	switch_core_chat_send_args(proto, CONF_CHAT_PROTO, to, hint && strchr(hint, '/') ? hint : from, "", stream.data, NULL, NULL);
@@ -6466,23 +9323,163 @@ static switch_status_t chat_send(switch_event_t *message_event)
 	return SWITCH_STATUS_SUCCESS;
 }
 
-static conference_obj_t *conference_find(char *name)
+static conference_registry_shard_t *conference_registry_shard(const char *name)
+{
+	const unsigned char *p;
+	uint32_t h = 5381;
+
+	for (p = (const unsigned char *) name; *p; p++) {
+		h = (h << 5) + h + *p;
+	}
+
+	return &globals.registry[h % CONF_REGISTRY_SHARDS];
+}
+
+static void conference_registry_add(conference_obj_t *conference)
+{
+	conference_registry_shard_t *shard = conference_registry_shard(conference->name);
+
+	conference_touch(conference);
+
+	switch_thread_rwlock_wrlock(shard->rwlock);
+	switch_set_flag(conference, CFLAG_INHASH);
+	switch_core_hash_insert(shard->hash, conference->name, conference);
+	switch_thread_rwlock_unlock(shard->rwlock);
+}
+
+static void conference_registry_del(conference_obj_t *conference)
+{
+	conference_registry_shard_t *shard = conference_registry_shard(conference->name);
+
+	switch_thread_rwlock_wrlock(shard->rwlock);
+	if (switch_test_flag(conference, CFLAG_INHASH) && switch_core_hash_find(shard->hash, conference->name) == conference) {
+		switch_core_hash_delete(shard->hash, conference->name);
+	}
+	switch_clear_flag(conference, CFLAG_INHASH);
+	switch_thread_rwlock_unlock(shard->rwlock);
+}
+
+/* Stamp a room as changed for --since. The stamp is taken before the global bump,
+   so a list that read the sequence first always sees it as newer */
+static void conference_touch(conference_obj_t *conference)
+{
+	conference->list_seq = switch_atomic_read(&globals.list_seq) + 1;
+	switch_atomic_inc(&globals.list_seq);
+}
+
+/* Record a state change: bump the room version, keep the delta in the ring and publish it to state subscribers */
+static void conference_state_delta(conference_obj_t *conference, conference_delta_type_t type, conference_member_t *member, int32_t value)
+{
+	conference_delta_t *delta;
+	uint32_t version;
+	switch_event_t *event = NULL;
+
+	if (!conference || !conference->delta_mutex) {
+		return;
+	}
+
+	if (test_eflag(conference, EFLAG_STATE_DELTA) &&
+		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CONF_EVENT_STATE) == SWITCH_STATUS_SUCCESS) {
+		conference_add_event_data(conference, event);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Action", conference_delta_names[type]);
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Member-ID", "%u", member ? member->id : 0);
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Delta-Value", "%d", value);
+	}
+
+	switch_mutex_lock(conference->delta_mutex);
+	version = ++conference->state_version;
+	delta = &conference->deltas[version % CONF_DELTA_RING];
+	delta->version = version;
+	delta->type = type;
+	delta->member_id = member ? member->id : 0;
+	delta->value = value;
+	delta->time = switch_micro_time_now();
+
+	/* queued under the lock so the events go out in version order */
+	if (event) {
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "State-Version", "%u", version);
+		switch_event_fire(&event);
+	}
+	switch_mutex_unlock(conference->delta_mutex);
+
+	conference_touch(conference);
+}
+
+/* Find a running conference; it comes back read locked and the caller must unlock conference->rwlock */
+static conference_obj_t *conference_find(const char *name)
 {
+	conference_registry_shard_t *shard = conference_registry_shard(name);
 	conference_obj_t *conference;
+	int stale = 0;
 
-	switch_mutex_lock(globals.hash_mutex);
-	if ((conference = switch_core_hash_find(globals.conference_hash, name))) {
+	switch_thread_rwlock_rdlock(shard->rwlock);
+	if ((conference = switch_core_hash_find(shard->hash, name))) {
 		if (switch_test_flag(conference, CFLAG_DESTRUCT)) {
-			switch_core_hash_delete(globals.conference_hash, conference->name);
-			switch_clear_flag(conference, CFLAG_INHASH);
+			stale = 1;
+			conference = NULL;
+		} else if (switch_thread_rwlock_tryrdlock(conference->rwlock) != SWITCH_STATUS_SUCCESS) {
 			conference = NULL;
 		}
 	}
-	switch_mutex_unlock(globals.hash_mutex);
+	switch_thread_rwlock_unlock(shard->rwlock);
+
+	if (stale) {
+		/* unhook a room that is tearing down so the name can be reused right away */
+		switch_thread_rwlock_wrlock(shard->rwlock);
+		if ((conference = switch_core_hash_find(shard->hash, name)) && switch_test_flag(conference, CFLAG_DESTRUCT)) {
+			switch_core_hash_delete(shard->hash, conference->name);
+			switch_clear_flag(conference, CFLAG_INHASH);
+		}
+		switch_thread_rwlock_unlock(shard->rwlock);
+		conference = NULL;
+	}
 
 	return conference;
 }
 
+/* Read lock every live conference into a list so it can be walked without holding the registry */
+static uint32_t conference_registry_snapshot(conference_obj_t ***list)
+{
+	conference_obj_t **confs = NULL, *conference;
+	uint32_t count = 0, size = 0, x;
+	switch_hash_index_t *hi;
+	void *val;
+
+	for (x = 0; x < CONF_REGISTRY_SHARDS; x++) {
+		conference_registry_shard_t *shard = &globals.registry[x];
+
+		switch_thread_rwlock_rdlock(shard->rwlock);
+		for (hi = switch_hash_first(NULL, shard->hash); hi; hi = switch_hash_next(hi)) {
+			switch_hash_this(hi, NULL, NULL, &val);
+			conference = (conference_obj_t *) val;
+
+			if (switch_test_flag(conference, CFLAG_DESTRUCT) || switch_thread_rwlock_tryrdlock(conference->rwlock) != SWITCH_STATUS_SUCCESS) {
+				continue;
+			}
+
+			if (count == size) {
+				size = size ? size * 2 : 32;
+				confs = realloc(confs, size * sizeof(*confs));
+				switch_assert(confs);
+			}
+			confs[count++] = conference;
+		}
+		switch_thread_rwlock_unlock(shard->rwlock);
+	}
+
+	*list = confs;
+	return count;
+}
+
+static void conference_registry_release(conference_obj_t **list, uint32_t count)
+{
+	while (count) {
+		switch_thread_rwlock_unlock(list[--count]->rwlock);
+	}
+
+	switch_safe_free(list);
+}
+
 /* create a new conferene with a specific profile */
 static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_core_session_t *session, switch_memory_pool_t *pool)
 {
@@ -6528,9 +9525,17 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
 	int ivr_dtmf_timeout = 500;
 	int ivr_input_timeout = 0;
 	char *suppress_events = NULL;
+	char *state_events = NULL;
 	char *verbose_events = NULL;
 	char *auto_record = NULL;
 	char *terminate_on_silence = NULL;
+	char *parallel_mix_threshold = NULL;
+	char *parallel_mix_threads = NULL;
+	char *max_active_speakers = NULL;
+	char *active_speaker_hold = NULL;
+	char *talk_summary_interval = NULL;
+	char *talk_summary_top = NULL;
+	char *inline_input = NULL;
 	char uuid_str[SWITCH_UUID_FORMATTED_LENGTH+1];
 	switch_uuid_t uuid;
 	switch_codec_implementation_t read_impl = { 0 };
@@ -6575,8 +9580,6 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
 		}
 	}
 
-	switch_mutex_lock(globals.hash_mutex);
-
 	/* parse the profile tree for param values */
 	if (cfg.profile)
 		for (xml_kvp = switch_xml_child(cfg.profile, "param"); xml_kvp; xml_kvp = xml_kvp->next) {
@@ -6730,12 +9733,28 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
 				}
 			} else if (!strcasecmp(var, "suppress-events") && !zstr(val)) {
 				suppress_events = val;
+			} else if (!strcasecmp(var, "state-events") && !zstr(val)) {
+				state_events = val;
 			} else if (!strcasecmp(var, "verbose-events") && !zstr(val)) {
 				verbose_events = val;
 			} else if (!strcasecmp(var, "auto-record") && !zstr(val)) {
 				auto_record = val;
 			} else if (!strcasecmp(var, "terminate-on-silence") && !zstr(val)) {
 				terminate_on_silence = val;
+			} else if (!strcasecmp(var, "parallel-mix-threshold") && !zstr(val)) {
+				parallel_mix_threshold = val;
+			} else if (!strcasecmp(var, "parallel-mix-threads") && !zstr(val)) {
+				parallel_mix_threads = val;
+			} else if (!strcasecmp(var, "max-active-speakers") && !zstr(val)) {
+				max_active_speakers = val;
+			} else if (!strcasecmp(var, "active-speaker-hold") && !zstr(val)) {
+				active_speaker_hold = val;
+			} else if (!strcasecmp(var, "talk-summary-interval") && !zstr(val)) {
+				talk_summary_interval = val;
+			} else if (!strcasecmp(var, "talk-summary-top") && !zstr(val)) {
+				talk_summary_top = val;
+			} else if (!strcasecmp(var, "inline-input") && !zstr(val)) {
+				inline_input = val;
 			}
 		}
 
@@ -6936,6 +9955,10 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
 		clear_eflags(suppress_events, &conference->eflags);
 	}
 
+	if (!switch_true(state_events)) {
+		conference->eflags &= ~EFLAG_STATE_DELTA;
+	}
+
 	if (!zstr(auto_record)) {
 		conference->auto_record = switch_core_strdup(conference->pool, auto_record);
 	}
@@ -6943,6 +9966,50 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
                 conference->terminate_on_silence = atoi(terminate_on_silence);
         }
 
+	if (!zstr(parallel_mix_threshold)) {
+		conference->parallel_mix_threshold = atoi(parallel_mix_threshold);
+	}
+
+	conference->parallel_mix_threads = 4;
+	if (!zstr(parallel_mix_threads)) {
+		int tmp = atoi(parallel_mix_threads);
+		if (tmp > 0 && tmp <= 64) {
+			conference->parallel_mix_threads = tmp;
+		} else {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "parallel-mix-threads must be between 1 and 64\n");
+		}
+	}
+
+	if (!zstr(max_active_speakers)) {
+		conference->max_active_speakers = atoi(max_active_speakers);
+	}
+
+	conference->active_speaker_hold = CONF_DEFAULT_ACTIVE_SPEAKER_HOLD;
+	if (!zstr(active_speaker_hold)) {
+		int tmp = atoi(active_speaker_hold);
+		conference->active_speaker_hold = tmp > 0 ? (uint32_t) tmp : 0;
+	}
+
+	conference->talk_summary_top = 5;
+	if (!zstr(talk_summary_interval)) {
+		int tmp = atoi(talk_summary_interval);
+		if (tmp > 0) {
+			conference->talk_summary_interval = tmp < (int) conference->interval ? conference->interval : (uint32_t) tmp;
+		}
+	}
+	if (!zstr(talk_summary_top)) {
+		int tmp = atoi(talk_summary_top);
+		if (tmp >= 0 && tmp <= CONF_TALK_SUMMARY_MAX_TOP) {
+			conference->talk_summary_top = tmp;
+		} else {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "talk-summary-top must be between 0 and %d\n", CONF_TALK_SUMMARY_MAX_TOP);
+		}
+	}
+
+	if (!zstr(inline_input) && switch_true(inline_input)) {
+		conference->inline_input = 1;
+	}
+
 	if (!zstr(verbose_events) && switch_true(verbose_events)) {
 		conference->verbose_events = 1;
 	}
@@ -6961,16 +10028,14 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
 	switch_mutex_init(&conference->flag_mutex, SWITCH_MUTEX_NESTED, conference->pool);
 	switch_thread_rwlock_create(&conference->rwlock, conference->pool);
 	switch_mutex_init(&conference->member_mutex, SWITCH_MUTEX_NESTED, conference->pool);
+	switch_mutex_init(&conference->frame_mutex, SWITCH_MUTEX_NESTED, conference->pool);
+	switch_mutex_init(&conference->tts_mutex, SWITCH_MUTEX_NESTED, conference->pool);
+	switch_mutex_init(&conference->delta_mutex, SWITCH_MUTEX_NESTED, conference->pool);
 
-	switch_mutex_lock(globals.hash_mutex);
-	switch_set_flag(conference, CFLAG_INHASH);
-	switch_core_hash_insert(globals.conference_hash, conference->name, conference);
-	switch_mutex_unlock(globals.hash_mutex);
+	conference_registry_add(conference);
 
   end:
 
-	switch_mutex_unlock(globals.hash_mutex);
-
 	return conference;
 }
 
@@ -7009,6 +10074,7 @@ static void pres_event_handler(switch_event_t *event)
 			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "call-direction", conference->count == 1 ? "outbound" : "inbound");
 			switch_event_fire(&event);
 		}
+		switch_thread_rwlock_unlock(conference->rwlock);
 	} else if (switch_event_create(&event, SWITCH_EVENT_PRESENCE_IN) == SWITCH_STATUS_SUCCESS) {
 		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "proto", CONF_CHAT_PROTO);
 		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "login", conf_name);
@@ -7154,10 +10220,19 @@ static struct _mapping control_mappings[] = {
 
 static void member_bind_controls(conference_member_t *member, const char *controls)
 {
-	switch_xml_t cxml, cfg, xgroups, xcontrol;
-	switch_event_t *params;
+	switch_xml_t cxml = NULL, cfg, xgroups = NULL, xcontrol;
+	switch_event_t *params = NULL;
+	conference_cfg_cache_t *cfg_cache;
 	int i;
 
+	if ((cfg_cache = conference_cfg_cache_get())) {
+		xgroups = switch_core_hash_find(cfg_cache->controls, controls);
+	}
+
+	if (xgroups) {
+		goto bind;
+	}
+
 	switch_event_create(&params, SWITCH_EVENT_REQUEST_PARAMS);
 	switch_event_add_header_string(params, SWITCH_STACK_BOTTOM, "Conf-Name", member->conference->name);
 	switch_event_add_header_string(params, SWITCH_STACK_BOTTOM, "Action", "request-controls");
@@ -7178,7 +10253,7 @@ static void member_bind_controls(conference_member_t *member, const char *contro
 		goto end;
 	}
 
-
+ bind:
 	for (xcontrol = switch_xml_child(xgroups, "control"); xcontrol; xcontrol = xcontrol->next) {
         const char *key = switch_xml_attr(xcontrol, "action");
         const char *digits = switch_xml_attr(xcontrol, "digits");
@@ -7203,6 +10278,8 @@ static void member_bind_controls(conference_member_t *member, const char *contro
 		switch_xml_free(cxml);
 		cxml = NULL;
 	}
+
+	conference_cfg_cache_release(cfg_cache);
 	
 	if (params) switch_event_destroy(&params);
 	
@@ -7269,16 +10346,38 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_conference_load)
 		return SWITCH_STATUS_TERM;
 	}
 
+	if (switch_event_reserve_subclass(CONF_EVENT_STATE) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't register subclass %s!\n", CONF_EVENT_STATE);
+		return SWITCH_STATUS_TERM;
+	}
+
 	/* Setup the pool */
 	globals.conference_pool = pool;
 
-	/* Setup a hash to store conferences by name */
-	switch_core_hash_init(&globals.conference_hash, globals.conference_pool);
+	/* Setup the sharded registry to store conferences by name */
+	for (i = 0; i < CONF_REGISTRY_SHARDS; i++) {
+		switch_core_hash_init(&globals.registry[i].hash, globals.conference_pool);
+		switch_thread_rwlock_create(&globals.registry[i].rwlock, globals.conference_pool);
+	}
 	switch_mutex_init(&globals.conference_mutex, SWITCH_MUTEX_NESTED, globals.conference_pool);
 	switch_mutex_init(&globals.id_mutex, SWITCH_MUTEX_NESTED, globals.conference_pool);
-	switch_mutex_init(&globals.hash_mutex, SWITCH_MUTEX_NESTED, globals.conference_pool);
 	switch_mutex_init(&globals.setup_mutex, SWITCH_MUTEX_NESTED, globals.conference_pool);
 
+	conference_load_settings();
+
+	if (globals.profile_cache) {
+		switch_thread_rwlock_create(&globals.cfg_rwlock, globals.conference_pool);
+		globals.cfg_cache = conference_cfg_cache_build();
+	}
+
+	if (globals.prompt_max_bytes) {
+		switch_core_hash_init(&globals.prompt_hash, globals.conference_pool);
+		switch_mutex_init(&globals.prompt_mutex, SWITCH_MUTEX_NESTED, globals.conference_pool);
+	}
+
+	switch_console_set_complete("add conference cache stats");
+	switch_console_set_complete("add conference cache flush");
+
 	/* Subscribe to presence request events */
 	if (switch_event_bind_removable(modname, SWITCH_EVENT_PRESENCE_PROBE, SWITCH_EVENT_SUBCLASS_ANY, pres_event_handler, NULL, &globals.node) !=
 		SWITCH_STATUS_SUCCESS) {
@@ -7286,6 +10385,12 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_conference_load)
 		return SWITCH_STATUS_GENERR;
 	}
 
+	/* Re-parse the cached profiles whenever the xml registry is reloaded */
+	if (globals.cfg_rwlock &&
+		switch_event_bind_removable(modname, SWITCH_EVENT_RELOADXML, SWITCH_EVENT_SUBCLASS_ANY, reload_event_handler, NULL, &globals.reload_node) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't subscribe to reloadxml events!\n");
+	}
+
 	SWITCH_ADD_API(api_interface, "conference", "Conference module commands", conf_api_main, p);
 	SWITCH_ADD_APP(app_interface, global_app_name, global_app_name, NULL, conference_function, NULL, SAF_NONE);
 	SWITCH_ADD_APP(app_interface, "conference_set_auto_outcall", "conference_set_auto_outcall", NULL, conference_auto_function, NULL, SAF_NONE);
@@ -7295,12 +10400,18 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_conference_load)
 	send_presence(SWITCH_EVENT_PRESENCE_IN);
 
 	globals.running = 1;
+	launch_conference_mixer_pool();
+	launch_conference_prefetch_pool();
+	launch_conference_rec_writers();
+
 	/* indicate that the module should continue to be loaded */
 	return status;
 }
 
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_conference_shutdown)
 {
+	uint32_t x;
+
 	if (globals.running) {
 
 		/* signal all threads to shutdown */
@@ -7315,12 +10426,26 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_conference_shutdown)
 		}
 
 		switch_event_unbind(&globals.node);
+		switch_event_unbind(&globals.reload_node);
 		switch_event_free_subclass(CONF_EVENT_MAINT);
+		switch_event_free_subclass(CONF_EVENT_STATE);
 
 		/* free api interface help ".syntax" field string */
 		switch_safe_free(api_syntax);
 	}
-	switch_core_hash_destroy(&globals.conference_hash);
+	for (x = 0; x < CONF_REGISTRY_SHARDS; x++) {
+		switch_core_hash_destroy(&globals.registry[x].hash);
+	}
+
+	if (globals.prompt_hash) {
+		conference_prompt_flush();
+		switch_core_hash_destroy(&globals.prompt_hash);
+	}
+
+	if (globals.cfg_cache) {
+		conference_cfg_cache_release(globals.cfg_cache);
+		globals.cfg_cache = NULL;
+	}
 
 	return SWITCH_STATUS_SUCCESS;
 }
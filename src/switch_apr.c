@@ -801,6 +801,47 @@ SWITCH_DECLARE(int) switch_sockaddr_equal(const switch_sockaddr_t *sa1, const sw
 	return apr_sockaddr_equal(sa1, sa2);
 }
 
+SWITCH_DECLARE(switch_status_t) switch_sockaddr_set_raw(switch_sockaddr_t *sa, const void *raw, switch_size_t len)
+{
+	const struct sockaddr *s = (const struct sockaddr *) raw;
+
+	if (!sa || !raw || len > sizeof(sa->sa)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	memcpy(&sa->sa, raw, len);
+	sa->salen = (apr_socklen_t) len;
+	sa->family = s->sa_family;
+
+#if APR_HAVE_IPV6
+	if (s->sa_family == AF_INET6) {
+		sa->port = ntohs(sa->sa.sin6.sin6_port);
+		sa->ipaddr_ptr = &(sa->sa.sin6.sin6_addr);
+		sa->ipaddr_len = sizeof(struct in6_addr);
+		sa->addr_str_len = 46;
+		return SWITCH_STATUS_SUCCESS;
+	}
+#endif
+
+	sa->port = ntohs(sa->sa.sin.sin_port);
+	sa->ipaddr_ptr = &(sa->sa.sin.sin_addr);
+	sa->ipaddr_len = sizeof(struct in_addr);
+	sa->addr_str_len = 16;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(int) switch_socket_fd_get(switch_socket_t *sock)
+{
+	apr_os_sock_t fd;
+
+	if (sock && apr_os_sock_get(&fd, sock) == APR_SUCCESS) {
+		return (int) fd;
+	}
+
+	return -1;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_mcast_join(switch_socket_t *sock, switch_sockaddr_t *join, switch_sockaddr_t *iface, switch_sockaddr_t *source)
 {
 	return apr_mcast_join(sock, join, iface, source);
@@ -1164,6 +1205,21 @@ SWITCH_DECLARE(switch_status_t) switch_thread_join(switch_status_t *retval, swit
 	return apr_thread_join((apr_status_t *) retval, (apr_thread_t *) thd);
 }
 
+SWITCH_DECLARE(switch_status_t) switch_threadkey_private_create(switch_threadkey_t ** key, void (*dest) (void *), switch_memory_pool_t *pool)
+{
+	return apr_threadkey_private_create((apr_threadkey_t **) key, dest, (apr_pool_t *) pool);
+}
+
+SWITCH_DECLARE(switch_status_t) switch_threadkey_private_get(void **new_mem, switch_threadkey_t *key)
+{
+	return apr_threadkey_private_get(new_mem, (apr_threadkey_t *) key);
+}
+
+SWITCH_DECLARE(switch_status_t) switch_threadkey_private_set(void *priv, switch_threadkey_t *key)
+{
+	return apr_threadkey_private_set(priv, (apr_threadkey_t *) key);
+}
+
 
 SWITCH_DECLARE(switch_status_t) switch_atomic_init(switch_memory_pool_t *pool)
 {
@@ -1215,6 +1271,15 @@ SWITCH_DECLARE(int) switch_atomic_dec(volatile switch_atomic_t *mem)
 #endif
 }
 
+SWITCH_DECLARE(uint32_t) switch_atomic_cas(volatile switch_atomic_t *mem, uint32_t with, uint32_t cmp)
+{
+#ifdef apr_atomic_t
+	return apr_atomic_cas((apr_atomic_t *)mem, with, cmp);
+#else
+	return apr_atomic_cas32((apr_uint32_t *)mem, with, cmp);
+#endif
+}
+
 
 /* For Emacs:
  * Local Variables:
@@ -35,9 +35,40 @@
 static uint32_t buffer_id = 0;
 
 typedef enum {
-	SWITCH_BUFFER_FLAG_DYNAMIC = (1 << 0)
+	SWITCH_BUFFER_FLAG_DYNAMIC = (1 << 0),
+	SWITCH_BUFFER_FLAG_SPSC = (1 << 1)
 } switch_buffer_flag_t;
 
+#define SWITCH_BUFFER_CACHE_LINE 64
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+#define spsc_load_acquire(_p) __atomic_load_n(_p, __ATOMIC_ACQUIRE)
+#define spsc_store_release(_p, _v) __atomic_store_n(_p, _v, __ATOMIC_RELEASE)
+#elif defined(__GNUC__)
+#define spsc_load_acquire(_p) spsc_gcc_load(_p)
+#define spsc_store_release(_p, _v) do { __sync_synchronize(); *(_p) = (_v); } while (0)
+static inline switch_size_t spsc_gcc_load(volatile switch_size_t *p)
+{
+	switch_size_t v = *p;
+	__sync_synchronize();
+	return v;
+}
+#else
+/* msvc gives volatile accesses acquire/release semantics */
+#define spsc_load_acquire(_p) (*(_p))
+#define spsc_store_release(_p, _v) (*(_p) = (_v))
+#endif
+
+/* Positions of a single producer / single consumer ring.  They only ever grow, each is written by one side
+   and they live on separate cache lines so the two threads do not bounce a line between them on every frame. */
+typedef struct {
+	char pad0[SWITCH_BUFFER_CACHE_LINE];
+	volatile switch_size_t tail;
+	char pad1[SWITCH_BUFFER_CACHE_LINE - sizeof(switch_size_t)];
+	volatile switch_size_t head;
+	char pad2[SWITCH_BUFFER_CACHE_LINE - sizeof(switch_size_t)];
+} switch_buffer_spsc_t;
+
 struct switch_buffer {
 	switch_byte_t *data;
 	switch_byte_t *head;
@@ -50,6 +81,7 @@ struct switch_buffer {
 	uint32_t flags;
 	uint32_t id;
 	int32_t loops;
+	switch_buffer_spsc_t *spsc;
 };
 
 SWITCH_DECLARE(switch_status_t) switch_buffer_create(switch_memory_pool_t *pool, switch_buffer_t **buffer, switch_size_t max_len)
@@ -96,6 +128,106 @@ SWITCH_DECLARE(switch_status_t) switch_buffer_create_dynamic(switch_buffer_t **b
 	return SWITCH_STATUS_MEMERR;
 }
 
+SWITCH_DECLARE(switch_status_t) switch_buffer_create_spsc(switch_buffer_t **buffer, switch_size_t max_len)
+{
+	switch_buffer_t *new_buffer;
+
+	switch_assert(max_len);
+
+	if (!(new_buffer = malloc(sizeof(*new_buffer)))) {
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	memset(new_buffer, 0, sizeof(*new_buffer));
+
+	if (!(new_buffer->data = malloc(max_len)) || !(new_buffer->spsc = malloc(sizeof(*new_buffer->spsc)))) {
+		switch_safe_free(new_buffer->data);
+		free(new_buffer);
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	memset(new_buffer->spsc, 0, sizeof(*new_buffer->spsc));
+	new_buffer->datalen = max_len;
+	new_buffer->max_len = max_len;
+	new_buffer->id = buffer_id++;
+	new_buffer->head = new_buffer->data;
+	switch_set_flag(new_buffer, SWITCH_BUFFER_FLAG_SPSC);
+
+	*buffer = new_buffer;
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* Copy out of the ring starting at absolute position pos, wrapping around the end of the storage */
+static void spsc_copy_out(switch_buffer_t *buffer, switch_size_t pos, void *data, switch_size_t len)
+{
+	switch_size_t off = pos % buffer->datalen;
+	switch_size_t first = buffer->datalen - off;
+
+	if (first >= len) {
+		memcpy(data, buffer->data + off, len);
+	} else {
+		memcpy(data, buffer->data + off, first);
+		memcpy((switch_byte_t *) data + first, buffer->data, len - first);
+	}
+}
+
+static switch_size_t spsc_inuse(switch_buffer_t *buffer)
+{
+	/* head first, the tail can only have moved further by the time we look at it */
+	switch_size_t head = spsc_load_acquire(&buffer->spsc->head);
+	switch_size_t tail = spsc_load_acquire(&buffer->spsc->tail);
+
+	return tail - head;
+}
+
+/* Consumer side, returns what can be read right now capped at datalen */
+static switch_size_t spsc_readable(switch_buffer_t *buffer, switch_size_t datalen)
+{
+	switch_size_t avail = spsc_load_acquire(&buffer->spsc->tail) - buffer->spsc->head;
+
+	return avail < datalen ? avail : datalen;
+}
+
+static switch_size_t spsc_read(switch_buffer_t *buffer, void *data, switch_size_t datalen, switch_bool_t consume)
+{
+	switch_size_t reading = spsc_readable(buffer, datalen);
+
+	if (reading) {
+		spsc_copy_out(buffer, buffer->spsc->head, data, reading);
+		if (consume) {
+			spsc_store_release(&buffer->spsc->head, buffer->spsc->head + reading);
+		}
+	}
+
+	return reading;
+}
+
+/* Producer side, all or nothing */
+static switch_size_t spsc_write(switch_buffer_t *buffer, const void *data, switch_size_t datalen)
+{
+	switch_size_t tail = buffer->spsc->tail;
+	switch_size_t used = tail - spsc_load_acquire(&buffer->spsc->head);
+	switch_size_t off, first;
+
+	if (buffer->datalen - used < datalen) {
+		return 0;
+	}
+
+	off = tail % buffer->datalen;
+	first = buffer->datalen - off;
+
+	if (first >= datalen) {
+		memcpy(buffer->data + off, data, datalen);
+	} else {
+		memcpy(buffer->data + off, data, first);
+		memcpy(buffer->data, (const switch_byte_t *) data + first, datalen - first);
+	}
+
+	spsc_store_release(&buffer->spsc->tail, tail + datalen);
+
+	return used + datalen;
+}
+
 SWITCH_DECLARE(void) switch_buffer_add_mutex(switch_buffer_t *buffer, switch_mutex_t *mutex)
 {
 	buffer->mutex = mutex;
@@ -130,6 +262,10 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_len(switch_buffer_t *buffer)
 
 SWITCH_DECLARE(switch_size_t) switch_buffer_freespace(switch_buffer_t *buffer)
 {
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC)) {
+		return buffer->datalen - spsc_inuse(buffer);
+	}
+
 	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_DYNAMIC)) {
 		if (buffer->max_len) {
 			return (switch_size_t) (buffer->max_len - buffer->used);
@@ -142,6 +278,10 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_freespace(switch_buffer_t *buffer)
 
 SWITCH_DECLARE(switch_size_t) switch_buffer_inuse(switch_buffer_t *buffer)
 {
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC)) {
+		return spsc_inuse(buffer);
+	}
+
 	return buffer->used;
 }
 
@@ -149,6 +289,12 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_toss(switch_buffer_t *buffer, switch
 {
 	switch_size_t reading = 0;
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC)) {
+		reading = spsc_readable(buffer, datalen);
+		spsc_store_release(&buffer->spsc->head, buffer->spsc->head + reading);
+		return spsc_inuse(buffer);
+	}
+
 	if (buffer->used < 1) {
 		buffer->used = 0;
 		return 0;
@@ -166,13 +312,19 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_toss(switch_buffer_t *buffer, switch
 
 SWITCH_DECLARE(void) switch_buffer_set_loops(switch_buffer_t *buffer, int32_t loops)
 {
+	/* a ring can not replay what the reader already gave back to the writer */
+	switch_assert(!switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC));
+
 	buffer->loops = loops;
 }
 
 SWITCH_DECLARE(switch_size_t) switch_buffer_read_loop(switch_buffer_t *buffer, void *data, switch_size_t datalen)
 {
 	switch_size_t len;
-	if ((len = switch_buffer_read(buffer, data, datalen)) == 0) {
+
+	switch_assert(!switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC));
+
+	if ((len = switch_buffer_read(buffer, data, datalen)) == 0 && !switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC)) {
 		if (buffer->loops > 0) {
 			buffer->loops--;
 		}
@@ -190,6 +342,10 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_read(switch_buffer_t *buffer, void *
 {
 	switch_size_t reading = 0;
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC)) {
+		return spsc_read(buffer, data, datalen, SWITCH_TRUE);
+	}
+
 	if (buffer->used < 1) {
 		buffer->used = 0;
 		return 0;
@@ -210,6 +366,10 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_peek(switch_buffer_t *buffer, void *
 {
 	switch_size_t reading = 0;
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC)) {
+		return spsc_read(buffer, data, datalen, SWITCH_FALSE);
+	}
+
 	if (buffer->used < 1) {
 		buffer->used = 0;
 		return 0;
@@ -228,6 +388,15 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_peek_zerocopy(switch_buffer_t *buffe
 {
 	switch_size_t reading = 0;
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC)) {
+		/* only the part up to the end of the storage is contiguous */
+		switch_size_t off = buffer->spsc->head % buffer->datalen;
+
+		reading = spsc_readable(buffer, buffer->datalen - off);
+		*ptr = buffer->data + off;
+		return reading;
+	}
+
 	if (buffer->used < 1) {
 		buffer->used = 0;
 		return 0;
@@ -246,6 +415,10 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_write(switch_buffer_t *buffer, const
 
 	switch_assert(buffer->data != NULL);
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC)) {
+		return datalen ? spsc_write(buffer, data, datalen) : spsc_inuse(buffer);
+	}
+
 	if (!datalen) {
 		return buffer->used;
 	}
@@ -297,6 +470,11 @@ SWITCH_DECLARE(void) switch_buffer_zero(switch_buffer_t *buffer)
 {
 	switch_assert(buffer->data != NULL);
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC)) {
+		spsc_store_release(&buffer->spsc->head, spsc_load_acquire(&buffer->spsc->tail));
+		return;
+	}
+
 	buffer->used = 0;
 	buffer->actually_used = 0;
 	buffer->head = buffer->data;
@@ -306,6 +484,12 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_zwrite(switch_buffer_t *buffer, cons
 {
 	switch_size_t w;
 
+	/* making room means moving the read side, which only the reader may do on a ring */
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC)) {
+		switch_assert(0);
+		return 0;
+	}
+
 	if (!(w = switch_buffer_write(buffer, data, datalen))) {
 		switch_buffer_zero(buffer);
 		return switch_buffer_write(buffer, data, datalen);
@@ -318,6 +502,11 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_slide_write(switch_buffer_t *buffer,
 {
 	switch_size_t w;
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC)) {
+		switch_assert(0);
+		return 0;
+	}
+
 	if (!(w = switch_buffer_write(buffer, data, datalen))) {
 		switch_buffer_toss(buffer, datalen);
 		return switch_buffer_write(buffer, data, datalen);
@@ -329,7 +518,8 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_slide_write(switch_buffer_t *buffer,
 SWITCH_DECLARE(void) switch_buffer_destroy(switch_buffer_t **buffer)
 {
 	if (buffer && *buffer) {
-		if ((switch_test_flag((*buffer), SWITCH_BUFFER_FLAG_DYNAMIC))) {
+		if ((switch_test_flag((*buffer), (SWITCH_BUFFER_FLAG_DYNAMIC | SWITCH_BUFFER_FLAG_SPSC)))) {
+			switch_safe_free((*buffer)->spsc);
 			switch_safe_free((*buffer)->data);
 			free(*buffer);
 		}
@@ -1608,6 +1608,9 @@ static void switch_load_core_config(const char *file)
 		}
 
 		if ((settings = switch_xml_child(cfg, "settings"))) {
+			const char *dispatch_key = NULL;
+			uint32_t dispatch_shards = 0;
+
 			for (param = switch_xml_child(settings, "param"); param; param = param->next) {
 				const char *var = switch_xml_attr_soft(param, "name");
 				const char *val = switch_xml_attr_soft(param, "value");
@@ -1735,6 +1738,13 @@ static void switch_load_core_config(const char *file)
 					switch_time_set_matrix(switch_true(val));
 				} else if (!strcasecmp(var, "max-sessions") && !zstr(val)) {
 					switch_core_session_limit(atoi(val));
+				} else if (!strcasecmp(var, "event-dispatch-key") && !zstr(val)) {
+					dispatch_key = val;
+				} else if (!strcasecmp(var, "event-dispatch-shards") && !zstr(val)) {
+					int tmp = atoi(val);
+					if (tmp > 0) {
+						dispatch_shards = (uint32_t) tmp;
+					}
 				} else if (!strcasecmp(var, "verbose-channel-events") && !zstr(val)) {
 					int v = switch_true(val);
 					if (v) {
@@ -1769,6 +1779,9 @@ static void switch_load_core_config(const char *file)
 					switch_rtp_set_start_port((switch_port_t) atoi(val));
 				} else if (!strcasecmp(var, "rtp-end-port") && !zstr(val)) {
 					switch_rtp_set_end_port((switch_port_t) atoi(val));
+				} else if (!strcasecmp(var, "rtp-io-threads") && !zstr(val)) {
+					int tmp = atoi(val);
+					switch_rtp_set_io_threads(tmp > 0 ? (uint32_t) tmp : 0);
 				} else if (!strcasecmp(var, "core-db-name") && !zstr(val)) {
 					runtime.dbname = switch_core_strdup(runtime.memory_pool, val);
 				} else if (!strcasecmp(var, "core-db-dsn") && !zstr(val)) {
@@ -1798,6 +1811,10 @@ static void switch_load_core_config(const char *file)
                     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Set switchname to %s\n", runtime.switchname);
 				}
 			}
+
+			if (dispatch_key) {
+				switch_event_set_dispatch_key(dispatch_key, dispatch_shards ? dispatch_shards : (uint32_t) runtime.cpu_count);
+			}
 		}
 
 		if ((settings = switch_xml_child(cfg, "variables"))) {
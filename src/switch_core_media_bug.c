@@ -549,6 +549,22 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_remove(switch_core_session
 }
 
 
+SWITCH_DECLARE(uint32_t) switch_core_media_bug_count(switch_core_session_t *session)
+{
+	switch_media_bug_t *bp;
+	uint32_t x = 0;
+
+	if (session->bugs) {
+		switch_thread_rwlock_rdlock(session->bug_rwlock);
+		for (bp = session->bugs; bp; bp = bp->next) {
+			x++;
+		}
+		switch_thread_rwlock_unlock(session->bug_rwlock);
+	}
+
+	return x;
+}
+
 SWITCH_DECLARE(uint32_t) switch_core_media_bug_prune(switch_core_session_t *session)
 {
 	switch_media_bug_t *bp = NULL, *last = NULL;
@@ -34,7 +34,6 @@
 
 #include <switch.h>
 #include <switch_event.h>
-//#define SWITCH_EVENT_RECYCLE
 #define DISPATCH_QUEUE_LEN 10000
 //#define DEBUG_DISPATCH_QUEUES
 
@@ -50,9 +49,18 @@ struct switch_event_node {
 	switch_event_callback_t callback;
 	/*! private data */
 	void *user_data;
+	/*! the subclass is a file: or func: filter that has to be checked against each event's headers */
+	int dynamic;
 	struct switch_event_node *next;
 };
 
+/*! \brief The bindings an event id and subclass is delivered to, in delivery order */
+typedef struct switch_event_route {
+	uint32_t count;
+	struct switch_event_route *next;
+	switch_event_node_t *nodes[1];
+} switch_event_route_t;
+
 /*! \brief A registered custom event subclass  */
 struct switch_event_subclass {
 	/*! the owner of the subclass */
@@ -80,15 +88,23 @@ static switch_queue_t *EVENT_QUEUE[NUMBER_OF_QUEUES] = { 0 };
 static switch_thread_t *EVENT_DISPATCH_QUEUE_THREADS[MAX_DISPATCH_VAL] = { 0 };
 static uint8_t EVENT_DISPATCH_QUEUE_RUNNING[MAX_DISPATCH_VAL] = { 0 };
 static switch_queue_t *EVENT_DISPATCH_QUEUE[MAX_DISPATCH_VAL] = { 0 };
+static switch_thread_id_t EVENT_DISPATCH_QUEUE_TID[MAX_DISPATCH_VAL] = { 0 };
+#define EVENT_SHARD_KEYS_MAX 4
+static char *EVENT_SHARD_KEYS[EVENT_SHARD_KEYS_MAX] = { 0 };
+static uint32_t EVENT_SHARD_KEY_COUNT = 0;
+static uint32_t EVENT_SHARDS = 0;
+static uint32_t EVENT_SHARD_DELIVERED[MAX_DISPATCH_VAL] = { 0 };
+static uint32_t EVENT_SHARD_SPILLS[MAX_DISPATCH_VAL] = { 0 };
 static int POOL_COUNT_MAX = SWITCH_CORE_QUEUE_LEN;
 static switch_mutex_t *EVENT_QUEUE_MUTEX = NULL;
 static switch_hash_t *CUSTOM_HASH = NULL;
+#define MAX_EVENT_ROUTES 1024
+static switch_hash_t *ROUTE_HASH = NULL;
+static switch_event_route_t *ROUTE_LIST = NULL;
+static switch_thread_rwlock_t *ROUTE_RWLOCK = NULL;
+static uint32_t ROUTE_COUNT = 0;
 static int THREAD_COUNT = 0;
 static int SYSTEM_RUNNING = 0;
-#ifdef SWITCH_EVENT_RECYCLE
-static switch_queue_t *EVENT_RECYCLE_QUEUE = NULL;
-static switch_queue_t *EVENT_HEADER_RECYCLE_QUEUE = NULL;
-#endif
 static void launch_dispatch_threads(uint32_t max, int len, switch_memory_pool_t *pool);
 
 static char *my_dup(const char *s)
@@ -110,6 +126,350 @@ static char *my_dup(const char *s)
 #define FREE(ptr) switch_safe_free(ptr)
 #endif
 
+/* Events and headers are recycled through a cache owned by each thread. A cache that grows past EVENT_CACHE_MAX
+   hands a batch of EVENT_CACHE_BATCH to the shared depot and an empty one takes a whole batch back, so the depot
+   lock is taken once per batch. This is what moves objects freed on the dispatch threads back to the producers.
+   A cache its thread has not touched for EVENT_CACHE_IDLE_SEC is swept into the depot, which holds at most
+   EVENT_DEPOT_MAX_BYTES and gives the rest back to malloc. */
+#define EVENT_CACHE_BATCH 32
+#define EVENT_CACHE_MAX (EVENT_CACHE_BATCH * 2)
+#define EVENT_CACHE_IDLE_SEC 10
+#define EVENT_DEPOT_MAX_BYTES (4 * 1024 * 1024)
+
+typedef enum {
+	EVENT_OBJ_EVENT,
+	EVENT_OBJ_HEADER,
+	EVENT_OBJ_KINDS
+} event_obj_kind_t;
+
+static const char *EVENT_OBJ_NAMES[EVENT_OBJ_KINDS] = { "event", "header" };
+
+/* A recycled object, the first of a batch also links the batches in the depot */
+typedef struct event_recycle_obj {
+	struct event_recycle_obj *next;
+	struct event_recycle_obj *next_batch;
+	uint32_t count;
+} event_recycle_obj_t;
+
+typedef struct event_recycle_counters {
+	uint64_t allocs;
+	uint64_t reuses;
+	uint64_t depot_gets;
+	uint64_t depot_puts;
+	uint64_t frees;
+} event_recycle_counters_t;
+
+/* busy is held by the owning thread while it uses the lists, a sweep only takes caches nobody holds */
+typedef struct event_thread_cache {
+	event_recycle_obj_t *free[EVENT_OBJ_KINDS];
+	uint32_t count[EVENT_OBJ_KINDS];
+	event_recycle_counters_t counters[EVENT_OBJ_KINDS];
+	volatile switch_atomic_t busy;
+	uint32_t uses;
+	uint32_t swept_uses;
+	struct event_thread_cache *next;
+} event_thread_cache_t;
+
+static struct {
+	switch_mutex_t *mutex;
+	switch_threadkey_t *key;
+	event_recycle_obj_t *batches[EVENT_OBJ_KINDS];
+	uint32_t batch_count[EVENT_OBJ_KINDS];
+	uint32_t cached[EVENT_OBJ_KINDS];
+	switch_size_t bytes;
+	event_recycle_counters_t retired[EVENT_OBJ_KINDS];
+	event_thread_cache_t *caches;
+	uint32_t cache_count;
+	uint32_t sweeps;
+	volatile switch_atomic_t sweeping;
+	switch_time_t next_sweep;
+} EVENT_DEPOT;
+
+static const size_t EVENT_OBJ_SIZES[EVENT_OBJ_KINDS] = { sizeof(switch_event_t), sizeof(switch_event_header_t) };
+
+/* Give a list of cached objects to the depot in batches, or to malloc once the depot is full. Called with the depot locked */
+static void event_depot_absorb(event_recycle_obj_t *list, event_obj_kind_t kind, event_recycle_counters_t *counters)
+{
+	event_recycle_obj_t *batch, *obj;
+	uint32_t n;
+
+	while ((batch = list)) {
+		for (n = 1, obj = batch; obj->next && n < EVENT_CACHE_BATCH; obj = obj->next, n++);
+		list = obj->next;
+		obj->next = NULL;
+
+		if (EVENT_DEPOT.bytes + n * EVENT_OBJ_SIZES[kind] <= EVENT_DEPOT_MAX_BYTES) {
+			batch->count = n;
+			batch->next_batch = EVENT_DEPOT.batches[kind];
+			EVENT_DEPOT.batches[kind] = batch;
+			EVENT_DEPOT.batch_count[kind]++;
+			EVENT_DEPOT.cached[kind] += n;
+			EVENT_DEPOT.bytes += n * EVENT_OBJ_SIZES[kind];
+			counters->depot_puts++;
+		} else {
+			while ((obj = batch)) {
+				batch = obj->next;
+				free(obj);
+			}
+			counters->frees += n;
+		}
+	}
+}
+
+static void event_thread_cache_destroy(void *data)
+{
+	event_thread_cache_t *cache = (event_thread_cache_t *) data, *cp, *last = NULL;
+	int kind;
+
+	if (!cache) {
+		return;
+	}
+
+	if (!SYSTEM_RUNNING) {
+		/* the depot may already be gone with the runtime pool, just give everything back to malloc */
+		for (kind = 0; kind < EVENT_OBJ_KINDS; kind++) {
+			event_recycle_obj_t *obj;
+
+			while ((obj = cache->free[kind])) {
+				cache->free[kind] = obj->next;
+				free(obj);
+			}
+		}
+		free(cache);
+		return;
+	}
+
+	switch_mutex_lock(EVENT_DEPOT.mutex);
+	for (kind = 0; kind < EVENT_OBJ_KINDS; kind++) {
+		event_depot_absorb(cache->free[kind], kind, &cache->counters[kind]);
+		EVENT_DEPOT.retired[kind].allocs += cache->counters[kind].allocs;
+		EVENT_DEPOT.retired[kind].reuses += cache->counters[kind].reuses;
+		EVENT_DEPOT.retired[kind].depot_gets += cache->counters[kind].depot_gets;
+		EVENT_DEPOT.retired[kind].depot_puts += cache->counters[kind].depot_puts;
+		EVENT_DEPOT.retired[kind].frees += cache->counters[kind].frees;
+	}
+
+	for (cp = EVENT_DEPOT.caches; cp; cp = cp->next) {
+		if (cp == cache) {
+			if (last) {
+				last->next = cp->next;
+			} else {
+				EVENT_DEPOT.caches = cp->next;
+			}
+			EVENT_DEPOT.cache_count--;
+			break;
+		}
+		last = cp;
+	}
+	switch_mutex_unlock(EVENT_DEPOT.mutex);
+
+	free(cache);
+}
+
+static event_thread_cache_t *event_thread_cache(void)
+{
+#ifdef WIN32
+	/* windows does not run thread key destructors so a cache would leak with its thread */
+	return NULL;
+#else
+	void *data = NULL;
+	event_thread_cache_t *cache;
+
+	if (!EVENT_DEPOT.key || switch_threadkey_private_get(&data, EVENT_DEPOT.key) != SWITCH_STATUS_SUCCESS) {
+		return NULL;
+	}
+
+	if (!(cache = (event_thread_cache_t *) data)) {
+		if (!(cache = calloc(1, sizeof(*cache)))) {
+			return NULL;
+		}
+
+		switch_threadkey_private_set(cache, EVENT_DEPOT.key);
+
+		switch_mutex_lock(EVENT_DEPOT.mutex);
+		cache->next = EVENT_DEPOT.caches;
+		EVENT_DEPOT.caches = cache;
+		EVENT_DEPOT.cache_count++;
+		switch_mutex_unlock(EVENT_DEPOT.mutex);
+	}
+
+	return cache;
+#endif
+}
+
+/* Move the lists of every cache whose thread has not used it since the last sweep, or of all of them, into the
+   depot. Called with the depot locked */
+static void event_thread_cache_sweep(switch_bool_t all)
+{
+	event_thread_cache_t *cache;
+	int kind;
+
+	for (cache = EVENT_DEPOT.caches; cache; cache = cache->next) {
+		if ((all || cache->uses == cache->swept_uses) && (cache->count[EVENT_OBJ_EVENT] || cache->count[EVENT_OBJ_HEADER]) &&
+			!switch_atomic_cas(&cache->busy, 1, 0)) {
+			for (kind = 0; kind < EVENT_OBJ_KINDS; kind++) {
+				event_depot_absorb(cache->free[kind], kind, &cache->counters[kind]);
+				cache->free[kind] = NULL;
+				cache->count[kind] = 0;
+			}
+			switch_atomic_cas(&cache->busy, 0, 1);
+		}
+		cache->swept_uses = cache->uses;
+	}
+
+	EVENT_DEPOT.sweeps++;
+}
+
+static event_thread_cache_t *event_thread_cache_hold(void)
+{
+	event_thread_cache_t *cache;
+
+	if (!(cache = event_thread_cache()) || switch_atomic_cas(&cache->busy, 1, 0)) {
+		/* no cache, or a sweep has it right now */
+		return NULL;
+	}
+
+	cache->uses++;
+
+	return cache;
+}
+
+static void event_thread_cache_release(event_thread_cache_t *cache)
+{
+	switch_time_t now;
+
+	switch_atomic_cas(&cache->busy, 0, 1);
+
+	/* whoever gets here first once EVENT_CACHE_IDLE_SEC went by sweeps for everyone */
+	if ((now = switch_micro_time_now()) >= EVENT_DEPOT.next_sweep && !switch_atomic_cas(&EVENT_DEPOT.sweeping, 1, 0)) {
+		switch_mutex_lock(EVENT_DEPOT.mutex);
+		if (EVENT_DEPOT.next_sweep) {
+			event_thread_cache_sweep(SWITCH_FALSE);
+		}
+		EVENT_DEPOT.next_sweep = now + EVENT_CACHE_IDLE_SEC * 1000000;
+		switch_mutex_unlock(EVENT_DEPOT.mutex);
+		switch_atomic_set(&EVENT_DEPOT.sweeping, 0);
+	}
+}
+
+static void *event_obj_alloc(event_obj_kind_t kind)
+{
+	event_thread_cache_t *cache;
+	event_recycle_obj_t *obj;
+	void *mem;
+
+	if ((cache = event_thread_cache_hold())) {
+		if (!cache->free[kind] && EVENT_DEPOT.batches[kind]) {
+			switch_mutex_lock(EVENT_DEPOT.mutex);
+			if ((obj = EVENT_DEPOT.batches[kind])) {
+				EVENT_DEPOT.batches[kind] = obj->next_batch;
+				EVENT_DEPOT.batch_count[kind]--;
+				EVENT_DEPOT.cached[kind] -= obj->count;
+				EVENT_DEPOT.bytes -= obj->count * EVENT_OBJ_SIZES[kind];
+				cache->free[kind] = obj;
+				cache->count[kind] = obj->count;
+				cache->counters[kind].depot_gets++;
+			}
+			switch_mutex_unlock(EVENT_DEPOT.mutex);
+		}
+
+		if ((obj = cache->free[kind])) {
+			cache->free[kind] = obj->next;
+			cache->count[kind]--;
+			cache->counters[kind].reuses++;
+			event_thread_cache_release(cache);
+			return obj;
+		}
+
+		cache->counters[kind].allocs++;
+		event_thread_cache_release(cache);
+	}
+
+	mem = ALLOC(EVENT_OBJ_SIZES[kind]);
+	switch_assert(mem);
+
+	return mem;
+}
+
+static void event_obj_free(event_obj_kind_t kind, void *mem)
+{
+	event_thread_cache_t *cache;
+	event_recycle_obj_t *obj = (event_recycle_obj_t *) mem, *batch;
+	uint32_t n;
+
+	if (!(cache = event_thread_cache_hold())) {
+		free(mem);
+		return;
+	}
+
+	obj->next = cache->free[kind];
+	cache->free[kind] = obj;
+
+	if (++cache->count[kind] > EVENT_CACHE_MAX) {
+		batch = cache->free[kind];
+		for (n = 1; n < EVENT_CACHE_BATCH; n++) {
+			obj = obj->next;
+		}
+		cache->free[kind] = obj->next;
+		cache->count[kind] -= EVENT_CACHE_BATCH;
+		obj->next = NULL;
+
+		switch_mutex_lock(EVENT_DEPOT.mutex);
+		event_depot_absorb(batch, kind, &cache->counters[kind]);
+		switch_mutex_unlock(EVENT_DEPOT.mutex);
+	}
+
+	event_thread_cache_release(cache);
+}
+
+SWITCH_DECLARE(void) switch_event_stats(switch_stream_handle_t *stream)
+{
+	event_recycle_counters_t total;
+	event_thread_cache_t *cache;
+	uint32_t cached;
+	int kind;
+
+	if (!EVENT_DEPOT.mutex || !SYSTEM_RUNNING) {
+		stream->write_function(stream, "-ERR event system not running\n");
+		return;
+	}
+
+	switch_mutex_lock(EVENT_DEPOT.mutex);
+	stream->write_function(stream, "thread caches: %u sweeps: %u depot bytes: %" SWITCH_SIZE_T_FMT "\n",
+						   EVENT_DEPOT.cache_count, EVENT_DEPOT.sweeps, EVENT_DEPOT.bytes);
+
+	for (kind = 0; kind < EVENT_OBJ_KINDS; kind++) {
+		total = EVENT_DEPOT.retired[kind];
+		cached = 0;
+
+		/* other threads bump their own counters without the lock, close enough for stats */
+		for (cache = EVENT_DEPOT.caches; cache; cache = cache->next) {
+			total.allocs += cache->counters[kind].allocs;
+			total.reuses += cache->counters[kind].reuses;
+			total.depot_gets += cache->counters[kind].depot_gets;
+			total.depot_puts += cache->counters[kind].depot_puts;
+			total.frees += cache->counters[kind].frees;
+			cached += cache->count[kind];
+		}
+
+		stream->write_function(stream, "%s: size %u allocs %" SWITCH_UINT64_T_FMT " reuses %" SWITCH_UINT64_T_FMT
+							   " depot-gets %" SWITCH_UINT64_T_FMT " depot-puts %" SWITCH_UINT64_T_FMT " frees %" SWITCH_UINT64_T_FMT
+							   " thread-cached %u depot-cached %u\n",
+							   EVENT_OBJ_NAMES[kind], (unsigned) EVENT_OBJ_SIZES[kind], total.allocs, total.reuses,
+							   total.depot_gets, total.depot_puts, total.frees, cached, EVENT_DEPOT.cached[kind]);
+	}
+	switch_mutex_unlock(EVENT_DEPOT.mutex);
+
+	switch_mutex_lock(EVENT_QUEUE_MUTEX);
+	stream->write_function(stream, "dispatch threads: %u shards: %u\n", SOFT_MAX_DISPATCH, EVENT_SHARDS);
+
+	for (kind = 0; kind < (int) EVENT_SHARDS; kind++) {
+		stream->write_function(stream, "shard %d: queued %u delivered %u spills %u\n", kind,
+							   switch_queue_size(EVENT_DISPATCH_QUEUE[kind]), EVENT_SHARD_DELIVERED[kind], EVENT_SHARD_SPILLS[kind]);
+	}
+	switch_mutex_unlock(EVENT_QUEUE_MUTEX);
+}
+
 /* make sure this is synced with the switch_event_types_t enum in switch_types.h
    also never put any new ones before EVENT_ALL
 */
@@ -236,21 +596,115 @@ static int switch_events_match(switch_event_t *event, switch_event_node_t *node)
 	return match;
 }
 
+/* Forget every resolved route, called with RWLOCK write locked so nobody is delivering */
+static void switch_event_flush_routes(void)
+{
+	switch_event_route_t *route;
+
+	while ((route = ROUTE_LIST)) {
+		ROUTE_LIST = route->next;
+		FREE(route);
+	}
+
+	if (ROUTE_HASH) {
+		switch_core_hash_destroy(&ROUTE_HASH);
+		switch_core_hash_init(&ROUTE_HASH, NULL);
+	}
+
+	ROUTE_COUNT = 0;
+}
+
+/* Resolve which bindings an event of this id and subclass goes to once, instead of matching every node on every event.
+   Only file: and func: bindings depend on more than the id and subclass, they stay in the route and are matched at delivery.
+   Called with RWLOCK read locked, NULL means walk the nodes the slow way. */
+static switch_event_route_t *switch_event_get_route(switch_event_t *event)
+{
+	switch_event_route_t *route;
+	switch_event_node_t *node;
+	switch_event_types_t e;
+	char key[256];
+	uint32_t count = 0;
+
+	if (!ROUTE_HASH) {
+		return NULL;
+	}
+
+	if (event->subclass_name) {
+		if (strlen(event->subclass_name) > sizeof(key) - 16) {
+			return NULL;
+		}
+		switch_snprintf(key, sizeof(key), "%d:%s", event->event_id, event->subclass_name);
+	} else {
+		switch_snprintf(key, sizeof(key), "%d", event->event_id);
+	}
+
+	switch_thread_rwlock_rdlock(ROUTE_RWLOCK);
+	route = (switch_event_route_t *) switch_core_hash_find(ROUTE_HASH, key);
+	switch_thread_rwlock_unlock(ROUTE_RWLOCK);
+
+	if (route) {
+		return route;
+	}
+
+	switch_thread_rwlock_wrlock(ROUTE_RWLOCK);
+
+	if ((route = (switch_event_route_t *) switch_core_hash_find(ROUTE_HASH, key)) || ROUTE_COUNT >= MAX_EVENT_ROUTES) {
+		goto end;
+	}
+
+	for (e = event->event_id;; e = SWITCH_EVENT_ALL) {
+		for (node = EVENT_NODES[e]; node; node = node->next) {
+			count++;
+		}
+		if (e == SWITCH_EVENT_ALL) {
+			break;
+		}
+	}
+
+	route = ALLOC(sizeof(*route) + count * sizeof(route->nodes[0]));
+	switch_assert(route);
+	route->count = 0;
+
+	for (e = event->event_id;; e = SWITCH_EVENT_ALL) {
+		for (node = EVENT_NODES[e]; node; node = node->next) {
+			if (node->dynamic || switch_events_match(event, node)) {
+				route->nodes[route->count++] = node;
+			}
+		}
+		if (e == SWITCH_EVENT_ALL) {
+			break;
+		}
+	}
+
+	route->next = ROUTE_LIST;
+	ROUTE_LIST = route;
+	ROUTE_COUNT++;
+	switch_core_hash_insert(ROUTE_HASH, key, route);
+
+  end:
+
+	switch_thread_rwlock_unlock(ROUTE_RWLOCK);
+
+	return route;
+}
+
 static void *SWITCH_THREAD_FUNC switch_event_dispatch_thread(switch_thread_t *thread, void *obj)
 {
 	switch_queue_t *queue = (switch_queue_t *) obj;
 	int my_id = 0;
 
-	switch_mutex_lock(EVENT_QUEUE_MUTEX);
-	THREAD_COUNT++;
-
-	for (my_id = 0; my_id < NUMBER_OF_QUEUES; my_id++) {
+	for (my_id = 0; my_id < MAX_DISPATCH_VAL - 1; my_id++) {
 		if (EVENT_DISPATCH_QUEUE[my_id] == queue) {
 			break;
 		}
 	}
 
+	/* the launcher waits for this while holding EVENT_QUEUE_MUTEX so it has to be set before taking it */
+	EVENT_DISPATCH_QUEUE_TID[my_id] = switch_thread_self();
 	EVENT_DISPATCH_QUEUE_RUNNING[my_id] = 1;
+
+	switch_mutex_lock(EVENT_QUEUE_MUTEX);
+	THREAD_COUNT++;
 	switch_mutex_unlock(EVENT_QUEUE_MUTEX);
 
 	for (;;) {
@@ -271,6 +725,7 @@ static void *SWITCH_THREAD_FUNC switch_event_dispatch_thread(switch_thread_t *th
 
 		event = (switch_event_t *) pop;
 		switch_event_deliver(&event);
+		EVENT_SHARD_DELIVERED[my_id]++;
 	}
 
 
@@ -378,19 +833,31 @@ SWITCH_DECLARE(void) switch_event_deliver(switch_event_t **event)
 {
 	switch_event_types_t e;
 	switch_event_node_t *node;
+	switch_event_route_t *route;
+	uint32_t i;
 
 	if (SYSTEM_RUNNING) {
 		switch_thread_rwlock_rdlock(RWLOCK);
-		for (e = (*event)->event_id;; e = SWITCH_EVENT_ALL) {
-			for (node = EVENT_NODES[e]; node; node = node->next) {
-				if (switch_events_match(*event, node)) {
+		if ((route = switch_event_get_route(*event))) {
+			for (i = 0; i < route->count; i++) {
+				node = route->nodes[i];
+				if (!node->dynamic || switch_events_match(*event, node)) {
 					(*event)->bind_user_data = node->user_data;
 					node->callback(*event);
 				}
 			}
+		} else {
+			for (e = (*event)->event_id;; e = SWITCH_EVENT_ALL) {
+				for (node = EVENT_NODES[e]; node; node = node->next) {
+					if (switch_events_match(*event, node)) {
+						(*event)->bind_user_data = node->user_data;
+						node->callback(*event);
+					}
+				}
 
-			if (e == SWITCH_EVENT_ALL) {
-				break;
+				if (e == SWITCH_EVENT_ALL) {
+					break;
+				}
 			}
 		}
 		switch_thread_rwlock_unlock(RWLOCK);
@@ -483,27 +950,37 @@ SWITCH_DECLARE(switch_status_t) switch_event_reserve_subclass_detailed(const cha
 
 SWITCH_DECLARE(void) switch_core_memory_reclaim_events(void)
 {
-#ifdef SWITCH_EVENT_RECYCLE
+	event_recycle_obj_t *batch, *obj;
+	uint32_t count;
+	int kind;
 
-	void *pop;
-	int size;
-	size = switch_queue_size(EVENT_RECYCLE_QUEUE);
+	if (!EVENT_DEPOT.mutex) {
+		return;
+	}
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Returning %d recycled event(s) %d bytes\n", size, (int) sizeof(switch_event_t) * size);
-	size = switch_queue_size(EVENT_HEADER_RECYCLE_QUEUE);
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Returning %d recycled event header(s) %d bytes\n",
-					  size, (int) sizeof(switch_event_header_t) * size);
+	/* caches their threads are in the middle of using stay with them */
+	switch_mutex_lock(EVENT_DEPOT.mutex);
+	event_thread_cache_sweep(SWITCH_TRUE);
 
-	while (switch_queue_trypop(EVENT_HEADER_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS && pop) {
-		free(pop);
-	}
-	while (switch_queue_trypop(EVENT_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS && pop) {
-		free(pop);
-	}
-#else
-	return;
-#endif
+	for (kind = 0; kind < EVENT_OBJ_KINDS; kind++) {
+		count = 0;
 
+		while ((batch = EVENT_DEPOT.batches[kind])) {
+			EVENT_DEPOT.batches[kind] = batch->next_batch;
+			while ((obj = batch)) {
+				batch = obj->next;
+				free(obj);
+				count++;
+			}
+		}
+		EVENT_DEPOT.batch_count[kind] = 0;
+		EVENT_DEPOT.cached[kind] = 0;
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Returning %u recycled %s(s) %u bytes\n",
+						  count, EVENT_OBJ_NAMES[kind], count * (uint32_t) EVENT_OBJ_SIZES[kind]);
+	}
+	EVENT_DEPOT.bytes = 0;
+	switch_mutex_unlock(EVENT_DEPOT.mutex);
 }
 
 SWITCH_DECLARE(switch_status_t) switch_event_shutdown(void)
@@ -577,6 +1054,12 @@ SWITCH_DECLARE(switch_status_t) switch_event_shutdown(void)
 	}
 
 	switch_core_hash_destroy(&CUSTOM_HASH);
+
+	switch_thread_rwlock_wrlock(RWLOCK);
+	switch_event_flush_routes();
+	switch_core_hash_destroy(&ROUTE_HASH);
+	switch_thread_rwlock_unlock(RWLOCK);
+
 	switch_core_memory_reclaim_events();
 
 	return SWITCH_STATUS_SUCCESS;
@@ -615,6 +1098,89 @@ static void launch_dispatch_threads(uint32_t max, int len, switch_memory_pool_t
 	SOFT_MAX_DISPATCH = index;
 }
 
+SWITCH_DECLARE(switch_status_t) switch_event_set_dispatch_key(const char *keys, uint32_t shards)
+{
+	char *dup, *argv[EVENT_SHARD_KEYS_MAX] = { 0 };
+	uint32_t sanity = MAX_DISPATCH_VAL * 2;
+	int argc, x;
+
+	if (EVENT_SHARDS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Event dispatch sharding is already configured, restart to change it.\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (zstr(keys) || !SYSTEM_RUNNING) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (shards < 1) {
+		shards = 1;
+	} else if (shards > MAX_DISPATCH) {
+		shards = MAX_DISPATCH;
+	}
+
+	dup = switch_core_strdup(RUNTIME_POOL, keys);
+	argc = switch_separate_string(dup, ',', argv, (sizeof(argv) / sizeof(argv[0])));
+
+	for (x = 0; x < argc; x++) {
+		if (!zstr(argv[x])) {
+			EVENT_SHARD_KEYS[EVENT_SHARD_KEY_COUNT++] = argv[x];
+		}
+	}
+
+	if (!EVENT_SHARD_KEY_COUNT) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_mutex_lock(EVENT_QUEUE_MUTEX);
+	while (SOFT_MAX_DISPATCH < shards && --sanity) {
+		launch_dispatch_threads(SOFT_MAX_DISPATCH + 1, DISPATCH_QUEUE_LEN, RUNTIME_POOL);
+	}
+	/* producers only look at the keys once this is set */
+	EVENT_SHARDS = SOFT_MAX_DISPATCH < shards ? SOFT_MAX_DISPATCH : shards;
+	switch_mutex_unlock(EVENT_QUEUE_MUTEX);
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Event dispatch sharded on %s over %u threads\n", keys, EVENT_SHARDS);
+
+	return EVENT_SHARDS ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+}
+
+/* Events carrying a dispatch key go straight to the dispatch queue picked by hashing the key so everything
+   about one call or conference is delivered in the order it was fired.  The producer is often a session or media
+   thread so it never waits on a shard: a full shard means its subscribers are slow and the event spills to the
+   priority queues instead, counted in the shard's spills. */
+static switch_status_t event_shard_push(switch_event_t *event)
+{
+	const char *key = NULL;
+	switch_ssize_t klen = -1;
+	uint32_t x, shard, spills;
+
+	for (x = 0; x < EVENT_SHARD_KEY_COUNT && !key; x++) {
+		key = switch_event_get_header(event, EVENT_SHARD_KEYS[x]);
+	}
+
+	if (zstr(key)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	shard = switch_ci_hashfunc_default(key, &klen) % EVENT_SHARDS;
+
+	if (switch_queue_trypush(EVENT_DISPATCH_QUEUE[shard], event) == SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	switch_mutex_lock(EVENT_QUEUE_MUTEX);
+	spills = EVENT_SHARD_SPILLS[shard]++;
+	switch_mutex_unlock(EVENT_QUEUE_MUTEX);
+
+	if (!(spills % 1000)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Event dispatch shard %u is full, delivery order for [%s] is not guaranteed (%u spills).\n",
+						  shard, key, spills + 1);
+	}
+
+	return SWITCH_STATUS_FALSE;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_event_init(switch_memory_pool_t *pool)
 {
 	switch_threadattr_t *thd_attr;;
@@ -634,6 +1200,10 @@ SWITCH_DECLARE(switch_status_t) switch_event_init(switch_memory_pool_t *pool)
 	switch_mutex_init(&POOL_LOCK, SWITCH_MUTEX_NESTED, RUNTIME_POOL);
 	switch_mutex_init(&EVENT_QUEUE_MUTEX, SWITCH_MUTEX_NESTED, RUNTIME_POOL);
 	switch_core_hash_init(&CUSTOM_HASH, RUNTIME_POOL);
+	switch_thread_rwlock_create(&ROUTE_RWLOCK, RUNTIME_POOL);
+	switch_core_hash_init(&ROUTE_HASH, NULL);
+	switch_mutex_init(&EVENT_DEPOT.mutex, SWITCH_MUTEX_NESTED, RUNTIME_POOL);
+	switch_threadkey_private_create(&EVENT_DEPOT.key, event_thread_cache_destroy, RUNTIME_POOL);
 
 	switch_mutex_lock(EVENT_QUEUE_MUTEX);
 	SYSTEM_RUNNING = -1;
@@ -647,10 +1217,6 @@ SWITCH_DECLARE(switch_status_t) switch_event_init(switch_memory_pool_t *pool)
 	switch_queue_create(&EVENT_QUEUE[0], POOL_COUNT_MAX + 10, THRUNTIME_POOL);
 	switch_queue_create(&EVENT_QUEUE[1], POOL_COUNT_MAX + 10, THRUNTIME_POOL);
 	switch_queue_create(&EVENT_QUEUE[2], POOL_COUNT_MAX + 10, THRUNTIME_POOL);
-#ifdef SWITCH_EVENT_RECYCLE
-	switch_queue_create(&EVENT_RECYCLE_QUEUE, 250000, THRUNTIME_POOL);
-	switch_queue_create(&EVENT_HEADER_RECYCLE_QUEUE, 250000, THRUNTIME_POOL);
-#endif
 
 	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
 	switch_threadattr_priority_increase(thd_attr);
@@ -675,25 +1241,12 @@ SWITCH_DECLARE(switch_status_t) switch_event_init(switch_memory_pool_t *pool)
 SWITCH_DECLARE(switch_status_t) switch_event_create_subclass_detailed(const char *file, const char *func, int line,
 																	  switch_event_t **event, switch_event_types_t event_id, const char *subclass_name)
 {
-#ifdef SWITCH_EVENT_RECYCLE
-	void *pop;
-#endif
-
 	*event = NULL;
 
 	if ((event_id != SWITCH_EVENT_CLONE && event_id != SWITCH_EVENT_CUSTOM) && subclass_name) {
 		return SWITCH_STATUS_GENERR;
 	}
-#ifdef SWITCH_EVENT_RECYCLE
-	if (EVENT_RECYCLE_QUEUE && switch_queue_trypop(EVENT_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS && pop) {
-		*event = (switch_event_t *) pop;
-	} else {
-#endif
-		*event = ALLOC(sizeof(switch_event_t));
-		switch_assert(*event);
-#ifdef SWITCH_EVENT_RECYCLE
-	}
-#endif
+	*event = event_obj_alloc(EVENT_OBJ_EVENT);
 
 	memset(*event, 0, sizeof(switch_event_t));
 
@@ -721,6 +1274,133 @@ SWITCH_DECLARE(switch_status_t) switch_event_set_priority(switch_event_t *event,
 	return SWITCH_STATUS_SUCCESS;
 }
 
+/* Events carrying more than EVENT_INDEX_MIN_HEADERS headers get a small open
+   addressing index keyed on the header hash.  The index is only touched from
+   the paths that already modify the header list so lookups stay read only. */
+#define EVENT_INDEX_MIN_HEADERS 16
+#define EVENT_INDEX_MIN_SIZE 64
+
+static void event_index_free(switch_event_t *event)
+{
+	switch_safe_free(event->index);
+	event->index_size = 0;
+	event->index_used = 0;
+	event->index_dups = 0;
+}
+
+static void event_index_insert(switch_event_t *event, switch_event_header_t *header, int top)
+{
+	uint32_t mask = event->index_size - 1;
+	uint32_t i = (uint32_t) header->hash & mask;
+	switch_event_header_t *hp;
+
+	while ((hp = event->index[i])) {
+		if (hp->hash == header->hash && !strcasecmp(hp->name, header->name)) {
+			/* the index always points at the first header of a given name */
+			event->index_dups = 1;
+			if (top) {
+				event->index[i] = header;
+			}
+			return;
+		}
+		i = (i + 1) & mask;
+	}
+
+	event->index[i] = header;
+	event->index_used++;
+}
+
+static void event_index_build(switch_event_t *event)
+{
+	switch_event_header_t *hp;
+	uint32_t size = EVENT_INDEX_MIN_SIZE;
+
+	event_index_free(event);
+
+	while (size < event->header_count * 4) {
+		size <<= 1;
+	}
+
+	if (!(event->index = calloc(size, sizeof(*event->index)))) {
+		/* lookups just fall back to walking the list */
+		return;
+	}
+
+	event->index_size = size;
+
+	for (hp = event->headers; hp; hp = hp->next) {
+		event_index_insert(event, hp, 0);
+	}
+}
+
+static void event_index_link(switch_event_t *event, switch_event_header_t *header, int top)
+{
+	event->header_count++;
+
+	if (!event->index) {
+		if (event->header_count > EVENT_INDEX_MIN_HEADERS) {
+			event_index_build(event);
+		}
+		return;
+	}
+
+	if ((event->index_used + 1) * 2 > event->index_size) {
+		event_index_build(event);
+		return;
+	}
+
+	event_index_insert(event, header, top);
+}
+
+static void event_index_unlink(switch_event_t *event, switch_event_header_t *header)
+{
+	uint32_t mask, i, j, k;
+	switch_event_header_t *hp;
+
+	event->header_count--;
+
+	if (!event->index) {
+		return;
+	}
+
+	if (event->header_count <= EVENT_INDEX_MIN_HEADERS / 2) {
+		event_index_free(event);
+		return;
+	}
+
+	mask = event->index_size - 1;
+	i = (uint32_t) header->hash & mask;
+
+	while ((hp = event->index[i]) && hp != header) {
+		i = (i + 1) & mask;
+	}
+
+	if (!hp) {
+		/* a later duplicate, the index never pointed at it */
+		return;
+	}
+
+	if (event->index_dups) {
+		/* another header of the same name may need to take its slot, let the caller rebuild */
+		event_index_free(event);
+		return;
+	}
+
+	event->index[i] = NULL;
+	event->index_used--;
+
+	/* backward shift the rest of the probe run into the hole */
+	for (j = (i + 1) & mask; (hp = event->index[j]); j = (j + 1) & mask) {
+		k = (uint32_t) hp->hash & mask;
+
+		if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j)) {
+			event->index[i] = hp;
+			event->index[j] = NULL;
+			i = j;
+		}
+	}
+}
+
 SWITCH_DECLARE(switch_status_t) switch_event_rename_header(switch_event_t *event, const char *header_name, const char *new_header_name)
 {
 	switch_event_header_t *hp;
@@ -746,6 +1426,10 @@ SWITCH_DECLARE(switch_status_t) switch_event_rename_header(switch_event_t *event
 		}
 	}
 
+	if (x && event->index) {
+		event_index_build(event);
+	}
+
 	return x ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
 }
 
@@ -763,6 +1447,20 @@ SWITCH_DECLARE(switch_event_header_t *) switch_event_get_header_ptr(switch_event
 
 	hash = switch_ci_hashfunc_default(header_name, &hlen);
 
+	if (event->index) {
+		uint32_t mask = event->index_size - 1;
+		uint32_t i = (uint32_t) hash & mask;
+
+		while ((hp = event->index[i])) {
+			if (hp->hash == hash && !strcasecmp(hp->name, header_name)) {
+				return hp;
+			}
+			i = (i + 1) & mask;
+		}
+
+		return NULL;
+	}
+
 	for (hp = event->headers; hp; hp = hp->next) {
 		if ((!hp->hash || hash == hp->hash) && !strcasecmp(hp->name, header_name)) {
 			return hp;
@@ -823,6 +1521,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_del_header_val(switch_event_t *even
 			if (hp == event->last_header || !hp->next) {
 				event->last_header = lp;
 			}
+			event_index_unlink(event, hp);
 			FREE(hp->name);
 
 			if (hp->idx) {
@@ -836,20 +1535,17 @@ SWITCH_DECLARE(switch_status_t) switch_event_del_header_val(switch_event_t *even
 
 			FREE(hp->value);
 			
-			memset(hp, 0, sizeof(*hp));
-#ifdef SWITCH_EVENT_RECYCLE
-			if (switch_queue_trypush(EVENT_HEADER_RECYCLE_QUEUE, hp) != SWITCH_STATUS_SUCCESS) {
-				FREE(hp);
-			}
-#else
-			FREE(hp);
-#endif
+			event_obj_free(EVENT_OBJ_HEADER, hp);
 			status = SWITCH_STATUS_SUCCESS;
 		} else {
 			lp = hp;
 		}
 	}
 
+	if (status == SWITCH_STATUS_SUCCESS && !event->index && event->header_count > EVENT_INDEX_MIN_HEADERS) {
+		event_index_build(event);
+	}
+
 	return status;
 }
 
@@ -857,17 +1553,7 @@ static switch_event_header_t *new_header(const char *header_name)
 {
 	switch_event_header_t *header;
 
-#ifdef SWITCH_EVENT_RECYCLE
-		void *pop;
-		if (EVENT_HEADER_RECYCLE_QUEUE && switch_queue_trypop(EVENT_HEADER_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS) {
-			header = (switch_event_header_t *) pop;
-		} else {
-#endif
-			header = ALLOC(sizeof(*header));
-			switch_assert(header);
-#ifdef SWITCH_EVENT_RECYCLE
-		}
-#endif	
+		header = event_obj_alloc(EVENT_OBJ_HEADER);
 
 		memset(header, 0, sizeof(*header));
 		header->name = DUP(header_name);
@@ -1092,6 +1778,8 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 			}
 			event->last_header = header;
 		}
+
+		event_index_link(event, header, (stack & SWITCH_STACK_TOP));
 	}
 
  end:
@@ -1195,25 +1883,14 @@ SWITCH_DECLARE(void) switch_event_destroy(switch_event_t **event)
 			FREE(this->value);
 			
 
-#ifdef SWITCH_EVENT_RECYCLE
-			if (switch_queue_trypush(EVENT_HEADER_RECYCLE_QUEUE, this) != SWITCH_STATUS_SUCCESS) {
-				FREE(this);
-			}
-#else
-			FREE(this);
-#endif
+			event_obj_free(EVENT_OBJ_HEADER, this);
 
 
 		}
 		FREE(ep->body);
 		FREE(ep->subclass_name);
-#ifdef SWITCH_EVENT_RECYCLE
-		if (switch_queue_trypush(EVENT_RECYCLE_QUEUE, ep) != SWITCH_STATUS_SUCCESS) {
-			FREE(ep);
-		}
-#else
-		FREE(ep);
-#endif
+		switch_safe_free(ep->index);
+		event_obj_free(EVENT_OBJ_EVENT, ep);
 
 	}
 	*event = NULL;
@@ -1781,6 +2458,10 @@ SWITCH_DECLARE(switch_status_t) switch_event_fire_detailed(const char *file, con
 		(*event)->event_user_data = user_data;
 	}
 
+	if (EVENT_SHARDS && event_shard_push(*event) == SWITCH_STATUS_SUCCESS) {
+		goto end;
+	}
+
 	for (;;) {
 		for (index = (*event)->priority; index < 3; index++) {
 			if (switch_queue_trypush(EVENT_QUEUE[index], *event) == SWITCH_STATUS_SUCCESS) {
@@ -1833,6 +2514,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_bind_removable(const char *id, swit
 		event_node->event_id = event;
 		if (subclass_name) {
 			event_node->subclass_name = DUP(subclass_name);
+			event_node->dynamic = !strncasecmp(subclass_name, "file:", 5) || !strncasecmp(subclass_name, "func:", 5);
 		}
 		event_node->callback = callback;
 		event_node->user_data = user_data;
@@ -1842,6 +2524,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_bind_removable(const char *id, swit
 		}
 
 		EVENT_NODES[event] = event_node;
+		switch_event_flush_routes();
 		switch_thread_rwlock_unlock(RWLOCK);
 		switch_mutex_unlock(BLOCK);
 		/* </LOCKED> ----------------------------------------------- */
@@ -1896,6 +2579,10 @@ SWITCH_DECLARE(switch_status_t) switch_event_unbind_callback(switch_event_callba
 			}
 		}
 	}
+
+	if (status == SWITCH_STATUS_SUCCESS) {
+		switch_event_flush_routes();
+	}
 	switch_mutex_unlock(BLOCK);
 	switch_thread_rwlock_unlock(RWLOCK);
 	/* </LOCKED> ----------------------------------------------- */
@@ -1932,6 +2619,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_unbind(switch_event_node_t **node)
 			FREE(n);
 			*node = NULL;
 			status = SWITCH_STATUS_SUCCESS;
+			switch_event_flush_routes();
 			break;
 		}
 		lnp = np;
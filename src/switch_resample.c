@@ -34,6 +34,7 @@
 #include <switch_resample.h>
 #ifndef WIN32
 #include <switch_private.h>
+#include "private/switch_mix_kernels.h"
 #endif
 #include <speex/speex_resampler.h>
 
@@ -252,6 +253,67 @@ SWITCH_DECLARE(uint32_t) switch_merge_sln(int16_t *data, uint32_t samples, int16
 	return x;
 }
 
+/* Conference style mixing kernels, see private/switch_mix_kernels.h */
+typedef void (*mix_sln_accumulate_fn_t) (int32_t *, const int16_t *, uint32_t);
+typedef void (*mix_sln_subtract_saturate_fn_t) (int16_t *, const int32_t *, const int16_t *, uint32_t);
+
+static mix_sln_accumulate_fn_t mix_sln_accumulate_fn = NULL;
+static mix_sln_accumulate_fn_t mix_sln_subtract_fn = NULL;
+static mix_sln_subtract_saturate_fn_t mix_sln_subtract_saturate_fn = NULL;
+
+static void mix_sln_select_kernels(void)
+{
+	mix_sln_accumulate_fn_t acc = mix_sln_accumulate_scalar;
+	mix_sln_accumulate_fn_t rem = mix_sln_subtract_scalar;
+	mix_sln_subtract_saturate_fn_t sub = mix_sln_subtract_saturate_scalar;
+
+#ifdef SWITCH_MIX_X86_DISPATCH
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		acc = mix_sln_accumulate_avx2;
+		rem = mix_sln_subtract_avx2;
+		sub = mix_sln_subtract_saturate_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		acc = mix_sln_accumulate_sse2;
+		rem = mix_sln_subtract_sse2;
+		sub = mix_sln_subtract_saturate_sse2;
+	}
+#endif
+
+	/* any thread racing us here picks the same set so there is nothing to lock */
+	mix_sln_subtract_saturate_fn = sub;
+	mix_sln_subtract_fn = rem;
+	mix_sln_accumulate_fn = acc;
+}
+
+SWITCH_DECLARE(void) switch_mix_sln_accumulate(int32_t *mix, const int16_t *data, uint32_t samples)
+{
+	if (!mix_sln_accumulate_fn) {
+		mix_sln_select_kernels();
+	}
+
+	mix_sln_accumulate_fn(mix, data, samples);
+}
+
+SWITCH_DECLARE(void) switch_mix_sln_subtract(int32_t *mix, const int16_t *data, uint32_t samples)
+{
+	if (!mix_sln_subtract_fn) {
+		mix_sln_select_kernels();
+	}
+
+	mix_sln_subtract_fn(mix, data, samples);
+}
+
+SWITCH_DECLARE(void) switch_mix_sln_subtract_saturate(int16_t *out, const int32_t *mix, const int16_t *own, uint32_t samples)
+{
+	if (!mix_sln_subtract_saturate_fn) {
+		mix_sln_select_kernels();
+	}
+
+	mix_sln_subtract_saturate_fn(out, mix, own, samples);
+}
+
 SWITCH_DECLARE(void) switch_mux_channels(int16_t *data, switch_size_t samples, uint32_t channels)
 {
 	int16_t *buf;
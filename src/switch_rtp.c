@@ -54,6 +54,12 @@
 
 #include "stfu.h"
 
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_RECVMMSG)
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#define SWITCH_RTP_IO_ENGINE
+#endif
+
 #define rtp_header_len 12
 #define RTP_START_PORT 16384
 #define RTP_END_PORT 32768
@@ -255,6 +261,9 @@ struct switch_rtp {
 	uint16_t last_seq;
 	switch_time_t last_read_time;
 	switch_size_t last_flush_packet_count;
+#ifdef SWITCH_RTP_IO_ENGINE
+	struct rtp_io_link *io_link;
+#endif
 };
 
 struct switch_rtcp_senderinfo {
@@ -810,6 +819,453 @@ static void zrtp_logger(int level, const char *data, int len, int offset)
 }
 #endif
 
+/* Optional receive engine: a few threads wait on every session socket with epoll and drain them with recvmmsg,
+   handing the packets to each session on its own queue so the session threads never touch the socket.  Only timer
+   driven sessions use it, they pop their queue on the tick without waiting on it, which saves the poll, recvfrom,
+   poll they would do per packet.  A blocking reader would trade those for a queue wake up per packet instead.
+   scripts/c/rtp_io_bench measures both ways of reading over loopback. */
+#ifdef SWITCH_RTP_IO_ENGINE
+#define RTP_IO_MAX_THREADS 64
+#define RTP_IO_BATCH 32
+#define RTP_IO_EVENTS 256
+#define RTP_IO_QUEUE_LEN 64
+#define RTP_IO_FREE_MAX 4096
+#define RTP_IO_PACKET_LEN 1536
+
+struct rtp_io_thread;
+
+typedef struct rtp_io_packet {
+	struct rtp_io_thread *io;
+	switch_size_t len;
+	switch_size_t size;
+	switch_size_t salen;
+	struct sockaddr_storage from;
+	char data[1];
+} rtp_io_packet_t;
+
+typedef struct rtp_io_slot {
+	int fd;
+	int dead;
+	struct rtp_io_link *link;
+	struct rtp_io_slot *next;
+} rtp_io_slot_t;
+
+struct rtp_io_link {
+	switch_queue_t *queue;
+	rtp_io_packet_t *pending;
+	rtp_io_slot_t *slot;
+	struct rtp_io_thread *io;
+	uint32_t drops;
+};
+
+typedef struct rtp_io_thread {
+	int id;
+	int epfd;
+	switch_thread_t *thread;
+	switch_mutex_t *mutex;
+	switch_queue_t *free_queue;
+	rtp_io_slot_t *dead;
+	uint32_t sessions;
+	struct mmsghdr msgs[RTP_IO_BATCH];
+	struct iovec iov[RTP_IO_BATCH];
+	struct sockaddr_storage addrs[RTP_IO_BATCH];
+	rtp_msg_t bufs[RTP_IO_BATCH];
+} rtp_io_thread_t;
+#endif
+
+static struct {
+	uint32_t thread_count;
+#ifdef SWITCH_RTP_IO_ENGINE
+	int running;
+	uint32_t started;
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+	rtp_io_thread_t *threads[RTP_IO_MAX_THREADS];
+#endif
+} RTP_IO;
+
+SWITCH_DECLARE(void) switch_rtp_set_io_threads(uint32_t threads)
+{
+#ifdef SWITCH_RTP_IO_ENGINE
+	if (RTP_IO.started) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "RTP I/O threads are already running, restart to change them.\n");
+		return;
+	}
+
+	if (threads > RTP_IO_MAX_THREADS) {
+		threads = RTP_IO_MAX_THREADS;
+	}
+
+	RTP_IO.thread_count = threads;
+#else
+	if (threads) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "rtp-io-threads is not implemented on this platform\n");
+	}
+#endif
+}
+
+#ifdef SWITCH_RTP_IO_ENGINE
+static rtp_io_packet_t *rtp_io_packet_get(rtp_io_thread_t *io, switch_size_t len)
+{
+	rtp_io_packet_t *pkt = NULL;
+	void *pop = NULL;
+	switch_size_t size = RTP_IO_PACKET_LEN;
+
+	if (len <= size && switch_queue_trypop(io->free_queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		return (rtp_io_packet_t *) pop;
+	}
+
+	if (len > size) {
+		size = len;
+	}
+
+	if ((pkt = malloc(sizeof(*pkt) + size))) {
+		pkt->io = io;
+		pkt->size = size;
+	}
+
+	return pkt;
+}
+
+static void rtp_io_packet_put(rtp_io_packet_t *pkt)
+{
+	if (pkt->size == RTP_IO_PACKET_LEN && switch_queue_trypush(pkt->io->free_queue, pkt) == SWITCH_STATUS_SUCCESS) {
+		return;
+	}
+
+	free(pkt);
+}
+
+static void rtp_io_read_slot(rtp_io_thread_t *io, rtp_io_slot_t *slot)
+{
+	struct rtp_io_link *link = slot->link;
+	rtp_io_packet_t *pkt;
+	int i, n;
+
+	for (i = 0; i < RTP_IO_BATCH; i++) {
+		io->iov[i].iov_base = &io->bufs[i];
+		io->iov[i].iov_len = sizeof(io->bufs[i]);
+		memset(&io->msgs[i], 0, sizeof(io->msgs[i]));
+		io->msgs[i].msg_hdr.msg_iov = &io->iov[i];
+		io->msgs[i].msg_hdr.msg_iovlen = 1;
+		io->msgs[i].msg_hdr.msg_name = &io->addrs[i];
+		io->msgs[i].msg_hdr.msg_namelen = sizeof(io->addrs[i]);
+	}
+
+	if ((n = recvmmsg(slot->fd, io->msgs, RTP_IO_BATCH, MSG_DONTWAIT, NULL)) <= 0) {
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (!(pkt = rtp_io_packet_get(io, io->msgs[i].msg_len))) {
+			link->drops++;
+			continue;
+		}
+
+		pkt->len = io->msgs[i].msg_len;
+		pkt->salen = io->msgs[i].msg_hdr.msg_namelen;
+		memcpy(&pkt->from, &io->addrs[i], pkt->salen);
+		memcpy(pkt->data, &io->bufs[i], pkt->len);
+
+		if (switch_queue_trypush(link->queue, pkt) != SWITCH_STATUS_SUCCESS) {
+			/* the session is not keeping up, drop like a full socket buffer would */
+			link->drops++;
+			rtp_io_packet_put(pkt);
+		}
+	}
+}
+
+static void *SWITCH_THREAD_FUNC rtp_io_thread_run(switch_thread_t *thread, void *obj)
+{
+	rtp_io_thread_t *io = (rtp_io_thread_t *) obj;
+	struct epoll_event events[RTP_IO_EVENTS];
+	rtp_io_slot_t *slot;
+	int i, n;
+
+	while (RTP_IO.running) {
+		n = epoll_wait(io->epfd, events, RTP_IO_EVENTS, 100);
+
+		switch_mutex_lock(io->mutex);
+		for (i = 0; i < n; i++) {
+			slot = (rtp_io_slot_t *) events[i].data.ptr;
+
+			if (!slot->dead) {
+				rtp_io_read_slot(io, slot);
+			}
+		}
+
+		/* slots removed from the epoll set can still show up in the events we just handled, free them now */
+		while ((slot = io->dead)) {
+			io->dead = slot->next;
+			free(slot);
+		}
+		switch_mutex_unlock(io->mutex);
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "RTP I/O thread %d ended\n", io->id);
+
+	return NULL;
+}
+
+static void rtp_io_start(void)
+{
+	switch_threadattr_t *thd_attr = NULL;
+	rtp_io_thread_t *io;
+	uint32_t x;
+
+	switch_mutex_lock(RTP_IO.mutex);
+
+	if (RTP_IO.started) {
+		goto end;
+	}
+
+	RTP_IO.running = 1;
+
+	for (x = 0; x < RTP_IO.thread_count; x++) {
+		if (!(io = switch_core_alloc(RTP_IO.pool, sizeof(*io)))) {
+			break;
+		}
+
+		if ((io->epfd = epoll_create(RTP_IO_EVENTS)) < 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot create RTP I/O epoll set: %s\n", strerror(errno));
+			break;
+		}
+
+		io->id = x;
+		switch_mutex_init(&io->mutex, SWITCH_MUTEX_NESTED, RTP_IO.pool);
+		switch_queue_create(&io->free_queue, RTP_IO_FREE_MAX, RTP_IO.pool);
+
+		switch_threadattr_create(&thd_attr, RTP_IO.pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_threadattr_priority_increase(thd_attr);
+		switch_thread_create(&io->thread, thd_attr, rtp_io_thread_run, io, RTP_IO.pool);
+
+		RTP_IO.threads[RTP_IO.started++] = io;
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Started %u RTP I/O thread(s)\n", RTP_IO.started);
+
+  end:
+
+	switch_mutex_unlock(RTP_IO.mutex);
+}
+
+static void rtp_io_shutdown(void)
+{
+	rtp_io_thread_t *io;
+	rtp_io_slot_t *slot;
+	switch_status_t st;
+	void *pop;
+	uint32_t x;
+
+	if (!RTP_IO.started) {
+		return;
+	}
+
+	RTP_IO.running = 0;
+
+	for (x = 0; x < RTP_IO.started; x++) {
+		io = RTP_IO.threads[x];
+		switch_thread_join(&st, io->thread);
+		close(io->epfd);
+
+		while ((slot = io->dead)) {
+			io->dead = slot->next;
+			free(slot);
+		}
+
+		while (switch_queue_trypop(io->free_queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+			free(pop);
+		}
+	}
+
+	RTP_IO.started = 0;
+}
+
+static void rtp_io_unregister(switch_rtp_t *rtp_session)
+{
+	struct rtp_io_link *link = rtp_session->io_link;
+	struct epoll_event ev = { 0 };
+	rtp_io_thread_t *io;
+	rtp_io_slot_t *slot;
+	void *pop;
+
+	if (!link || !(slot = link->slot)) {
+		return;
+	}
+
+	io = link->io;
+	epoll_ctl(io->epfd, EPOLL_CTL_DEL, slot->fd, &ev);
+
+	switch_mutex_lock(io->mutex);
+	slot->dead = 1;
+	slot->next = io->dead;
+	io->dead = slot;
+	link->slot = NULL;
+	io->sessions--;
+	switch_mutex_unlock(io->mutex);
+
+	if (link->drops) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "RTP I/O dropped %u packet(s) for port %d\n", link->drops, rtp_session->local_port);
+		link->drops = 0;
+	}
+
+	while (switch_queue_trypop(link->queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		rtp_io_packet_put((rtp_io_packet_t *) pop);
+	}
+
+	/* wake up a reader waiting on the queue */
+	switch_queue_interrupt_all(link->queue);
+}
+
+static void rtp_io_register(switch_rtp_t *rtp_session)
+{
+	struct rtp_io_link *link;
+	struct epoll_event ev = { 0 };
+	rtp_io_thread_t *io = NULL;
+	rtp_io_slot_t *slot;
+	uint32_t x;
+	int fd;
+
+	if (!RTP_IO.thread_count || !RTP_IO.mutex || !rtp_session->sock_input || !switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER)) {
+		return;
+	}
+
+	if (!RTP_IO.started) {
+		rtp_io_start();
+	}
+
+	if (!RTP_IO.started || (fd = switch_socket_fd_get(rtp_session->sock_input)) < 0) {
+		return;
+	}
+
+	rtp_io_unregister(rtp_session);
+
+	if (!(link = rtp_session->io_link)) {
+		link = switch_core_alloc(rtp_session->pool, sizeof(*link));
+		switch_queue_create(&link->queue, RTP_IO_QUEUE_LEN, rtp_session->pool);
+		rtp_session->io_link = link;
+	}
+
+	for (x = 0; x < RTP_IO.started; x++) {
+		if (!io || RTP_IO.threads[x]->sessions < io->sessions) {
+			io = RTP_IO.threads[x];
+		}
+	}
+
+	switch_zmalloc(slot, sizeof(*slot));
+	slot->fd = fd;
+	slot->link = link;
+
+	switch_mutex_lock(io->mutex);
+	link->io = io;
+	link->slot = slot;
+	io->sessions++;
+	switch_mutex_unlock(io->mutex);
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = slot;
+
+	if (epoll_ctl(io->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot add RTP socket to I/O thread %d: %s\n", io->id, strerror(errno));
+		switch_mutex_lock(io->mutex);
+		link->slot = NULL;
+		io->sessions--;
+		switch_mutex_unlock(io->mutex);
+		free(slot);
+	}
+}
+
+static void rtp_io_destroy(switch_rtp_t *rtp_session)
+{
+	struct rtp_io_link *link = rtp_session->io_link;
+
+	if (!link) {
+		return;
+	}
+
+	rtp_io_unregister(rtp_session);
+
+	if (link->pending) {
+		rtp_io_packet_put(link->pending);
+		link->pending = NULL;
+	}
+
+	rtp_session->io_link = NULL;
+}
+
+static switch_status_t rtp_io_poll(switch_rtp_t *rtp_session, switch_interval_time_t timeout)
+{
+	struct rtp_io_link *link = rtp_session->io_link;
+	switch_status_t status;
+	void *pop = NULL;
+
+	if (link->pending) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (timeout > 0) {
+		status = switch_queue_pop_timeout(link->queue, &pop, timeout);
+	} else {
+		status = switch_queue_trypop(link->queue, &pop);
+	}
+
+	if (status == SWITCH_STATUS_SUCCESS && pop) {
+		link->pending = (rtp_io_packet_t *) pop;
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	/* an unregistered link means the socket is going away */
+	return link->slot ? SWITCH_STATUS_TIMEOUT : SWITCH_STATUS_BREAK;
+}
+
+static switch_status_t rtp_io_recv(switch_rtp_t *rtp_session, switch_size_t *bytes)
+{
+	struct rtp_io_link *link = rtp_session->io_link;
+	rtp_io_packet_t *pkt;
+	void *pop = NULL;
+
+	if ((pkt = link->pending)) {
+		link->pending = NULL;
+	} else if (switch_queue_trypop(link->queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		pkt = (rtp_io_packet_t *) pop;
+	} else {
+		*bytes = 0;
+		return SWITCH_STATUS_BREAK;
+	}
+
+	if (pkt->len < *bytes) {
+		*bytes = pkt->len;
+	}
+
+	memcpy(&rtp_session->recv_msg, pkt->data, *bytes);
+	switch_sockaddr_set_raw(rtp_session->from_addr, &pkt->from, pkt->salen);
+	rtp_io_packet_put(pkt);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+#endif
+
+static switch_status_t rtp_recvfrom(switch_rtp_t *rtp_session, switch_size_t *bytes)
+{
+#ifdef SWITCH_RTP_IO_ENGINE
+	if (rtp_session->io_link && (rtp_session->io_link->slot || rtp_session->io_link->pending)) {
+		return rtp_io_recv(rtp_session, bytes);
+	}
+#endif
+	return switch_socket_recvfrom(rtp_session->from_addr, rtp_session->sock_input, 0, (void *) &rtp_session->recv_msg, bytes);
+}
+
+static switch_status_t rtp_read_poll(switch_rtp_t *rtp_session, int32_t *fdr, switch_interval_time_t timeout)
+{
+#ifdef SWITCH_RTP_IO_ENGINE
+	if (rtp_session->io_link && (rtp_session->io_link->slot || rtp_session->io_link->pending)) {
+		return rtp_io_poll(rtp_session, timeout);
+	}
+#endif
+	return switch_poll(rtp_session->read_pollfd, 1, fdr, timeout);
+}
+
 SWITCH_DECLARE(void) switch_rtp_init(switch_memory_pool_t *pool)
 {
 #ifdef ENABLE_ZRTP
@@ -854,6 +1310,10 @@ SWITCH_DECLARE(void) switch_rtp_init(switch_memory_pool_t *pool)
 	srtp_init();
 #endif
 	switch_mutex_init(&port_lock, SWITCH_MUTEX_NESTED, pool);
+#ifdef SWITCH_RTP_IO_ENGINE
+	RTP_IO.pool = pool;
+	switch_mutex_init(&RTP_IO.mutex, SWITCH_MUTEX_NESTED, pool);
+#endif
 	global_init = 1;
 }
 
@@ -878,6 +1338,10 @@ SWITCH_DECLARE(void) switch_rtp_shutdown(void)
 		return;
 	}
 
+#ifdef SWITCH_RTP_IO_ENGINE
+	rtp_io_shutdown();
+#endif
+
 	switch_mutex_lock(port_lock);
 
 	for (hi = switch_hash_first(NULL, alloc_hash); hi; hi = switch_hash_next(hi)) {
@@ -1194,6 +1658,10 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_set_local_address(switch_rtp_t *rtp_s
 
 	switch_socket_create_pollset(&rtp_session->read_pollfd, rtp_session->sock_input, SWITCH_POLLIN | SWITCH_POLLERR, rtp_session->pool);
 
+#ifdef SWITCH_RTP_IO_ENGINE
+	rtp_io_register(rtp_session);
+#endif
+
 	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {
 		if ((status = enable_local_rtcp_socket(rtp_session, err)) == SWITCH_STATUS_SUCCESS) {
 			*err = "Success";
@@ -1274,6 +1742,11 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_udptl_mode(switch_rtp_t *rtp_session)
 		switch_clear_flag_locked(rtp_session, SWITCH_RTP_FLAG_USE_TIMER);
 	}
 
+#ifdef SWITCH_RTP_IO_ENGINE
+	/* udptl reads block on the socket */
+	rtp_io_unregister(rtp_session);
+#endif
+
 	switch_clear_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP);
 
 	if (rtp_session->rtcp_sock_input) {
@@ -2038,6 +2511,9 @@ SWITCH_DECLARE(void) switch_rtp_kill_socket(switch_rtp_t *rtp_session)
 	switch_mutex_lock(rtp_session->flag_mutex);
 	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_IO)) {
 		switch_clear_flag(rtp_session, SWITCH_RTP_FLAG_IO);
+#ifdef SWITCH_RTP_IO_ENGINE
+		rtp_io_unregister(rtp_session);
+#endif
 		if (rtp_session->sock_input) {
 			ping_socket(rtp_session);
 			switch_socket_shutdown(rtp_session->sock_input, SWITCH_SHUTDOWN_READWRITE);
@@ -2110,6 +2586,10 @@ SWITCH_DECLARE(void) switch_rtp_destroy(switch_rtp_t **rtp_session)
 		stfu_n_destroy(&(*rtp_session)->jb);
 	}
 
+#ifdef SWITCH_RTP_IO_ENGINE
+	rtp_io_destroy(*rtp_session);
+#endif
+
 	sock = (*rtp_session)->sock_input;
 	(*rtp_session)->sock_input = NULL;
 	switch_socket_close(sock);
@@ -2464,7 +2944,7 @@ static void do_flush(switch_rtp_t *rtp_session)
 		do {
 			if (switch_rtp_ready(rtp_session)) {
 				bytes = sizeof(rtp_msg_t);
-				switch_socket_recvfrom(rtp_session->from_addr, rtp_session->sock_input, 0, (void *) &rtp_session->recv_msg, &bytes);
+				rtp_recvfrom(rtp_session, &bytes);
 				if (bytes) {
 					int do_cng = 0;
 
@@ -2511,7 +2991,7 @@ static switch_status_t read_rtp_packet(switch_rtp_t *rtp_session, switch_size_t
 	switch_assert(bytes);
  more:
 	*bytes = sizeof(rtp_msg_t);
-	status = switch_socket_recvfrom(rtp_session->from_addr, rtp_session->sock_input, 0, (void *) &rtp_session->recv_msg, bytes);
+	status = rtp_recvfrom(rtp_session, bytes);
 	ts = ntohl(rtp_session->recv_msg.header.ts);
 
 	if (*bytes) {
@@ -2854,7 +3334,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 		if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER)) {
 			if ((switch_test_flag(rtp_session, SWITCH_RTP_FLAG_AUTOFLUSH) || switch_test_flag(rtp_session, SWITCH_RTP_FLAG_STICKY_FLUSH)) &&
 				rtp_session->read_pollfd) {
-				if (switch_poll(rtp_session->read_pollfd, 1, &fdr, 0) == SWITCH_STATUS_SUCCESS) {
+				if (rtp_read_poll(rtp_session, &fdr, 0) == SWITCH_STATUS_SUCCESS) {
 					status = read_rtp_packet(rtp_session, &bytes, flags, SWITCH_FALSE);
 					/* switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Initial (%i) %d\n", status, bytes); */
 					if (status != SWITCH_STATUS_FALSE) {
@@ -2862,7 +3342,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 					}
 
 					if (bytes) {
-						if (switch_poll(rtp_session->read_pollfd, 1, &fdr, 0) == SWITCH_STATUS_SUCCESS) {
+						if (rtp_read_poll(rtp_session, &fdr, 0) == SWITCH_STATUS_SUCCESS) {
 							/* switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Trigger %d\n", rtp_session->hot_hits); */
 							rtp_session->hot_hits += rtp_session->samples_per_interval;
 						} else {
@@ -2920,7 +3400,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 				pt = 0;
 			}
 
-			poll_status = switch_poll(rtp_session->read_pollfd, 1, &fdr, pt);
+			poll_status = rtp_read_poll(rtp_session, &fdr, pt);
 
 			if (rtp_session->dtmf_data.out_digit_dur > 0) {
 				return_cng_frame();